@@ -0,0 +1,93 @@
+#!/usr/bin/env python
+
+# Compares the output of a quantized decoder with the fp32 output of the
+# same model, e.g.
+#
+#   amun -c config.yml --n-best < input > fp32.txt
+#   amun -c config.yml --n-best --cpu-int8-output < input > int8.txt
+#   scripts/score_drift.py fp32.txt int8.txt
+#
+# Reports the share of identical translations, the BLEU of the quantized
+# translations against the fp32 ones and, for n-best lists, the drift of
+# the best total score.
+
+from __future__ import print_function, division
+
+import sys
+import math
+import argparse
+from collections import Counter
+
+# Parse arguments.
+parser = argparse.ArgumentParser()
+parser.add_argument('reference', help="fp32 output, plain text or n-best list")
+parser.add_argument('candidate', help="quantized output, same format")
+parser.add_argument('--max-bleu-drop', type=float, default=None,
+                    help="Exit with 1 if BLEU is below 100 - this value")
+args = parser.parse_args()
+
+
+def read_output(filename):
+    """Returns a list of (translation, score or None), best entry per sentence."""
+    best = []
+    seen = set()
+    with open(filename) as f:
+        for line in f:
+            fields = [field.strip() for field in line.rstrip('\n').split('|||')]
+            if len(fields) >= 3:
+                if fields[0] in seen:
+                    continue
+                seen.add(fields[0])
+                best.append((fields[1], float(fields[-1])))
+            else:
+                best.append((fields[0], None))
+    return best
+
+
+def ngrams(words, n):
+    return Counter(tuple(words[i:i + n]) for i in range(len(words) - n + 1))
+
+
+def bleu(references, candidates):
+    if references == candidates:
+        return 100.0
+    matches = [0] * 4
+    totals = [0] * 4
+    refLength = 0
+    candLength = 0
+    for ref, cand in zip(references, candidates):
+        ref = ref.split()
+        cand = cand.split()
+        refLength += len(ref)
+        candLength += len(cand)
+        for n in range(1, 5):
+            refNgrams = ngrams(ref, n)
+            candNgrams = ngrams(cand, n)
+            matches[n - 1] += sum(min(count, refNgrams[g]) for g, count in candNgrams.items())
+            totals[n - 1] += max(len(cand) - n + 1, 0)
+    if min(matches) == 0 or candLength == 0:
+        return 0.0
+    logPrecision = sum(math.log(m / t) for m, t in zip(matches, totals)) / 4
+    brevity = min(1.0, math.exp(1 - refLength / candLength))
+    return 100 * brevity * math.exp(logPrecision)
+
+
+reference = read_output(args.reference)
+candidate = read_output(args.candidate)
+if len(reference) != len(candidate):
+    sys.exit("Different number of sentences: {} vs {}".format(len(reference), len(candidate)))
+
+identical = sum(1 for r, c in zip(reference, candidate) if r[0] == c[0])
+score = bleu([r[0] for r in reference], [c[0] for c in candidate])
+
+print("Sentences: {}".format(len(reference)))
+print("Identical: {} ({:.2f}%)".format(identical, 100 * identical / max(len(reference), 1)))
+print("BLEU vs reference: {:.2f}".format(score))
+
+drifts = [abs(r[1] - c[1]) for r, c in zip(reference, candidate)
+          if r[1] is not None and c[1] is not None]
+if drifts:
+    print("Score drift: mean {:.4f} max {:.4f}".format(sum(drifts) / len(drifts), max(drifts)))
+
+if args.max_bleu_drop is not None and score < 100 - args.max_bleu_drop:
+    sys.exit(1)
@@ -0,0 +1,49 @@
+#include "common/allocation_counter.h"
+
+#ifdef COUNT_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new so that AllocationCount sees every heap
+// allocation; the matrix buffers are allocated aligned, outside of it, and
+// keep counting themselves.
+
+void* operator new(std::size_t size) {
+  amunmt::CountAllocation();
+  if (void* ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  amunmt::CountAllocation();
+  return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return operator new(size, std::nothrow);
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+#endif
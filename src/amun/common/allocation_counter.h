@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+namespace amunmt {
+
+// Number of allocations made on the calling thread. By default only the
+// matrix buffers count: CountAllocation is called when one is allocated or
+// grown. Built with COUNT_ALLOCATIONS, every operator new counts as well,
+// which also shows the hypotheses, beams and other small objects. Once the
+// buffers of a search have reached their working size, decoding steps
+// should not move the default count any more.
+inline size_t& AllocationCount() {
+  static thread_local size_t count = 0;
+  return count;
+}
+
+inline void CountAllocation() {
+  ++AllocationCount();
+}
+
+// what AllocationCount counts, for the logs
+#ifdef COUNT_ALLOCATIONS
+const char* const COUNTED_ALLOCATIONS = "heap allocations";
+#else
+const char* const COUNTED_ALLOCATIONS = "matrix buffer allocations";
+#endif
+
+}
@@ -3,6 +3,9 @@
 #include <functional>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 #include "common/types.h"
 #include "scorer.h"
@@ -17,12 +20,18 @@ class BestHypsBase
         bool returnNBestList,
         bool isInputFiltered,
         bool returnAttentionWeights,
-        const std::map<std::string, float>& weights)
+        const std::map<std::string, float>& weights,
+        float pruneRelative = 0.0f,
+        float pruneAbsolute = 0.0f,
+        size_t maxCandidatesPerParent = 0)
     : forbidUNK_(forbidUNK),
       returnNBestList_(returnNBestList),
       isInputFiltered_(isInputFiltered),
       returnAttentionWeights_(returnAttentionWeights),
-      weights_(weights)
+      weights_(weights),
+      pruneRelative_(pruneRelative),
+      pruneAbsolute_(pruneAbsolute),
+      maxCandidatesPerParent_(maxCandidatesPerParent)
     {}
 
     BestHypsBase(const BestHypsBase&) = delete;
@@ -45,12 +54,60 @@ class BestHypsBase
     virtual void resizeCosts(uint size) = 0;
 
   protected:
+    // Threshold pruning of the candidates of one sentence, as in Freitag and
+    // Al-Onaizan, "Beam Search Strategies for Neural Machine Translation".
+    // costs and keys are sorted best first, keys are row * vocabSize + word.
+    // Drops candidates whose probability is below pruneRelative_ times the
+    // best one, whose cost is more than pruneAbsolute_ below the best one, and
+    // any beyond the first maxCandidatesPerParent_ of the same parent. The
+    // best candidate is always kept, so a beam never ends up empty.
+    void PruneCandidates(std::vector<float>& costs, std::vector<size_t>& keys, size_t vocabSize) {
+      if (costs.empty()
+          || (pruneRelative_ <= 0.0f && pruneAbsolute_ <= 0.0f && maxCandidatesPerParent_ == 0)) {
+        return;
+      }
+
+      float threshold = std::numeric_limits<float>::lowest();
+      if (pruneRelative_ > 0.0f) {
+        threshold = std::max(threshold, costs[0] + std::log(pruneRelative_));
+      }
+      if (pruneAbsolute_ > 0.0f) {
+        threshold = std::max(threshold, costs[0] - pruneAbsolute_);
+      }
+
+      parentCounts_.clear();
+      size_t kept = 0;
+      for (size_t i = 0; i < costs.size() && (i == 0 || costs[i] >= threshold); ++i) {
+        if (maxCandidatesPerParent_ > 0) {
+          size_t parent = keys[i] / vocabSize;
+          auto it = std::find_if(parentCounts_.begin(), parentCounts_.end(),
+                                 [=](const std::pair<size_t, size_t>& p) { return p.first == parent; });
+          if (it == parentCounts_.end()) {
+            parentCounts_.emplace_back(parent, 0);
+            it = parentCounts_.end() - 1;
+          }
+          if (++it->second > maxCandidatesPerParent_) {
+            continue;
+          }
+        }
+        costs[kept] = costs[i];
+        keys[kept] = keys[i];
+        ++kept;
+      }
+      costs.resize(kept);
+      keys.resize(kept);
+    }
+
     const bool forbidUNK_;
     const bool returnNBestList_;
     const bool isInputFiltered_;
     const bool returnAttentionWeights_;
     const std::map<std::string, float> weights_;
 
+    const float pruneRelative_;
+    const float pruneAbsolute_;
+    const size_t maxCandidatesPerParent_;
+    std::vector<std::pair<size_t, size_t>> parentCounts_;
 };
 
 typedef std::shared_ptr<BestHypsBase> BestHypsBasePtr;
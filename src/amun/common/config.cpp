@@ -18,15 +18,18 @@ do { if(vm_.count(key) > 0) { \
 }} while(0)
 
 bool Config::Has(const std::string& key) const {
+  std::lock_guard<std::mutex> lock(mutex_);
   return config_[key];
 }
 
 YAML::Node Config::Get(const std::string& key) const {
-  return config_[key];
+  std::lock_guard<std::mutex> lock(mutex_);
+  return YAML::Clone(config_[key]);
 }
 
-const YAML::Node& Config::Get() const {
-  return config_;
+YAML::Node Config::Get() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return YAML::Clone(config_);
 }
 
 void ProcessPaths(YAML::Node& node, const boost::filesystem::path& configPath, bool isPath) {
@@ -112,6 +115,14 @@ void Validate(const YAML::Node& config) {
   amunmt_UTIL_THROW_IF2(config["maxi-batch"].as<int>() < config["mini-batch"].as<int>(),
                 "maxi-batch (" << config["maxi-batch"].as<int>()
                 << ") < mini-batch (" << config["mini-batch"].as<int>() << ")");
+
+  // 0 turns either pruning off
+  float pruneRelative = config["prune-relative"].as<float>();
+  amunmt_UTIL_THROW_IF2(!(pruneRelative >= 0.0f && pruneRelative <= 1.0f),
+                "prune-relative (" << pruneRelative << ") has to be in (0, 1], or 0 for off");
+  float pruneAbsolute = config["prune-absolute"].as<float>();
+  amunmt_UTIL_THROW_IF2(!(pruneAbsolute >= 0.0f),
+                "prune-absolute (" << pruneAbsolute << ") has to be positive, or 0 for off");
 }
 
 void OutputRec(const YAML::Node node, YAML::Emitter& out) {
@@ -192,6 +203,10 @@ void Config::AddOptions(size_t argc, char** argv) {
      "Overwrite bpe section in config with bpe code file.")
     ("no-debpe", po::value(&debpe)->zero_tokens()->default_value(false),
      "Providing bpe is on, turn off deBPE of the output.")
+    ("load-threads", po::value<size_t>()->default_value(0),
+     "Number of threads loading the vocabularies, scorers and BPE codes at startup, 0 = one per core")
+    ("reload-on-sighup", po::value<bool>()->zero_tokens()->default_value(false),
+     "Load the scorers again on SIGHUP and switch to them without stopping the translation")
 #ifdef CUDA
     ("devices,d", po::value(&devices)->multitoken()->default_value(std::vector<size_t>(1, 0), "0"),
      "CUDA device(s) to use, set to 0 by default, "
@@ -209,6 +224,14 @@ void Config::AddOptions(size_t argc, char** argv) {
      ("cpu-threads", po::value<size_t>()->default_value(1),
       "Number of threads on the CPU.")
   #endif
+    ("cpu-parallel-encoder", po::value<bool>()->zero_tokens()->default_value(false),
+     "Run the forward and backward encoder RNNs on separate threads.")
+    ("cpu-int8-output", po::value<bool>()->zero_tokens()->default_value(false),
+     "Quantize the output layer to int8 at load time (faster, small score drift).")
+    ("cpu-int16", po::value<bool>()->zero_tokens()->default_value(false),
+     "Quantize the recurrent and attention matrices to int16 at load time.")
+    ("cpu-mmap-hugepages", po::value<bool>()->zero_tokens()->default_value(false),
+     "Ask for huge pages for the mapped model files (madvise, where the kernel supports it).")
 #endif
 
 #ifdef HAS_FPGA
@@ -255,11 +278,28 @@ void Config::AddOptions(size_t argc, char** argv) {
     ("normalize,n", po::value<bool>()->zero_tokens()->default_value(false),
      "Normalize scores by translation length after decoding")
     ("softmax-filter,f", po::value<std::vector<std::string>>()->multitoken()->default_value(std::vector<std::string>(0), ""),
-     "Filter final softmax: path to file with alignment [N first words]")
+     "Filter final softmax: path to file with alignment, text or converted by amun-shortlist "
+     "[N first words] [max translations per source word]")
+    ("softmax-filter-per-sentence", po::value<bool>()->zero_tokens()->default_value(false),
+     "Filter the softmax for every sentence instead of every mini-batch, sentences are then decoded one at a time")
     ("allow-unk,u", po::value<bool>()->zero_tokens()->default_value(false),
      "Allow generation of UNK")
     ("n-best", po::value<bool>()->zero_tokens()->default_value(false),
      "Output n-best list with n = beam-size")
+    ("no-early-stopping", po::value<bool>()->zero_tokens()->default_value(false),
+     "Keep expanding a sentence after no live hypothesis can beat its finished ones")
+    ("prune-relative", po::value<float>()->default_value(0.0f),
+     "Drop candidates whose probability is below this fraction of the best candidate's, 0 = off")
+    ("prune-absolute", po::value<float>()->default_value(0.0f),
+     "Drop candidates whose log-probability is more than this below the best candidate's, 0 = off")
+    ("max-candidates-per-parent", po::value<size_t>()->default_value(0),
+     "Keep at most this many candidates expanded from the same hypothesis, 0 = off")
+    ("search", po::value<std::string>()->default_value("beam"),
+     "Search algorithm: beam, best-first")
+    ("best-first-batch", po::value<size_t>()->default_value(4),
+     "Best-first search: number of frontier entries per sentence expanded together")
+    ("best-first-frontier", po::value<size_t>()->default_value(10000),
+     "Best-first search: keep at most this many (up to twice between trims) frontier entries per sentence, 0 = unlimited")
   ;
 
   po::options_description configuration("Configuration meta options");
@@ -310,8 +350,18 @@ void Config::AddOptions(size_t argc, char** argv) {
   SET_OPTION("return-alignment", bool);
   SET_OPTION("return-soft-alignment", bool);
   SET_OPTION("softmax-filter", std::vector<std::string>);
+  SET_OPTION("softmax-filter-per-sentence", bool);
   SET_OPTION("allow-unk", bool);
+  SET_OPTION("no-early-stopping", bool);
+  SET_OPTION("prune-relative", float);
+  SET_OPTION("prune-absolute", float);
+  SET_OPTION("max-candidates-per-parent", size_t);
+  SET_OPTION("search", std::string);
+  SET_OPTION("best-first-batch", size_t);
+  SET_OPTION("best-first-frontier", size_t);
   SET_OPTION("no-debpe", bool);
+  SET_OPTION("load-threads", size_t);
+  SET_OPTION("reload-on-sighup", bool);
   SET_OPTION("beam-size", size_t);
   SET_OPTION("mini-batch", size_t);
   SET_OPTION("maxi-batch", size_t);
@@ -323,6 +373,10 @@ void Config::AddOptions(size_t argc, char** argv) {
 #endif
 #ifdef HAS_CPU
   SET_OPTION("cpu-threads", size_t);
+  SET_OPTION("cpu-parallel-encoder", bool);
+  SET_OPTION("cpu-int8-output", bool);
+  SET_OPTION("cpu-int16", bool);
+  SET_OPTION("cpu-mmap-hugepages", bool);
 #endif
 #ifdef HAS_FPGA
   SET_OPTION("fpga-threads", size_t);
@@ -382,6 +436,7 @@ void Config::AddOptions(size_t argc, char** argv) {
 void Config::LogOptions() {
   std::stringstream ss;
   YAML::Emitter out;
+  std::lock_guard<std::mutex> lock(mutex_);
   OutputRec(config_, out);
   LOG(info)->info("Options: {}\n", out.c_str());
 }
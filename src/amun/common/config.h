@@ -1,5 +1,6 @@
 #pragma once
 
+#include <mutex>
 #include <yaml-cpp/yaml.h>
 #include <boost/program_options.hpp>
 
@@ -7,9 +8,13 @@
 
 namespace amunmt {
 
+// yaml-cpp is not safe to read from several threads at once, even a lookup
+// of an existing key may change the node, so every access to config_ after
+// AddOptions holds mutex_. The nodes handed out are copies.
 class Config {
   private:
     YAML::Node config_;
+    mutable std::mutex mutex_;
     
   public:
     std::string inputPath;
@@ -20,15 +25,17 @@ class Config {
     
     template <typename T>
     T Get(const std::string& key) const {
+      std::lock_guard<std::mutex> lock(mutex_);
       return config_[key].as<T>();
     }
     
-    const YAML::Node& Get() const;
+    YAML::Node Get() const;
     
     void AddOptions(size_t argc, char** argv);
     
     template <class OStream>
     friend OStream& operator<<(OStream& out, const Config& config) {
+      std::lock_guard<std::mutex> lock(config.mutex_);
       out << config.config_;
       return out;
     }
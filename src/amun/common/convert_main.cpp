@@ -0,0 +1,70 @@
+#include <iostream>
+#include <string>
+#include <boost/program_options.hpp>
+
+#include "common/logging.h"
+#include "common/exception.h"
+#include "cpu/binary_model.h"
+#include "cpu/dl4mt/model.h"
+#include "cpu/nematus/model.h"
+
+using namespace amunmt;
+namespace po = boost::program_options;
+
+// Converts an npz model to the native format of the CPU backend, which amun
+// loads by mapping the file. The weights are stored in the forms the
+// options select; decoding has to ask for the same ones.
+int main(int argc, char* argv[])
+{
+  std::string inputPath, outputPath, type;
+  CPU::mblas::QuantizationOptions quantization;
+
+  po::options_description options("amun-convert options");
+  options.add_options()
+    ("input,i", po::value(&inputPath)->required(), "npz model")
+    ("output,o", po::value(&outputPath)->required(), "Native model file")
+    ("type,t", po::value(&type)->default_value("dl4mt"), "Model type: dl4mt or nematus2")
+    ("cpu-int16", po::bool_switch(&quantization.int16),
+     "Quantize the recurrent and attention matrices to int16, for --cpu-int16")
+    ("cpu-int8-output", po::bool_switch(&quantization.int8Output),
+     "Quantize the output layer to int8, for --cpu-int8-output")
+    ("vocab-major-output", po::bool_switch(&quantization.vocabMajorOutput),
+     "Keep the output layer by target word, for --softmax-filter")
+    ("help,h", "Print this help message and exit");
+
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    if (vm.count("help")) {
+      std::cout << options << std::endl;
+      return 0;
+    }
+    po::notify(vm);
+  } catch (const po::error& e) {
+    std::cerr << "Error: " << e.what() << std::endl << std::endl;
+    std::cerr << options << std::endl;
+    return 1;
+  }
+
+  spdlog::stderr_logger_mt("info");
+
+  amunmt_UTIL_THROW_IF2(type != "dl4mt" && type != "nematus2", "Unknown model type " << type);
+  amunmt_UTIL_THROW_IF2(quantization.int8Output && quantization.vocabMajorOutput,
+                        "--cpu-int8-output and --vocab-major-output exclude each other");
+  amunmt_UTIL_THROW_IF2(CPU::BinaryModel::IsBinary(inputPath), inputPath << " is already converted");
+
+  CPU::NpzConverter model(inputPath);
+  CPU::BinaryModelWriter writer(type, quantization);
+  if (type == "nematus2") {
+    CPU::Nematus::Weights weights(model, 0, quantization);
+    weights.Save(writer);
+    writer.Save(outputPath);
+  } else {
+    CPU::dl4mt::Weights weights(model, 0, quantization);
+    weights.Save(writer);
+    writer.Save(outputPath);
+  }
+  LOG(info)->info("Wrote {}", outputPath);
+
+  return 0;
+}
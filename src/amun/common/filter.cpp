@@ -5,18 +5,41 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
-#include <set>
-#include <cmath>
+#include <cstring>
+#include <numeric>
 #include <algorithm>
 
 #include "common/god.h"
 #include "common/vocab.h"
 #include "common/utils.h"
 #include "common/types.h"
+#include "common/exception.h"
 
 namespace amunmt {
 
-Filter::Filter(const size_t numFirstWords) : numFirstWords_(numFirstWords) {}
+namespace {
+
+// binary form: this magic, the source and target vocabulary sizes and the
+// number of translations as uint32, then offsets_ and translations_
+const char MAGIC[8] = {'A', 'M', 'U', 'N', 'L', 'E', 'X', '1'};
+
+template <class T>
+void Write(std::ofstream& out, const T* data, size_t count) {
+  out.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+template <class T>
+void Read(std::ifstream& in, T* data, size_t count) {
+  in.read(reinterpret_cast<char*>(data), count * sizeof(T));
+}
+
+}
+
+Filter::Filter(const size_t numFirstWords)
+  : numFirstWords_(numFirstWords),
+    maxNumTranslation_(0),
+    trgVocabSize_(0)
+{}
 
 Filter::Filter(const Vocab& srcVocab,
                const Vocab& trgVocab,
@@ -24,22 +47,38 @@ Filter::Filter(const Vocab& srcVocab,
                const size_t numFirstWords,
                const size_t maxNumTranslation)
   : numFirstWords_(numFirstWords),
-    mapper_(ParseAlignmentFile(srcVocab,
-                               trgVocab,
-                               path,
-                               maxNumTranslation,
-                               numFirstWords)) {}
-
-std::vector<Words> Filter::ParseAlignmentFile(const Vocab& srcVocab,
-                                              const Vocab& trgVocab,
-                                              const std::string& path,
-                                              const size_t maxNumTranslation,
-                                              const size_t numNFirst) {
-  std::map<Word, std::vector<std::pair<Word, float>>> mapper;
+    maxNumTranslation_(maxNumTranslation),
+    trgVocabSize_(trgVocab.size())
+{
+  if (IsBinary(path)) {
+    Load(srcVocab, trgVocab, path);
+  } else {
+    ParseAlignmentFile(srcVocab, trgVocab, path);
+  }
+}
+
+bool Filter::IsBinary(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(MAGIC)];
+  return in.read(magic, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+void Filter::ParseAlignmentFile(const Vocab& srcVocab,
+                                const Vocab& trgVocab,
+                                const std::string& path) {
+  struct Translation {
+    uint32_t src;
+    uint32_t trg;
+    float prob;
+  };
+  std::vector<Translation> entries;
+
   std::ifstream filterFile(path);
+  amunmt_UTIL_THROW_IF2(!filterFile, "Cannot open softmax filter file " << path);
   std::string line;
   std::string delimiter = "";
   size_t srcIndex, trgIndex;
+  std::vector<std::string> tokens;
   while (std::getline(filterFile, line)) {
     if (delimiter ==  "") {
        if (line.find("\t", 0) != std::string::npos) {
@@ -56,61 +95,119 @@ std::vector<Words> Filter::ParseAlignmentFile(const Vocab& srcVocab,
     if (line.size() == 0) {
       continue;
     }
-    std::vector<std::string> tokens;
+    tokens.clear();
     Split(line, tokens, delimiter);
     if (tokens.size() != 3) {
       LOG(info)->info("Filter: broken line: {}", line);
       continue;
     }
-    if (trgVocab[tokens[trgIndex]] != 1 && srcVocab[tokens[srcIndex]] != 1) {
-      mapper[srcVocab[tokens[1]]].push_back(std::make_pair(trgVocab[tokens[trgIndex]],
-                                                           std::stof(tokens[2])));
+    size_t src = srcVocab[tokens[srcIndex]];
+    size_t trg = trgVocab[tokens[trgIndex]];
+    if (trg != UNK_ID && src != UNK_ID) {
+      entries.push_back({uint32_t(src), uint32_t(trg), std::stof(tokens[2])});
     }
   }
-  std::vector<Words> vecMapper(srcVocab.size());
-  for (size_t i = 0; i < srcVocab.size(); ++i) {
-    if (mapper.find(i) != mapper.end()) {
-      std::sort(mapper[i].begin(), mapper[i].end(),
-          [](const std::pair<Word, float>& left,
-            const std::pair<Word, float>& right) {
-            return left.second > right.second; });
-      for (size_t j = 0; j < std::min(mapper[i].size(), maxNumTranslation); ++j) {
-        if (mapper[i][j].first >= numNFirst) {
-          vecMapper[i].push_back(mapper[i][j].first);
-        }
-      }
-      // std::cerr << "MAP :" << i  << " " << srcVocab[i] << " " << vecMapper[i].size()
-                // <<  " " << mapper[i].size() << std::endl;
+
+  // counting sort by source word, within one the file order is kept so
+  // that equally probable translations stay in a deterministic order
+  offsets_.assign(srcVocab.size() + 1, 0);
+  for (const auto& entry : entries) {
+    ++offsets_[entry.src + 1];
+  }
+  std::partial_sum(offsets_.begin(), offsets_.end(), offsets_.begin());
+
+  std::vector<uint32_t> next(offsets_.begin(), offsets_.end() - 1);
+  std::vector<Translation> sorted(entries.size());
+  for (const auto& entry : entries) {
+    sorted[next[entry.src]++] = entry;
+  }
+
+  translations_.resize(sorted.size());
+  for (size_t s = 0; s < srcVocab.size(); ++s) {
+    std::stable_sort(sorted.begin() + offsets_[s], sorted.begin() + offsets_[s + 1],
+                     [](const Translation& left, const Translation& right) {
+                       return left.prob > right.prob; });
+    for (size_t i = offsets_[s]; i < offsets_[s + 1]; ++i) {
+      translations_[i] = sorted[i].trg;
     }
   }
-  return vecMapper;
 }
 
-// Words Filter::GetFilteredVocab(const Words& srcWords, const size_t maxVocabSize) const {
-  // std::set<Word> filtered;
-
-  // for(size_t i = 0; i < std::min(numFirstWords_, maxVocabSize); ++i) {
-    // filtered.insert(i);
-  // }
-
-  // for (const auto& srcWord : srcWords) {
-    // size_t licz = 0;
-    // for (const auto& trgWord : mapper_[srcWord]) {
-      // if (trgWord < maxVocabSize) {
-        // ++licz;
-      // }
-    // }
-    // for (const auto& trgWord : mapper_[srcWord]) {
-      // if (trgWord < maxVocabSize) {
-        // filtered.insert(trgWord);
-      // }
-    // }
-  // }
-
-  // Words output(filtered.begin(), filtered.end());
-
-  // return output;
-// }
+void Filter::Load(const Vocab& srcVocab,
+                  const Vocab& trgVocab,
+                  const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(MAGIC)];
+  uint32_t sizes[3];
+  Read(in, magic, sizeof(magic));
+  Read(in, sizes, 3);
+  amunmt_UTIL_THROW_IF2(!in, "Broken softmax filter file " << path);
+  amunmt_UTIL_THROW_IF2(sizes[0] != srcVocab.size() || sizes[1] != trgVocab.size(),
+                        "Softmax filter " << path << " was converted for vocabularies of "
+                        << sizes[0] << " and " << sizes[1] << " words, not "
+                        << srcVocab.size() << " and " << trgVocab.size());
+
+  offsets_.resize(sizes[0] + 1);
+  translations_.resize(sizes[2]);
+  Read(in, offsets_.data(), offsets_.size());
+  Read(in, translations_.data(), translations_.size());
+  amunmt_UTIL_THROW_IF2(!in || offsets_.front() != 0 || offsets_.back() != translations_.size(),
+                        "Broken softmax filter file " << path);
+  for (size_t s = 0; s + 1 < offsets_.size(); ++s) {
+    amunmt_UTIL_THROW_IF2(offsets_[s] > offsets_[s + 1], "Broken softmax filter file " << path);
+  }
+  for (uint32_t trg : translations_) {
+    amunmt_UTIL_THROW_IF2(trg >= sizes[1], "Broken softmax filter file " << path);
+  }
+}
+
+void Filter::Save(const std::string& path) const {
+  std::ofstream out(path, std::ios::binary);
+  uint32_t sizes[3] = {uint32_t(offsets_.size() - 1), uint32_t(trgVocabSize_),
+                       uint32_t(translations_.size())};
+  Write(out, MAGIC, sizeof(MAGIC));
+  Write(out, sizes, 3);
+  Write(out, offsets_.data(), offsets_.size());
+  Write(out, translations_.data(), translations_.size());
+  amunmt_UTIL_THROW_IF2(!out, "Cannot write softmax filter file " << path);
+}
+
+Words Filter::GetFilteredVocab(const Words& srcWords, const size_t maxVocabSize) const {
+  const size_t numFirst = std::min(numFirstWords_, maxVocabSize);
+
+  // a target word is in the output once its stamp is the epoch of this
+  // call, so the stamps never need clearing
+  thread_local std::vector<uint32_t> stamps;
+  thread_local uint32_t epoch = 0;
+  if (stamps.size() < maxVocabSize) {
+    stamps.resize(maxVocabSize, 0);
+  }
+  if (++epoch == 0) {
+    std::fill(stamps.begin(), stamps.end(), 0);
+    epoch = 1;
+  }
+
+  Words output(numFirst);
+  std::iota(output.begin(), output.end(), 0);
+
+  for (Word srcWord : srcWords) {
+    if (srcWord + 1 >= offsets_.size()) {
+      continue;
+    }
+    size_t begin = offsets_[srcWord];
+    size_t end = std::min<size_t>(offsets_[srcWord + 1], begin + maxNumTranslation_);
+    for (size_t i = begin; i < end; ++i) {
+      Word trgWord = translations_[i];
+      if (trgWord >= numFirst && trgWord < maxVocabSize && stamps[trgWord] != epoch) {
+        stamps[trgWord] = epoch;
+        output.push_back(trgWord);
+      }
+    }
+  }
+  std::sort(output.begin() + numFirst, output.end());
+
+  return output;
+}
 
 size_t Filter::GetNumFirstWords() const {
   return numFirstWords_;
@@ -2,8 +2,8 @@
 
 #include <string>
 #include <memory>
-#include <unordered_set>
-#include <set>
+#include <vector>
+#include <cstdint>
 
 #include "common/types.h"
 
@@ -11,6 +11,12 @@ namespace amunmt {
 
 class Vocab;
 
+// Lexical shortlist for the output layer: the first numFirstWords target
+// words plus the maxNumTranslation most probable translations of every
+// source word. The table is kept in CSR form, the translations of source
+// word s are translations_[offsets_[s] .. offsets_[s + 1]), most probable
+// first. It is read from a text alignment file or from the binary form
+// written by Save (see amun-shortlist), which is recognized by its header.
 class Filter {
   public:
     Filter(const size_t numFirstWords=10000);
@@ -21,43 +27,37 @@ class Filter {
            const size_t numFirstWords=10000,
            const size_t maxNumTranslation=1000);
 
-    template<class T>
-    Words GetFilteredVocab(const T& srcWords, const size_t maxVocabSize) const {
-      std::set<Word> filtered;
-
-      for(size_t i = 0; i < std::min(numFirstWords_, maxVocabSize); ++i) {
-        filtered.insert(i);
-      }
-
-      for (const auto& srcWord : srcWords) {
-        for (const auto& trgWord : mapper_[srcWord]) {
-          if (trgWord < maxVocabSize) {
-            filtered.insert(trgWord);
-          }
-        }
-      }
-
-      Words output(filtered.begin(), filtered.end());
-
-      return output;
-    }
+    // Sorted target words for srcWords, only those below maxVocabSize.
+    // Runs in time linear in the output, apart from sorting the
+    // translations that are not among the first words.
+    Words GetFilteredVocab(const Words& srcWords, const size_t maxVocabSize) const;
 
     size_t GetNumFirstWords() const;
 
     void SetNumFirstWords(size_t numFirstWords);
 
-    static std::vector<Words> ParseAlignmentFile(const Vocab& srcVocab,
-                                                 const Vocab& trgVocab,
-                                                 const std::string& path,
-                                                 const size_t maxNumTranslation,
-                                                 const size_t numNFirst);
+    // The whole table, independent of numFirstWords and maxNumTranslation,
+    // which are applied when the shortlist is built.
+    void Save(const std::string& path) const;
+
+    static bool IsBinary(const std::string& path);
 
   private:
+    void ParseAlignmentFile(const Vocab& srcVocab,
+                            const Vocab& trgVocab,
+                            const std::string& path);
+
+    void Load(const Vocab& srcVocab,
+              const Vocab& trgVocab,
+              const std::string& path);
+
     size_t numFirstWords_;
-    const std::vector<Words> mapper_;
+    size_t maxNumTranslation_;
+    size_t trgVocabSize_;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint32_t> translations_;
 };
 
 typedef std::unique_ptr<Filter> FilterPtr;
 
 }
-
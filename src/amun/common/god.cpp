@@ -1,5 +1,13 @@
 #include <vector>
 #include <sstream>
+#include <thread>
+#include <future>
+#include <algorithm>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/timer/timer.hpp>
 
@@ -27,6 +35,28 @@ namespace amunmt {
 
 std::unordered_map<std::string, boost::timer::cpu_timer> timers;
 
+namespace {
+
+// the device a thread was given with its first Search
+thread_local std::unique_ptr<DeviceInfo> threadDevice;
+
+// --reload-on-sighup: the signal handler writes RELOAD to the pipe, Cleanup
+// writes STOP_RELOAD
+int reloadPipe[2] = {-1, -1};
+struct sigaction previousAction;
+const char RELOAD = 'r';
+const char STOP_RELOAD = 'q';
+
+void OnReloadSignal(int) {
+  int saved = errno;
+  char c = RELOAD;
+  ssize_t written = write(reloadPipe[1], &c, 1);
+  (void)written;
+  errno = saved;
+}
+
+}
+
 God::God()
  : threadIncr_(0)
 {
@@ -71,15 +101,6 @@ God& God::Init(int argc, char** argv) {
   
   config_.LogOptions();
 
-  if (Get("source-vocab").IsSequence()) {
-    for (auto sourceVocabPath : Get<std::vector<std::string>>("source-vocab")) {
-      sourceVocabs_.emplace_back(new Vocab(sourceVocabPath));
-    }
-  } else {
-    sourceVocabs_.emplace_back(new Vocab(Get<std::string>("source-vocab")));
-  }
-  targetVocab_.reset(new Vocab(Get<std::string>("target-vocab")));
-
   weights_ = Get<std::map<std::string, float>>("weights");
 
   if(Get<bool>("show-weights")) {
@@ -90,115 +111,308 @@ God& God::Init(int argc, char** argv) {
     exit(0);
   }
 
-  LoadScorers();
-  LoadFiltering();
-
-  if (Has("input-file")) {
-    LOG(info)->info("Reading from {}", Get<std::string>("input-file"));
-    inputStream_.reset(new InputFileStream(Get<std::string>("input-file")));
-  }
-  else {
-    LOG(info)->info("Reading from stdin");
-    inputStream_.reset(new InputFileStream(std::cin));
-  }
-
-  LoadPrePostProcessing();
+  Load();
 
   size_t totalThreads = GetTotalThreads();
   LOG(info)->info("Total number of threads: {}", totalThreads);
   amunmt_UTIL_THROW_IF2(totalThreads == 0, "Total number of threads is 0");
 
-  pool_.reset(new ThreadPool(totalThreads, totalThreads));
+  {
+    // a reload waits for the pool
+    std::lock_guard<std::mutex> lock(reloadMutex_);
+    if (Get<bool>("reload-on-sighup")) {
+      WatchReloadSignal();
+    }
+    pool_.reset(new ThreadPool(totalThreads, totalThreads));
+  }
 
   return *this;
 }
 
 void God::Cleanup()
 {
+  StopReloadSignal();
   pool_.reset();
-  cpuLoaders_.clear();
-  gpuLoaders_.clear();
-  fpgaLoaders_.clear();
+  searches_.clear();
+  std::atomic_store(&models_, ModelsPtr());
+}
+
+// Runs load on the pool and logs how long it took as "Loaded <what>".
+template <class F>
+static std::shared_future<void> Timed(ThreadPool& pool, const std::string& what, F load) {
+  return pool.enqueue([what, load]() {
+    boost::timer::cpu_timer timer;
+    load();
+    LOG(info)->info("Loaded {} in {}", what, timer.format(3, "%ws"));
+  }).share();
 }
 
-void God::LoadScorers() {
+// The vocabularies, the scorers and the BPE codes do not depend on each other
+// and are loaded side by side; the softmax filter waits for the vocabularies.
+// The tasks only fill slots created here, the containers do not change
+// while they run.
+void God::Load() {
+  boost::timer::cpu_timer timer;
+  size_t threads = LoadThreads();
+
+  std::shared_ptr<Models> models(new Models());
+  std::vector<std::shared_future<void>> tasks;
+  {
+    ThreadPool pool(threads);
+    std::vector<std::shared_future<void>> vocabs = LoadVocabs(pool);
+    tasks = vocabs;
+    // The pool runs its tasks in order, so the vocabularies are being or
+    // have been loaded when a thread gets to the filter and waits for them.
+    // get() passes on a failed load before the vocabularies are used.
+    if (!Get<std::vector<std::string>>("softmax-filter").empty()) {
+      tasks.push_back(Timed(pool, "softmax filter", [this, vocabs]() {
+        for (auto& vocab : vocabs) {
+          vocab.get();
+        }
+        LoadFiltering();
+      }));
+    }
+    LoadScorers(*models, config_.Get()["scorers"], pool, tasks);
+    LoadPrePostProcessing(pool, tasks);
+
+    if (Has("input-file")) {
+      LOG(info)->info("Reading from {}", Get<std::string>("input-file"));
+      inputStream_.reset(new InputFileStream(Get<std::string>("input-file")));
+    }
+    else {
+      LOG(info)->info("Reading from stdin");
+      inputStream_.reset(new InputFileStream(std::cin));
+    }
+  }
+
+  // all tasks have finished, rethrow the first failure
+  for (auto& task : tasks) {
+    task.get();
+  }
+  std::atomic_store(&models_, ModelsPtr(models));
+  LOG(info)->info("Loading took {} with {} threads", timer.format(3, "%ws"), threads);
+}
+
+size_t God::LoadThreads() const {
+  size_t threads = Get<size_t>("load-threads");
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return threads;
+}
+
+void God::Reload() {
+  Reload(config_.Get()["scorers"]);
+}
+
+void God::Reload(const YAML::Node& scorers) {
+  std::lock_guard<std::mutex> lock(reloadMutex_);
+  amunmt_UTIL_THROW_IF2(!pool_, "Reload before Init or after Cleanup");
+  amunmt_UTIL_THROW_IF2(!scorers.IsMap() || scorers.size() == 0, "Reload: no scorers given");
+  for (auto&& pair : scorers) {
+    std::string name = pair.first.as<std::string>();
+    amunmt_UTIL_THROW_IF2(!weights_.count(name), "Reload: scorer " << name << " has no weight");
+  }
+
+  // the pool keeps translating with the old scorers meanwhile
+  boost::timer::cpu_timer timer;
+  std::shared_ptr<Models> models(new Models());
+  {
+    std::vector<std::shared_future<void>> tasks;
+    {
+      ThreadPool pool(LoadThreads());
+      LoadScorers(*models, scorers, pool, tasks);
+    }
+    for (auto& task : tasks) {
+      task.get();
+    }
+  }
+  ModelsPtr old = std::atomic_exchange(&models_, ModelsPtr(models));
+  LOG(info)->info("Reloading took {}, new mini-batches use the new scorers", timer.format(3, "%ws"));
+
+  // A batch that got its Search before the exchange is marked busy with the
+  // old scorers by now, see GetSearch; the ones after it get the new ones.
+  std::vector<std::unique_ptr<Search>> retired;
+  {
+    std::unique_lock<std::mutex> searchLock(searchMutex_);
+    searchReleased_.wait(searchLock, [&]() {
+      for (auto&& slot : searches_ | boost::adaptors::map_values) {
+        if (slot.busy == old.get()) {
+          return false;
+        }
+      }
+      return true;
+    });
+    for (auto&& slot : searches_ | boost::adaptors::map_values) {
+      if (!slot.busy && slot.search && slot.search->GetModels() != models) {
+        retired.push_back(std::move(slot.search));
+      }
+    }
+  }
+  retired.clear();
+  if (old.use_count() > 1) {
+    LOG(info)->warn("The old scorers are still used outside of the thread pool");
+  }
+  old.reset();
+  LOG(info)->info("Released the old scorers");
+}
+
+// The handler only writes to a pipe, which the watcher thread reads; the
+// handler is installed for the process, so whichever thread the signal hits,
+// including ones the host created before Init, the scorers are reloaded.
+void God::WatchReloadSignal() {
+  amunmt_UTIL_THROW_IF2(reloadPipe[0] >= 0, "Only one God can reload on SIGHUP");
+  amunmt_UTIL_THROW_IF2(pipe(reloadPipe) != 0, "Cannot create the pipe for SIGHUP");
+  // the handler must never block on a full pipe, a pending reload is enough
+  fcntl(reloadPipe[1], F_SETFL, fcntl(reloadPipe[1], F_GETFL) | O_NONBLOCK);
+
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_handler = OnReloadSignal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  amunmt_UTIL_THROW_IF2(sigaction(SIGHUP, &action, &previousAction) != 0,
+                        "Cannot install the SIGHUP handler");
+
+  LOG(info)->info("Reloading the scorers on SIGHUP");
+  reloadThread_ = std::thread([this]() {
+    char c;
+    while (true) {
+      ssize_t n = read(reloadPipe[0], &c, 1);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0 || c == STOP_RELOAD) {
+        break;
+      }
+      try {
+        Reload();
+      } catch (const std::exception& e) {
+        LOG(info)->error("Reloading failed, keeping the old scorers: {}", e.what());
+      }
+    }
+  });
+}
+
+void God::StopReloadSignal() {
+  if (reloadThread_.joinable()) {
+    sigaction(SIGHUP, &previousAction, nullptr);
+    char c = STOP_RELOAD;
+    while (write(reloadPipe[1], &c, 1) < 0 && errno == EINTR) {
+    }
+    reloadThread_.join();
+    close(reloadPipe[0]);
+    close(reloadPipe[1]);
+    reloadPipe[0] = reloadPipe[1] = -1;
+  }
+}
+
+std::vector<std::shared_future<void>> God::LoadVocabs(ThreadPool& pool) {
+  std::vector<std::string> sourceVocabPaths;
+  if (Get("source-vocab").IsSequence()) {
+    sourceVocabPaths = Get<std::vector<std::string>>("source-vocab");
+  } else {
+    sourceVocabPaths.push_back(Get<std::string>("source-vocab"));
+  }
+  sourceVocabs_.resize(sourceVocabPaths.size());
+
+  std::vector<std::shared_future<void>> tasks;
+  for (size_t i = 0; i < sourceVocabPaths.size(); ++i) {
+    std::string path = sourceVocabPaths[i];
+    tasks.push_back(Timed(pool, "source vocab " + path, [this, i, path]() {
+      sourceVocabs_[i].reset(new Vocab(path));
+    }));
+  }
+  std::string path = Get<std::string>("target-vocab");
+  tasks.push_back(Timed(pool, "target vocab " + path, [this, path]() {
+    targetVocab_.reset(new Vocab(path));
+  }));
+  return tasks;
+}
+
+void God::LoadScorers(Loaders& loaders, DeviceType deviceType, const YAML::Node& scorers,
+                      ThreadPool& pool, std::vector<std::shared_future<void>>& tasks) {
+  for (auto&& pair : scorers) {
+    std::string name = pair.first.as<std::string>();
+    YAML::Node config = YAML::Clone(pair.second);
+    LoaderPtr& loader = loaders[name];
+    tasks.push_back(Timed(pool, "scorer " + name, [this, &loader, name, config, deviceType]() {
+      loader = LoaderFactory::Create(*this, name, config, deviceType);
+    }));
+  }
+}
+
+void God::LoadScorers(Models& models, const YAML::Node& scorers,
+                      ThreadPool& pool, std::vector<std::shared_future<void>>& tasks) {
   LOG(info)->info("Loading scorers...");
 #ifdef CUDA
   size_t gpuThreads = God::Get<size_t>("gpu-threads");
   auto devices = God::Get<std::vector<size_t>>("devices");
   if (gpuThreads > 0 && devices.size() > 0) {
-    for (auto&& pair : config_.Get()["scorers"]) {
-      std::string name = pair.first.as<std::string>();
-      gpuLoaders_.emplace(name, LoaderFactory::Create(*this, name, pair.second, GPUDevice));
-    }
+    LoadScorers(models.gpuLoaders, GPUDevice, scorers, pool, tasks);
   }
 #endif
 #ifdef HAS_CPU
   size_t cpuThreads = God::Get<size_t>("cpu-threads");
   if (cpuThreads) {
-    for (auto&& pair : config_.Get()["scorers"]) {
-      std::string name = pair.first.as<std::string>();
-      cpuLoaders_.emplace(name, LoaderFactory::Create(*this, name, pair.second, CPUDevice));
-    }
+    LoadScorers(models.cpuLoaders, CPUDevice, scorers, pool, tasks);
   }
 #endif
 #ifdef HAS_FPGA
   size_t fpgaThreads = God::Get<size_t>("fpga-threads");
   if (fpgaThreads) {
-    for (auto&& pair : config_.Get()["scorers"]) {
-      std::string name = pair.first.as<std::string>();
-      fpgaLoaders_.emplace(name, LoaderFactory::Create(*this, name, pair.second, FPGADevice));
-    }
+    LoadScorers(models.fpgaLoaders, FPGADevice, scorers, pool, tasks);
   }
 #endif
 
 }
 
 void God::LoadFiltering() {
-  if (!Get<std::vector<std::string>>("softmax-filter").empty()) {
-    auto filterOptions = Get<std::vector<std::string>>("softmax-filter");
-    std::string alignmentFile = filterOptions[0];
-    LOG(info)->info("Reading target softmax filter file from {}", alignmentFile);
-    Filter* filter = nullptr;
-    if (filterOptions.size() >= 3) {
-      const size_t numNFirst = stoi(filterOptions[1]);
-      const size_t maxNumTranslation = stoi(filterOptions[2]);
-      filter = new Filter(GetSourceVocab(0),
-                          GetTargetVocab(),
-                          alignmentFile,
-                          numNFirst,
-                          maxNumTranslation);
-    } else if (filterOptions.size() == 2) {
-      const size_t numNFirst = stoi(filterOptions[1]);
-      filter = new Filter(GetSourceVocab(0),
-                          GetTargetVocab(),
-                          alignmentFile,
-                          numNFirst);
-    } else {
-      filter = new Filter(GetSourceVocab(0),
-                          GetTargetVocab(),
-                          alignmentFile);
-    }
-    filter_.reset(filter);
+  auto filterOptions = Get<std::vector<std::string>>("softmax-filter");
+  std::string alignmentFile = filterOptions[0];
+  LOG(info)->info("Reading target softmax filter file from {}", alignmentFile);
+  Filter* filter = nullptr;
+  if (filterOptions.size() >= 3) {
+    const size_t numNFirst = stoi(filterOptions[1]);
+    const size_t maxNumTranslation = stoi(filterOptions[2]);
+    filter = new Filter(GetSourceVocab(0),
+                        GetTargetVocab(),
+                        alignmentFile,
+                        numNFirst,
+                        maxNumTranslation);
+  } else if (filterOptions.size() == 2) {
+    const size_t numNFirst = stoi(filterOptions[1]);
+    filter = new Filter(GetSourceVocab(0),
+                        GetTargetVocab(),
+                        alignmentFile,
+                        numNFirst);
+  } else {
+    filter = new Filter(GetSourceVocab(0),
+                        GetTargetVocab(),
+                        alignmentFile);
   }
+  filter_.reset(filter);
 }
 
-void God::LoadPrePostProcessing() {
+void God::LoadPrePostProcessing(ThreadPool& pool, std::vector<std::shared_future<void>>& tasks) {
   if (Has("bpe")) {
+    std::vector<std::string> bpePaths;
     if(Get("bpe").IsSequence()) {
-      size_t i = 0;
-      for(auto bpePath : Get<std::vector<std::string>>("bpe")) {
-        LOG(info)->info("using bpe: {}", bpePath);
-        preprocessors_.push_back(std::vector<PreprocessorPtr>());
-        preprocessors_[i++].emplace_back(new BPE(bpePath));
-      }
+      bpePaths = Get<std::vector<std::string>>("bpe");
     }
     else {
-      LOG(info)->info("using bpe: {}", Get<std::string>("bpe"));
-        preprocessors_.push_back(std::vector<PreprocessorPtr>());
-      if (Get<std::string>("bpe") != "") {
-        preprocessors_[0].emplace_back(new BPE(Get<std::string>("bpe")));
+      bpePaths.push_back(Get<std::string>("bpe"));
+    }
+    preprocessors_.resize(bpePaths.size());
+    for (size_t i = 0; i < bpePaths.size(); ++i) {
+      std::string bpePath = bpePaths[i];
+      LOG(info)->info("using bpe: {}", bpePath);
+      if (bpePath == "") {
+        continue;
       }
+      tasks.push_back(Timed(pool, "bpe " + bpePath, [this, i, bpePath]() {
+        preprocessors_[i].emplace_back(new BPE(bpePath));
+      }));
     }
   }
 
@@ -228,19 +442,23 @@ OutputCollector& God::GetOutputCollector() const {
   return outputCollector_;
 }
 
-std::vector<ScorerPtr> God::GetScorers(const DeviceInfo &deviceInfo) const {
+God::ModelsPtr God::GetModels() const {
+  return std::atomic_load(&models_);
+}
+
+std::vector<ScorerPtr> God::GetScorers(const Models& models, const DeviceInfo &deviceInfo) const {
   std::vector<ScorerPtr> scorers;
 
   if (deviceInfo.deviceType == CPUDevice) {
-    for (auto&& loader : cpuLoaders_ | boost::adaptors::map_values)
+    for (auto&& loader : models.cpuLoaders | boost::adaptors::map_values)
       scorers.emplace_back(loader->NewScorer(*this, deviceInfo));
   }
   else if (deviceInfo.deviceType == GPUDevice) {
-    for (auto&& loader : gpuLoaders_ | boost::adaptors::map_values)
+    for (auto&& loader : models.gpuLoaders | boost::adaptors::map_values)
       scorers.emplace_back(loader->NewScorer(*this, deviceInfo));
   }
   else if (deviceInfo.deviceType == FPGADevice) {
-    for (auto&& loader : fpgaLoaders_ | boost::adaptors::map_values)
+    for (auto&& loader : models.fpgaLoaders | boost::adaptors::map_values)
       scorers.emplace_back(loader->NewScorer(*this, deviceInfo));
   }
   else {
@@ -250,15 +468,15 @@ std::vector<ScorerPtr> God::GetScorers(const DeviceInfo &deviceInfo) const {
   return scorers;
 }
 
-BestHypsBasePtr God::GetBestHyps(const DeviceInfo &deviceInfo) const {
+BestHypsBasePtr God::GetBestHyps(const Models& models, const DeviceInfo &deviceInfo) const {
   if (deviceInfo.deviceType == CPUDevice) {
-    return cpuLoaders_.begin()->second->GetBestHyps(*this, deviceInfo);
+    return models.cpuLoaders.begin()->second->GetBestHyps(*this, deviceInfo);
   }
   else if (deviceInfo.deviceType == GPUDevice) {
-    return gpuLoaders_.begin()->second->GetBestHyps(*this, deviceInfo);
+    return models.gpuLoaders.begin()->second->GetBestHyps(*this, deviceInfo);
   }
   else if (deviceInfo.deviceType == FPGADevice) {
-    return fpgaLoaders_.begin()->second->GetBestHyps(*this, deviceInfo);
+    return models.fpgaLoaders.begin()->second->GetBestHyps(*this, deviceInfo);
   }
   else {
 	amunmt_UTIL_THROW2("Unknown device type:" << deviceInfo);
@@ -266,12 +484,13 @@ BestHypsBasePtr God::GetBestHyps(const DeviceInfo &deviceInfo) const {
 }
 
 std::vector<std::string> God::GetScorerNames() const {
+  ModelsPtr models = GetModels();
   std::vector<std::string> scorerNames;
-  for(auto&& name : cpuLoaders_ | boost::adaptors::map_keys)
+  for(auto&& name : models->cpuLoaders | boost::adaptors::map_keys)
     scorerNames.push_back(name);
-  for(auto&& name : gpuLoaders_ | boost::adaptors::map_keys)
+  for(auto&& name : models->gpuLoaders | boost::adaptors::map_keys)
     scorerNames.push_back(name);
-  for(auto&& name : fpgaLoaders_ | boost::adaptors::map_keys)
+  for(auto&& name : models->fpgaLoaders | boost::adaptors::map_keys)
     scorerNames.push_back(name);
 
   return scorerNames;
@@ -359,10 +578,40 @@ DeviceInfo God::GetNextDevice() const
   return ret;
 }
 
-Search &God::GetSearch() const
+std::shared_ptr<Search> God::GetSearch() const
 {
-  thread_local Search obj(*this);
-  return obj;
+  ModelsPtr models;
+  ThreadSearch* slot;
+  {
+    std::lock_guard<std::mutex> lock(searchMutex_);
+    models = GetModels();
+    // map nodes stay where they are, only this thread touches a busy slot
+    slot = &searches_[std::this_thread::get_id()];
+    slot->busy = models.get();
+  }
+
+  auto release = [this, slot](Search*) {
+    {
+      std::lock_guard<std::mutex> lock(searchMutex_);
+      slot->busy = nullptr;
+    }
+    searchReleased_.notify_all();
+  };
+
+  try {
+    if (!slot->search || slot->search->GetModels() != models) {
+      if (!threadDevice) {
+        threadDevice.reset(new DeviceInfo(GetNextDevice()));
+      }
+      // the old Search goes first, with its buffers
+      slot->search.reset();
+      slot->search.reset(new Search(*this, models, *threadDevice));
+    }
+  } catch (...) {
+    release(nullptr);
+    throw;
+  }
+  return std::shared_ptr<Search>(slot->search.get(), release);
 }
 
 size_t God::GetTotalThreads() const
@@ -1,6 +1,11 @@
 #pragma once
 #include <memory>
 #include <iostream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 #include <boost/thread/shared_mutex.hpp>
 #include <boost/thread/locks.hpp>
 
@@ -29,6 +34,15 @@ class InputFileStream;
 
 class God {
   public:
+    typedef std::map<std::string, LoaderPtr> Loaders;
+
+    // The loaded scorers. A Search keeps the set it was created from, so
+    // that Reload can swap in a new set while batches on the old one run.
+    struct Models {
+      Loaders cpuLoaders, gpuLoaders, fpgaLoaders;
+    };
+    typedef std::shared_ptr<const Models> ModelsPtr;
+
 	God();
     virtual ~God();
 
@@ -58,9 +72,12 @@ class God {
 
     std::shared_ptr<const Filter> GetFilter() const;
 
-    BestHypsBasePtr GetBestHyps(const DeviceInfo &deviceInfo) const;
+    // the current scorers
+    ModelsPtr GetModels() const;
+
+    BestHypsBasePtr GetBestHyps(const Models& models, const DeviceInfo &deviceInfo) const;
 
-    std::vector<ScorerPtr> GetScorers(const DeviceInfo &deviceInfo) const;
+    std::vector<ScorerPtr> GetScorers(const Models& models, const DeviceInfo &deviceInfo) const;
     std::vector<std::string> GetScorerNames() const;
     const std::map<std::string, float>& GetScorerWeights() const;
 
@@ -71,16 +88,40 @@ class God {
     void LoadWeights(const std::string& path);
 
     DeviceInfo GetNextDevice() const;
-    Search &GetSearch() const;
+
+    // The Search of the calling thread on the current scorers, for one
+    // mini-batch, which is in flight until the pointer is released.
+    std::shared_ptr<Search> GetSearch() const;
+
+    // Loads the scorers again, from the "scorers" section of the config or
+    // from the given one with the same scorer names, while the thread pool
+    // keeps translating. Mini-batches started afterwards use the new
+    // scorers. Returns once the batches in flight on the old scorers have
+    // finished and the old scorers are freed, so it must not be called
+    // from a translation task. A model file has to be replaced by a new
+    // file, not overwritten, as the old one may still be mapped.
+    void Reload();
+    void Reload(const YAML::Node& scorers);
 
     size_t GetTotalThreads() const;
     ThreadPool &GetThreadPool()
     { return *pool_; }
 
   private:
-    void LoadScorers();
+    // the loads in Init, as tasks on a pool of load-threads threads
+    void Load();
+    std::vector<std::shared_future<void>> LoadVocabs(ThreadPool& pool);
+    void LoadScorers(Models& models, const YAML::Node& scorers,
+                     ThreadPool& pool, std::vector<std::shared_future<void>>& tasks);
+    void LoadScorers(Loaders& loaders, DeviceType deviceType, const YAML::Node& scorers,
+                     ThreadPool& pool, std::vector<std::shared_future<void>>& tasks);
     void LoadFiltering();
-    void LoadPrePostProcessing();
+    void LoadPrePostProcessing(ThreadPool& pool, std::vector<std::shared_future<void>>& tasks);
+    size_t LoadThreads() const;
+
+    // Reload on SIGHUP, from a thread woken by the signal handler
+    void WatchReloadSignal();
+    void StopReloadSignal();
 
 
     Config config_;
@@ -93,8 +134,22 @@ class God {
     std::vector<std::vector<PreprocessorPtr>> preprocessors_;
     std::vector<PostprocessorPtr> postprocessors_;
 
-    typedef std::map<std::string, LoaderPtr> Loaders;
-    Loaders cpuLoaders_, gpuLoaders_, fpgaLoaders_;
+    // read and replaced with std::atomic_load and std::atomic_exchange
+    ModelsPtr models_;
+    std::mutex reloadMutex_;
+
+    // The Search of every thread that translated. A batch marks its
+    // thread's slot busy with the scorers it runs on, under searchMutex_;
+    // Reload waits for the busy slots on the old scorers and frees the
+    // Searches on them, the others belong to their threads.
+    struct ThreadSearch {
+      std::unique_ptr<Search> search;
+      const Models* busy = nullptr;
+    };
+    mutable std::map<std::thread::id, ThreadSearch> searches_;
+    mutable std::mutex searchMutex_;
+    mutable std::condition_variable searchReleased_;
+    std::thread reloadThread_;
     std::map<std::string, float> weights_;
 
     std::shared_ptr<spdlog::logger> info_;
@@ -4,21 +4,23 @@
 
 namespace amunmt {
 
-History::History(size_t lineNo, bool normalizeScore, size_t maxLength)
-  : normalize_(normalizeScore),
+History::History(size_t lineNo, bool normalizeScore, size_t maxLength, size_t nBest)
+  : arena_(std::make_shared<HypothesisArena>()),
+    normalize_(normalizeScore),
     lineNo_(lineNo),
-   maxLength_(maxLength)
+   maxLength_(maxLength),
+   nBest_(nBest)
 {
-  Add({HypothesisPtr(new Hypothesis())});
+  Add({std::allocate_shared<Hypothesis>(ArenaAllocator<Hypothesis>(arena_), arena_.get())});
 }
 
 
-Histories::Histories(const Sentences& sentences, bool normalizeScore)
+Histories::Histories(const Sentences& sentences, bool normalizeScore, size_t nBest)
  : coll_(sentences.size())
 {
   for (size_t i = 0; i < sentences.size(); ++i) {
     const Sentence &sentence = *sentences.at(i).get();
-    History *history = new History(sentence.GetLineNum(), normalizeScore, 3 * sentence.size());
+    History *history = new History(sentence.GetLineNum(), normalizeScore, 3 * sentence.size(), nBest);
     coll_[i].reset(history);
   }
 }
@@ -2,6 +2,7 @@
 
 #include <queue>
 #include <algorithm>
+#include <functional>
 
 #include "hypothesis.h"
 
@@ -24,7 +25,7 @@ class History {
     History(const History&) = delete;
 
   public:
-    History(size_t lineNo, bool normalizeScore, size_t maxLength);
+    History(size_t lineNo, bool normalizeScore, size_t maxLength, size_t nBest = 1);
 
     void Add(const Beam& beam) {
       if (beam.back()->GetPrevHyp() != nullptr) {
@@ -32,11 +33,47 @@ class History {
           if(beam[j]->GetWord() == EOS_ID || size() == maxLength_ ) {
             float cost = normalize_ ? beam[j]->GetCost() / history_.size() : beam[j]->GetCost();
             topHyps_.push({ history_.size(), j, cost });
+            AddFinished(cost);
           }
       }
       history_.push_back(beam);
     }
 
+    // Best-first search finishes hypotheses out of length order, each one
+    // is kept as a step of its own.
+    void AddResult(const HypothesisPtr& hyp, size_t length) {
+      float cost = normalize_ ? hyp->GetCost() / length : hyp->GetCost();
+      topHyps_.push({ history_.size(), 0, cost });
+      AddFinished(cost);
+      history_.push_back({hyp});
+    }
+
+    // Greedy decoding keeps no hypothesis graph while searching, the single
+    // path of a sentence is added in one go once it is finished.
+    void AddPath(const Words& words, const std::vector<float>& costs) {
+      HypothesisPtr hyp = history_.front()[0];
+      for (size_t i = 0; i < words.size(); ++i) {
+        hyp = NewHypothesis(hyp, words[i], 0, costs[i]);
+        Add({hyp});
+      }
+    }
+
+    // True once expanding the live hypotheses cannot change the output:
+    // the nBest best finished hypotheses all beat the best score a
+    // continuation of bestLiveCost can reach. Costs only decrease with
+    // every word, with normalization the bound is divided by the longest
+    // possible length.
+    bool IsConverged(float bestLiveCost) const {
+      if (size() > maxLength_) {
+        return true;
+      }
+      if (finished_.size() < nBest_) {
+        return false;
+      }
+      float bound = normalize_ ? bestLiveCost / maxLength_ : bestLiveCost;
+      return finished_.front() > bound;
+    }
+
     size_t size() const {
       return history_.size();
     }
@@ -56,10 +93,10 @@ class History {
         size_t j  = bestHypCoord.j;
 
         Words targetWords;
-        HypothesisPtr bestHyp = history_[start][j];
+        const Hypothesis* bestHyp = history_[start][j].get();
         while(bestHyp->GetPrevHyp() != nullptr) {
           targetWords.push_back(bestHyp->GetWord());
-          bestHyp = bestHyp->GetPrevHyp();
+          bestHyp = bestHyp->GetPrevHyp().get();
         }
 
         std::reverse(targetWords.begin(), targetWords.end());
@@ -76,18 +113,35 @@ class History {
     { return lineNo_; }
 
   private:
+    void AddFinished(float cost) {
+      // min-heap of the nBest_ best finished costs
+      if (finished_.size() < nBest_) {
+        finished_.push_back(cost);
+        std::push_heap(finished_.begin(), finished_.end(), std::greater<float>());
+      } else if (cost > finished_.front()) {
+        std::pop_heap(finished_.begin(), finished_.end(), std::greater<float>());
+        finished_.back() = cost;
+        std::push_heap(finished_.begin(), finished_.end(), std::greater<float>());
+      }
+    }
+
+    // shared with the hypotheses, see HypothesisArena
+    std::shared_ptr<HypothesisArena> arena_;
+
     std::vector<Beam> history_;
     std::priority_queue<HypothesisCoord> topHyps_;
+    std::vector<float> finished_;
     bool normalize_;
     size_t lineNo_;
     size_t maxLength_;
+    size_t nBest_;
 };
 
 
 class Histories {
   public:
     Histories() {} // for all histories in translation task
-    Histories(const Sentences& sentences, bool normalizeScore);
+    Histories(const Sentences& sentences, bool normalizeScore, size_t nBest = 1);
 
     std::shared_ptr<History> at(size_t id) const {
       return coll_.at(id);
@@ -1,52 +1,75 @@
 #include "history_dijkstra.h"
 
+#include <functional>
+
 #include "sentences.h"
 
 namespace amunmt {
 
-History_Dijkstra::History_Dijkstra(size_t lineNo, bool normalizeScore, size_t maxLength)
+History_Dijkstra::History_Dijkstra(bool normalizeScore, size_t maxLength,
+                                   size_t nBest, size_t maxFrontier)
   : normalize_(normalizeScore),
-    lineNo_(lineNo),
-   maxLength_(maxLength)
-{
-  Add({HypothesisPtr(new Hypothesis())});
-}
+    maxLength_(maxLength),
+    nBest_(nBest),
+    maxFrontier_(maxFrontier)
+{}
 
 
-Histories_Dijkstra::Histories_Dijkstra(const Sentences& sentences, bool normalizeScore)
- : coll_(sentences.size())
+void History_Dijkstra::Push(const HypothesisPtr& hyp,
+                            const std::shared_ptr<States>& states,
+                            size_t length)
 {
-  for (size_t i = 0; i < sentences.size(); ++i) {
-    const Sentence &sentence = *sentences.at(i).get();
-    History_Dijkstra *history = new History_Dijkstra(sentence.GetLineNum(), normalizeScore, 3 * sentence.size());
-    coll_[i].reset(history);
+  float bound = normalize_ ? hyp->GetCost() / maxLength_ : hyp->GetCost();
+  frontier_.push_back({ hyp, states, length, bound });
+  std::push_heap(frontier_.begin(), frontier_.end(), Worse());
+
+  // trimming only every maxFrontier_ pushes keeps it amortized O(1)
+  if (maxFrontier_ && frontier_.size() >= 2 * maxFrontier_) {
+    std::nth_element(frontier_.begin(), frontier_.begin() + maxFrontier_, frontier_.end(),
+                     [](const Entry& a, const Entry& b) { return a.bound > b.bound; });
+    frontier_.resize(maxFrontier_);
+    std::make_heap(frontier_.begin(), frontier_.end(), Worse());
   }
 }
 
 
-class LineNumOrderer
-{
-  public:
-    bool operator()(const std::shared_ptr<History_Dijkstra>& a, const std::shared_ptr<History_Dijkstra>& b) const
-    {
-      return a->GetLineNum() < b->GetLineNum();
-    }
-};
+size_t History_Dijkstra::Pop(size_t n, std::vector<Entry>& out) {
+  size_t popped = 0;
+  while (popped < n && !IsConverged()) {
+    std::pop_heap(frontier_.begin(), frontier_.end(), Worse());
+    out.push_back(std::move(frontier_.back()));
+    frontier_.pop_back();
+    ++popped;
+  }
+  return popped;
+}
 
 
-void Histories_Dijkstra::SortByLineNum()
-{
-  std::sort(coll_.begin(), coll_.end(), LineNumOrderer());
+void History_Dijkstra::AddFinished(float cost, size_t length) {
+  if (normalize_) {
+    cost /= length;
+  }
+
+  // min-heap of the nBest_ best finished scores
+  if (finished_.size() < nBest_) {
+    finished_.push_back(cost);
+    std::push_heap(finished_.begin(), finished_.end(), std::greater<float>());
+  } else if (cost > finished_.front()) {
+    std::pop_heap(finished_.begin(), finished_.end(), std::greater<float>());
+    finished_.back() = cost;
+    std::push_heap(finished_.begin(), finished_.end(), std::greater<float>());
+  }
 }
 
 
-void Histories_Dijkstra::Append(const Histories_Dijkstra &other)
+Histories_Dijkstra::Histories_Dijkstra(const Sentences& sentences, bool normalizeScore,
+                                       size_t nBest, size_t maxFrontier)
+ : coll_(sentences.size())
 {
-  for (size_t i = 0; i < other.size(); ++i) {
-    std::shared_ptr<History_Dijkstra> history = other.coll_[i];
-    coll_.push_back(history);
+  for (size_t i = 0; i < sentences.size(); ++i) {
+    const Sentence &sentence = *sentences.at(i).get();
+    coll_[i].reset(new History_Dijkstra(normalizeScore, 3 * sentence.size(), nBest, maxFrontier));
   }
 }
 
 }
-
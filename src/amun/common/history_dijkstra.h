@@ -1,93 +1,89 @@
 #pragma once
 
-#include <queue>
+#include <vector>
+#include <memory>
 #include <algorithm>
 
 #include "hypothesis.h"
+#include "scorer.h"
 
 namespace amunmt {
 
 class Sentences;
 
+// Frontier of the best-first search over the partial translations of one
+// sentence. Every entry keeps the decoder states it continues from alive,
+// its hypothesis' prevIndex is the row in there.
+// Entries are ordered by an upper bound of the score any continuation can
+// reach: costs only decrease with every word, so the bound is the cost
+// itself; with normalization it is divided by the longest possible length.
+// The bound is admissible, the search is exact once the nBest best finished
+// hypotheses reach the bound of the best entry.
 class History_Dijkstra {
-  private:
-    struct HypothesisCoord {
-      bool operator<(const HypothesisCoord& hc) const {
-        return cost < hc.cost;
-      }
-
-      size_t i;
-      size_t j;
-      float cost;
+  public:
+    struct Entry {
+      HypothesisPtr hyp;
+      std::shared_ptr<States> states;
+      size_t length;
+      float bound;
     };
 
-    History_Dijkstra(const History_Dijkstra&) = delete;
+    History_Dijkstra(bool normalizeScore, size_t maxLength, size_t nBest, size_t maxFrontier);
 
-  public:
-    History_Dijkstra(size_t lineNo, bool normalizeScore, size_t maxLength);
-
-    void Add(const Beam& beam) {
-      if (beam.back()->GetPrevHyp() != nullptr) {
-        for (size_t j = 0; j < beam.size(); ++j)
-          if(beam[j]->GetWord() == EOS_ID || size() == maxLength_ ) {
-            float cost = normalize_ ? beam[j]->GetCost() / history_.size() : beam[j]->GetCost();
-            topHyps_.push({ history_.size(), j, cost });
-          }
+    void Push(const HypothesisPtr& hyp, const std::shared_ptr<States>& states, size_t length);
+
+    // Moves up to n of the best entries to out and returns their number,
+    // none once the search for this sentence is over.
+    size_t Pop(size_t n, std::vector<Entry>& out);
+
+    void AddFinished(float cost, size_t length);
+
+    bool IsConverged() const {
+      if (frontier_.empty()) {
+        return true;
       }
-      history_.push_back(beam);
+      return finished_.size() >= nBest_ && finished_.front() >= frontier_.front().bound;
     }
 
-    size_t size() const {
-      return history_.size();
+    bool HasFinished() const {
+      return !finished_.empty();
     }
 
-    Beam& front() {
-      return history_.front();
+    // best unfinished entry, for sentences whose search was cut short
+    const Entry& Top() const {
+      return frontier_.front();
     }
 
-    NBestList NBest(size_t n) const {
-      NBestList nbest;
-      auto topHypsCopy = topHyps_;
-      while (nbest.size() < n && !topHypsCopy.empty()) {
-        auto bestHypCoord = topHypsCopy.top();
-        topHypsCopy.pop();
-
-        size_t start = bestHypCoord.i;
-        size_t j  = bestHypCoord.j;
-
-        Words targetWords;
-        HypothesisPtr bestHyp = history_[start][j];
-        while(bestHyp->GetPrevHyp() != nullptr) {
-          targetWords.push_back(bestHyp->GetWord());
-          bestHyp = bestHyp->GetPrevHyp();
-        }
-
-        std::reverse(targetWords.begin(), targetWords.end());
-        nbest.emplace_back(targetWords, history_[bestHypCoord.i][bestHypCoord.j]);
-      }
-      return nbest;
+    bool empty() const {
+      return frontier_.empty();
     }
 
-    Result Top() const {
-      return NBest(1)[0];
+    size_t GetMaxLength() const {
+      return maxLength_;
     }
 
-    size_t GetLineNum() const
-    { return lineNo_; }
-
   private:
-    std::vector<Beam> history_;
-    std::priority_queue<HypothesisCoord> topHyps_;
+    struct Worse {
+      bool operator()(const Entry& a, const Entry& b) const {
+        return a.bound < b.bound;
+      }
+    };
+
+    std::vector<Entry> frontier_;
+    std::vector<float> finished_;
     bool normalize_;
-    size_t lineNo_;
     size_t maxLength_;
+    size_t nBest_;
+    size_t maxFrontier_;
+
+    History_Dijkstra(const History_Dijkstra&) = delete;
 };
 
 
 class Histories_Dijkstra {
   public:
-    Histories_Dijkstra() {} // for all histories in translation task
-    Histories_Dijkstra(const Sentences& sentences, bool normalizeScore);
+    Histories_Dijkstra(const Sentences& sentences, bool normalizeScore,
+                       size_t nBest, size_t maxFrontier);
 
     std::shared_ptr<History_Dijkstra> at(size_t id) const {
       return coll_.at(id);
@@ -97,25 +93,6 @@ class Histories_Dijkstra {
       return coll_.size();
     }
 
-    void Add(const Beams& beams) {
-      for (size_t i = 0; i < size(); ++i) {
-        if (!beams[i].empty()) {
-          coll_[i]->Add(beams[i]);
-        }
-      }
-    }
-
-    void SortByLineNum();
-    void Append(const Histories_Dijkstra &other);
-
-    Beam GetFirstHyps() {
-      Beam beam;
-      for (auto& history : coll_) {
-        beam.emplace_back(history->front()[0]);
-      }
-      return beam;
-    }
-
   protected:
     std::vector<std::shared_ptr<History_Dijkstra>> coll_;
     Histories_Dijkstra(const Histories_Dijkstra &) = delete;
@@ -1,7 +1,9 @@
 #pragma once
 #include <memory>
+#include <cstdint>
 #include "common/types.h"
 #include "common/soft_alignment.h"
+#include "common/hypothesis_arena.h"
 
 namespace amunmt {
 
@@ -11,33 +13,40 @@ typedef std::shared_ptr<Hypothesis> HypothesisPtr;
 
 class Hypothesis {
   public:
-    Hypothesis()
+    Hypothesis(HypothesisArena* arena = nullptr)
      : prevHyp_(nullptr),
+       arena_(arena),
        prevIndex_(0),
        word_(0),
        cost_(0.0)
     {}
 
-    Hypothesis(const HypothesisPtr prevHyp, size_t word, size_t prevIndex, float cost)
+    Hypothesis(const HypothesisPtr& prevHyp, size_t word, size_t prevIndex, float cost)
       : prevHyp_(prevHyp),
+        arena_(prevHyp ? prevHyp->arena_ : nullptr),
         prevIndex_(prevIndex),
         word_(word),
         cost_(cost)
     {}
 
-    Hypothesis(const HypothesisPtr prevHyp, size_t word, size_t prevIndex, float cost,
+    Hypothesis(const HypothesisPtr& prevHyp, size_t word, size_t prevIndex, float cost,
                std::vector<SoftAlignmentPtr> alignment)
       : prevHyp_(prevHyp),
+        arena_(prevHyp ? prevHyp->arena_ : nullptr),
         prevIndex_(prevIndex),
         word_(word),
         cost_(cost),
-        alignments_(alignment)
+        alignments_(std::move(alignment))
     {}
 
-    const HypothesisPtr GetPrevHyp() const {
+    const HypothesisPtr& GetPrevHyp() const {
       return prevHyp_;
     }
 
+    HypothesisArena* GetArena() const {
+      return arena_;
+    }
+
     size_t GetWord() const {
       return word_;
     }
@@ -64,14 +73,26 @@ class Hypothesis {
 
   private:
     const HypothesisPtr prevHyp_;
-    const size_t prevIndex_;
-    const size_t word_;
+    HypothesisArena* const arena_;
+    const uint32_t prevIndex_;
+    const uint32_t word_;
     const float cost_;
     std::vector<SoftAlignmentPtr> alignments_;
 
     std::vector<float> costBreakdown_;
 };
 
+// Creates a hypothesis in the arena of the sentence prevHyp belongs to,
+// or on the heap if the sentence has none.
+template <class... Args>
+HypothesisPtr NewHypothesis(const HypothesisPtr& prevHyp, Args&&... args) {
+  if (HypothesisArena* arena = prevHyp->GetArena()) {
+    ArenaAllocator<Hypothesis> allocator(arena->shared_from_this());
+    return std::allocate_shared<Hypothesis>(allocator, prevHyp, std::forward<Args>(args)...);
+  }
+  return std::make_shared<Hypothesis>(prevHyp, std::forward<Args>(args)...);
+}
+
 typedef std::vector<HypothesisPtr> Beam;
 typedef std::vector<Beam> Beams;
 typedef std::pair<Words, HypothesisPtr> Result;
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+namespace amunmt {
+
+// Bump allocator for the hypotheses of a single sentence. Memory is never
+// returned piecemeal, all blocks are released together when the arena is
+// destroyed. The History holds it and every hypothesis in it does through
+// its allocator, so a Result taken from the History stays valid after it.
+// Allocating is not thread-safe; a sentence is only expanded by one thread
+// at a time.
+class HypothesisArena : public std::enable_shared_from_this<HypothesisArena> {
+  public:
+    HypothesisArena(size_t blockSize = 64 * 1024)
+      : blockSize_(blockSize),
+        current_(nullptr),
+        left_(0)
+    {}
+
+    HypothesisArena(const HypothesisArena&) = delete;
+
+    void* Allocate(size_t bytes, size_t alignment) {
+      size_t padding = (alignment - reinterpret_cast<size_t>(current_) % alignment) % alignment;
+      if (padding + bytes > left_) {
+        size_t size = std::max(blockSize_, bytes + alignment);
+        blocks_.emplace_back(new char[size]);
+        current_ = blocks_.back().get();
+        left_ = size;
+        padding = (alignment - reinterpret_cast<size_t>(current_) % alignment) % alignment;
+      }
+      void* ptr = current_ + padding;
+      current_ += padding + bytes;
+      left_ -= padding + bytes;
+      return ptr;
+    }
+
+  private:
+    size_t blockSize_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* current_;
+    size_t left_;
+};
+
+// Standard allocator interface over a HypothesisArena, used with
+// std::allocate_shared so that a hypothesis and its control block are a
+// single arena allocation. The control block keeps a copy of the
+// allocator and with it the arena alive.
+template <class T>
+class ArenaAllocator {
+  public:
+    typedef T value_type;
+
+    ArenaAllocator(std::shared_ptr<HypothesisArena> arena)
+      : arena_(std::move(arena))
+    {}
+
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& other)
+      : arena_(other.arena_)
+    {}
+
+    T* allocate(size_t n) {
+      return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t) {}
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+      return arena_ == other.arena_;
+    }
+
+    template <class U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+      return arena_ != other.arena_;
+    }
+
+    std::shared_ptr<HypothesisArena> arena_;
+};
+
+}
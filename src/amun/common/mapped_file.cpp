@@ -0,0 +1,59 @@
+#include "common/mapped_file.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common/exception.h"
+
+namespace amunmt {
+
+MappedFile::MappedFile(const std::string& path)
+  : path_(path), data_(nullptr), size_(0)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  amunmt_UTIL_THROW_IF2(fd < 0, "Cannot open " << path << ": " << std::strerror(errno));
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    amunmt_UTIL_THROW2("Cannot stat " << path << ": " << std::strerror(error));
+  }
+
+  size_ = st.st_size;
+  if (size_) {
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd);
+    amunmt_UTIL_THROW_IF2(data == MAP_FAILED, "Cannot map " << path << ": " << std::strerror(error));
+    data_ = static_cast<const char*>(data);
+  } else {
+    close(fd);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+void MappedFile::WillNeed() const {
+  if (data_) {
+    madvise(const_cast<char*>(data_), size_, MADV_WILLNEED);
+  }
+}
+
+bool MappedFile::HugePages() const {
+#ifdef MADV_HUGEPAGE
+  return data_ && madvise(const_cast<char*>(data_), size_, MADV_HUGEPAGE) == 0;
+#else
+  return false;
+#endif
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstddef>
+
+namespace amunmt {
+
+// A file mapped read-only into memory. Its pages come from the page cache,
+// so every process mapping the same file shares them, and they are only
+// read from disk when first touched.
+class MappedFile {
+  public:
+    explicit MappedFile(const std::string& path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+      return data_;
+    }
+
+    size_t size() const {
+      return size_;
+    }
+
+    const std::string& path() const {
+      return path_;
+    }
+
+    // Hints for the whole mapping, a failure only loses the hint. WillNeed
+    // starts reading the file in the background; HugePages asks for the
+    // pages to be backed by huge pages, which only some kernels and file
+    // systems do for file mappings.
+    void WillNeed() const;
+    bool HugePages() const;
+
+  private:
+    std::string path_;
+    const char* data_;
+    size_t size_;
+};
+
+typedef std::shared_ptr<const MappedFile> MappedFilePtr;
+
+}
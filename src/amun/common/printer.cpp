@@ -4,10 +4,10 @@ namespace amunmt {
 
 std::vector<size_t> GetAlignment(const HypothesisPtr& hypothesis) {
   std::vector<SoftAlignment> aligns;
-  HypothesisPtr last = hypothesis->GetPrevHyp();
+  Hypothesis* last = hypothesis->GetPrevHyp().get();
   while (last->GetPrevHyp().get() != nullptr) {
     aligns.push_back(*(last->GetAlignment(0)));
-    last = last->GetPrevHyp();
+    last = last->GetPrevHyp().get();
   }
 
   std::vector<size_t> alignment;
@@ -36,10 +36,10 @@ std::string GetAlignmentString(const std::vector<size_t>& alignment) {
 
 std::string GetSoftAlignmentString(const HypothesisPtr& hypothesis) {
   std::vector<SoftAlignment> aligns;
-  HypothesisPtr last = hypothesis->GetPrevHyp();
+  Hypothesis* last = hypothesis->GetPrevHyp().get();
   while (last->GetPrevHyp().get() != nullptr) {
     aligns.push_back(*(last->GetAlignment(0)));
-    last = last->GetPrevHyp();
+    last = last->GetPrevHyp().get();
   }
 
   std::stringstream alignString;
@@ -1,4 +1,5 @@
 #include "scorer.h"
+#include "common/exception.h"
 
 namespace amunmt {
 
@@ -9,4 +10,9 @@ Scorer::Scorer(const God &god,
 {
 }
 
+void Scorer::AssembleFrontierState(const std::vector<const State*>&, const Beam&, State&)
+{
+  amunmt_UTIL_THROW2("Scorer " << name_ << " does not support best-first search");
+}
+
 }
@@ -51,6 +51,11 @@ class Scorer {
 
     virtual void AssembleBeamState(const State& in, const Beam& beam, State& out) = 0;
 
+    // Best-first search continues hypotheses of different steps together,
+    // the state of hypothesis i is in ins[i]
+    virtual void AssembleFrontierState(const std::vector<const State*>& ins,
+                                       const Beam& beam, State& out);
+
     virtual void Encode(const Sentences& sources) = 0;
 
     virtual void Filter(const std::vector<size_t>&) = 0;
@@ -61,6 +66,37 @@ class Scorer {
 
     virtual void CleanUpAfterSentence() {}
 
+    // Greedy decoding (beam size 1) without the full probability matrix.
+    // In greedy mode Decode only computes the best word of every row, which
+    // is returned by GetBestWords; AssembleGreedyState continues the given
+    // rows with the chosen words and may take over the states of in.
+    virtual bool SupportsGreedy() const {
+      return false;
+    }
+
+    virtual void SetGreedy(bool greedy, bool forbidUNK) {}
+
+    virtual void GetBestWords(std::vector<size_t>& words, std::vector<float>& costs) const {}
+
+    virtual void AssembleGreedyState(State& in, const std::vector<size_t>& words,
+                                     const std::vector<size_t>& rows, State& out) {}
+
+    // Beam search of a single model without the full probability matrix.
+    // With k set, Decode only keeps the k best words of every row and their
+    // log-probabilities, which GetTopK returns row by row, the same number
+    // (at most k) for every row; GetProbs is not filled. GetTopK swaps them
+    // into words and costs, whose old contents are overwritten by the next
+    // step, and returns false if Decode computed the full matrix instead.
+    virtual bool SupportsTopK() const {
+      return false;
+    }
+
+    virtual void SetTopK(size_t k, bool forbidUNK) {}
+
+    virtual bool GetTopK(std::vector<size_t>& words, std::vector<float>& costs) {
+      return false;
+    }
+
     virtual const std::string& GetName() const {
       return name_;
     }
@@ -1,3 +1,5 @@
+#include <numeric>
+#include <algorithm>
 #include <boost/timer/timer.hpp>
 #include "common/search.h"
 #include "common/sentences.h"
@@ -6,6 +8,8 @@
 #include "common/filter.h"
 #include "common/base_matrix.h"
 #include "common/history_dijkstra.h"
+#include "common/exception.h"
+#include "common/allocation_counter.h"
 
 /*
 #include "gpu/decoder/encoder_decoder.h"
@@ -20,15 +24,59 @@ using namespace std;
 
 namespace amunmt {
 
-Search::Search(const God &god)
-  : deviceInfo_(god.GetNextDevice()),
-    scorers_(god.GetScorers(deviceInfo_)),
+// candidates the beam search keeps per sentence and step
+const uint SELECTED_BEAM_SIZE = 20;
+
+Search::Search(const God &god, God::ModelsPtr models, const DeviceInfo& deviceInfo)
+  : deviceInfo_(deviceInfo),
+    models_(std::move(models)),
+    scorers_(god.GetScorers(*models_, deviceInfo_)),
     filter_(god.GetFilter()),
+    filterPerSentence_(god.Get<bool>("softmax-filter-per-sentence")),
     maxBeamSize_(god.Get<size_t>("beam-size")),
     normalizeScore_(god.Get<bool>("normalize")),
-    bestHyps_(god.GetBestHyps(deviceInfo_)),
-    batchSize_(god.Get<size_t>("mini-batch"))
-{}
+    bestHyps_(god.GetBestHyps(*models_, deviceInfo_)),
+    batchSize_(god.Get<size_t>("mini-batch")),
+    earlyStopping_(!god.Get<bool>("no-early-stopping")),
+    nBest_(god.Get<bool>("n-best") ? maxBeamSize_ : 1),
+    greedy_(false),
+    greedyWeight_(1.0f),
+    bestFirst_(god.Get<std::string>("search") == "best-first"),
+    bestFirstBatch_(god.Get<size_t>("best-first-batch")),
+    bestFirstFrontier_(god.Get<size_t>("best-first-frontier"))
+{
+  const std::string search = god.Get<std::string>("search");
+  amunmt_UTIL_THROW_IF2(search != "beam" && search != "best-first",
+                        "Unknown search algorithm: " << search);
+  amunmt_UTIL_THROW_IF2(bestFirst_ && bestFirstBatch_ == 0,
+                        "best-first-batch must be at least 1");
+
+  // the bound assumes costs never increase, which a negative weight breaks
+  for (auto& weight : god.GetScorerWeights()) {
+    if (weight.second < 0) {
+      earlyStopping_ = false;
+    }
+  }
+
+  // alignments and n-best lists need the hypothesis graph of a real beam
+  if (!bestFirst_ && maxBeamSize_ == 1 && scorers_.size() == 1 && scorers_[0]->SupportsGreedy()
+      && !god.Get<bool>("n-best")
+      && !god.Get<bool>("return-alignment")
+      && !god.Get<bool>("return-soft-alignment")) {
+    greedy_ = true;
+    greedyWeight_ = god.GetScorerWeights().at(scorers_[0]->GetName());
+    scorers_[0]->SetGreedy(true, !god.Get<bool>("allow-unk"));
+  }
+
+  // a single model only has to provide the best words of every row, as
+  // many as a sentence can select; a negative weight would turn them into
+  // the worst ones
+  if (!greedy_ && scorers_.size() == 1 && scorers_[0]->SupportsTopK()
+      && god.GetScorerWeights().at(scorers_[0]->GetName()) > 0) {
+    size_t k = bestFirst_ ? maxBeamSize_ : std::max<size_t>(maxBeamSize_, SELECTED_BEAM_SIZE);
+    scorers_[0]->SetTopK(k, !god.Get<bool>("allow-unk"));
+  }
+}
 
 
 Search::~Search() {
@@ -44,9 +92,33 @@ void Search::CleanAfterTranslation()
   for (auto scorer : scorers_) {
     scorer->CleanUpAfterSentence();
   }
+
+  // the hypotheses live in the arenas of the histories
+  for (auto& beam : beams_) {
+    beam.clear();
+  }
+  survivors_.clear();
 }
 
 std::shared_ptr<Histories> Search::Translate(const Sentences& sentences) {
+  // every sentence with its own shortlist
+  if (filter_ && filterPerSentence_ && sentences.size() > 1) {
+    std::shared_ptr<Histories> histories(new Histories());
+    for (size_t i = 0; i < sentences.size(); ++i) {
+      Sentences sentence;
+      sentence.push_back(sentences.at(i));
+      histories->Append(*Translate(sentence));
+    }
+    return histories;
+  }
+
+  if (bestFirst_) {
+    return TranslateBestFirst(sentences);
+  }
+  if (greedy_) {
+    return TranslateGreedy(sentences);
+  }
+
   boost::timer::cpu_timer timer;
 
   size_t vocabulary_size = scorers_[0]->GetVocabSize();
@@ -58,24 +130,34 @@ std::shared_ptr<Histories> Search::Translate(const Sentences& sentences) {
   }
 
   //Encode the input sentences  
-  States states = Encode(sentences);
+  States& states = Encode(sentences);
   //Create variable to store the next states on the generation
-  States nextStates = NewStates();
+  States& nextStates = NextStates();
   //I think this is used to store the size of remaining elemenrs on the beam? e.g. if EOS is found
   //in one element of the beam, then the beam size of the batch member decreases by 1
   std::vector<uint> beamSizes(sentences.size(), 1);
   // If we need the default max beam size use "maxBeamSize_"
-  uint selected_beam_size = 20;//vocabulary_size;//200;
+  uint selected_beam_size = SELECTED_BEAM_SIZE;//vocabulary_size;//200;
 
   //TODO: Figure out how much memory histories and prevHyps actually consume
-  std::shared_ptr<Histories> histories(new Histories(sentences, normalizeScore_));
+  std::shared_ptr<Histories> histories(new Histories(sentences, normalizeScore_, nBest_));
   Beam prevHyps = histories->GetFirstHyps();
 
+  liveBeamWidth_ = 0;
+  liveBeams_ = 0;
+
   //Resize the cost vector to fit the modified beam size
   bestHyps_->resizeCosts((batchSize_ * selected_beam_size));
 
+  // the first two steps size the buffers for one and for beam-size
+  // hypotheses, later ones should only reuse them
+  size_t allocations = AllocationCount();
+
   for (size_t decoderStep = 0; decoderStep < 3 * sentences.GetMaxLength(); ++decoderStep) {
    cout << "Decoder Step " << decoderStep << endl;
+   if (decoderStep == 2) {
+     allocations = AllocationCount();
+   }
 
    //TODO: Find ways to separate the *states[i].get<EDState>();
    if(decoderStep == 0){
@@ -161,19 +243,196 @@ for (size_t i = 0; i < scorers_.size(); i++){
 
   CleanAfterTranslation();
 
-  LOG(progress)->info("Search took {}", timer.format(3, "%ws"));
+  LOG(progress)->info("Search took {}, {} {} once the buffers were sized",
+                      timer.format(3, "%ws"), AllocationCount() - allocations,
+                      COUNTED_ALLOCATIONS);
+  if (liveBeams_) {
+    LOG(progress)->info("Average live beam width {}", float(liveBeamWidth_) / liveBeams_);
+  }
   return histories;
 }
 
-States Search::Encode(const Sentences& sentences) {
-  States states;
-  for (auto& scorer : scorers_) {
-    scorer->Encode(sentences);
-    auto state = scorer->NewState();
-    scorer->BeginSentenceState(*state, sentences.size());
-    states.emplace_back(state);
+std::shared_ptr<Histories> Search::TranslateGreedy(const Sentences& sentences) {
+  boost::timer::cpu_timer timer;
+
+  if (filter_) {
+    FilterTargetVocab(sentences);
   }
-  return states;
+
+  Scorer& scorer = *scorers_[0];
+  States& states = Encode(sentences);
+  States& nextStates = NextStates();
+
+  // one row per unfinished sentence, only word ids and costs are recorded
+  std::vector<uint> beamSizes(sentences.size(), 1);
+  std::vector<size_t> rowToSentence(sentences.size());
+  std::iota(rowToSentence.begin(), rowToSentence.end(), 0);
+  std::vector<Words> translations(sentences.size());
+  std::vector<std::vector<float>> costs(sentences.size());
+
+  std::vector<size_t> bestWords;
+  std::vector<float> bestCosts;
+  std::vector<size_t> keptRows;
+  std::vector<size_t> keptWords;
+  std::vector<size_t> keptSentences;
+
+  // rows only drop out, the first step sizes all buffers
+  size_t allocations = AllocationCount();
+
+  for (size_t decoderStep = 0; decoderStep < 3 * sentences.GetMaxLength(); ++decoderStep) {
+    if (decoderStep == 1) {
+      allocations = AllocationCount();
+    }
+    scorer.Decode(*states[0], *nextStates[0], beamSizes);
+    scorer.GetBestWords(bestWords, bestCosts);
+
+    keptRows.clear();
+    keptWords.clear();
+    keptSentences.clear();
+    for (size_t row = 0; row < rowToSentence.size(); ++row) {
+      size_t batchId = rowToSentence[row];
+      Word word = filter_ ? filterIndices_[bestWords[row]] : bestWords[row];
+      float cost = (costs[batchId].empty() ? 0.0f : costs[batchId].back())
+                 + greedyWeight_ * bestCosts[row];
+
+      translations[batchId].push_back(word);
+      costs[batchId].push_back(cost);
+
+      if (word == EOS_ID || translations[batchId].size() >= 3 * sentences.at(batchId)->size()) {
+        beamSizes[batchId] = 0;
+      } else {
+        keptRows.push_back(row);
+        keptWords.push_back(word);
+        keptSentences.push_back(batchId);
+      }
+    }
+
+    if (keptRows.empty()) {
+      break;
+    }
+
+    scorer.AssembleGreedyState(*nextStates[0], keptWords, keptRows, *states[0]);
+    rowToSentence.swap(keptSentences);
+  }
+
+  CleanAfterTranslation();
+
+  std::shared_ptr<Histories> histories(new Histories(sentences, normalizeScore_, nBest_));
+  for (size_t batchId = 0; batchId < sentences.size(); ++batchId) {
+    histories->at(batchId)->AddPath(translations[batchId], costs[batchId]);
+  }
+
+  LOG(progress)->info("Search took {}, {} {} once the buffers were sized",
+                      timer.format(3, "%ws"), AllocationCount() - allocations,
+                      COUNTED_ALLOCATIONS);
+  return histories;
+}
+
+std::shared_ptr<Histories> Search::TranslateBestFirst(const Sentences& sentences) {
+  boost::timer::cpu_timer timer;
+
+  if (filter_) {
+    FilterTargetVocab(sentences);
+  }
+
+  const size_t batchSize = sentences.size();
+  std::shared_ptr<Histories> histories(new Histories(sentences, normalizeScore_, nBest_));
+  Histories_Dijkstra frontiers(sentences, normalizeScore_, nBest_, bestFirstFrontier_);
+
+  // the roots are expanded from the encoder states, every later hypothesis
+  // from the states of the expansion that created it
+  States& states = Encode(sentences);
+  Beam prevHyps = histories->GetFirstHyps();
+  std::vector<size_t> prevLengths(batchSize, 0);
+  std::vector<uint> beamSizes(batchSize, 1);
+
+  // never more expansions than a beam search of the same width
+  std::vector<size_t> expansions(batchSize, 1);
+  size_t totalExpansions = batchSize;
+
+  std::vector<History_Dijkstra::Entry> popped;
+  std::vector<const State*> ins;
+
+  while (true) {
+    std::shared_ptr<States> nextStates(new States(NewStates()));
+    for (size_t i = 0; i < scorers_.size(); ++i) {
+      scorers_[i]->Decode(*states[i], *(*nextStates)[i], beamSizes);
+    }
+
+    Beams beams(batchSize);
+    bestHyps_->CalcBeam(prevHyps, scorers_, filterIndices_, beams, beamSizes, maxBeamSize_);
+
+    for (size_t batchId = 0; batchId < batchSize; ++batchId) {
+      History_Dijkstra& frontier = *frontiers.at(batchId);
+      for (auto& h : beams[batchId]) {
+        size_t length = prevLengths[h->GetPrevStateIndex()] + 1;
+        if (h->GetWord() == EOS_ID || length >= frontier.GetMaxLength()) {
+          histories->at(batchId)->AddResult(h, length);
+          frontier.AddFinished(h->GetCost(), length);
+        } else {
+          frontier.Push(h, nextStates, length);
+        }
+      }
+    }
+
+    // the best entries of all sentences are expanded together
+    popped.clear();
+    for (size_t batchId = 0; batchId < batchSize; ++batchId) {
+      size_t budget = frontiers.at(batchId)->GetMaxLength() * maxBeamSize_;
+      size_t n = std::min(bestFirstBatch_, budget - std::min(budget, expansions[batchId]));
+      beamSizes[batchId] = frontiers.at(batchId)->Pop(n, popped);
+      expansions[batchId] += beamSizes[batchId];
+    }
+    if (popped.empty()) {
+      break;
+    }
+    totalExpansions += popped.size();
+
+    prevHyps.clear();
+    prevLengths.clear();
+    for (auto& entry : popped) {
+      prevHyps.push_back(entry.hyp);
+      prevLengths.push_back(entry.length);
+    }
+    for (size_t i = 0; i < scorers_.size(); ++i) {
+      ins.clear();
+      for (auto& entry : popped) {
+        ins.push_back((*entry.states)[i].get());
+      }
+      scorers_[i]->AssembleFrontierState(ins, prevHyps, *states[i]);
+    }
+  }
+
+  // sentences that ran out of budget before finishing a hypothesis
+  for (size_t batchId = 0; batchId < batchSize; ++batchId) {
+    const History_Dijkstra& frontier = *frontiers.at(batchId);
+    if (!frontier.HasFinished() && !frontier.empty()) {
+      histories->at(batchId)->AddResult(frontier.Top().hyp, frontier.Top().length);
+    }
+  }
+
+  CleanAfterTranslation();
+
+  LOG(progress)->info("Search took {}, {} hypotheses expanded", timer.format(3, "%ws"), totalExpansions);
+  return histories;
+}
+
+States& Search::Encode(const Sentences& sentences) {
+  if (states_.empty()) {
+    states_ = NewStates();
+  }
+  for (size_t i = 0; i < scorers_.size(); ++i) {
+    scorers_[i]->Encode(sentences);
+    scorers_[i]->BeginSentenceState(*states_[i], sentences.size());
+  }
+  return states_;
+}
+
+States& Search::NextStates() {
+  if (nextStates_.empty()) {
+    nextStates_ = NewStates();
+  }
+  return nextStates_;
 }
 
 bool Search::CalcBeam(
@@ -185,7 +444,11 @@ bool Search::CalcBeam(
     uint custom_beam_size)
 {
     size_t batchSize = beamSizes.size();
-    Beams beams(batchSize);
+    Beams& beams = beams_;
+    beams.resize(batchSize);
+    for (auto& beam : beams) {
+      beam.clear();
+    }
 
     bestHyps_->CalcBeam(prevHyps, scorers_, filterIndices_, beams, beamSizes,custom_beam_size);
 
@@ -201,8 +464,10 @@ bool Search::CalcBeam(
     std::cout << "END ADDING BEAMS" << std::endl;
     #endif
 
-    Beam survivors;
+    Beam& survivors = survivors_;
+    survivors.clear();
     for (size_t batchId = 0; batchId < batchSize; ++batchId) {
+      size_t first = survivors.size();
       int token_index = 0;
       for (auto& h : beams[batchId]) {
 
@@ -212,9 +477,21 @@ bool Search::CalcBeam(
           survivors.push_back(h);
         } else {
           survivors.push_back(h);
-          //--beamSizes[batchId];
         }
       }
+
+      // finished sentences drop out of the batch
+      if (!beams[batchId].empty()
+          && IsConverged(*histories->at(batchId), survivors.begin() + first, survivors.end())) {
+        survivors.resize(first);
+      }
+
+      // pruning may leave fewer rows than the beam size
+      beamSizes[batchId] = survivors.size() - first;
+      if (!beams[batchId].empty()) {
+        liveBeamWidth_ += beams[batchId].size();
+        ++liveBeams_;
+      }
     }
 
     std::cout << "-------------" << std::endl;
@@ -250,7 +527,11 @@ bool Search::CalcBeam(
     States& nextStates)
 {
     size_t batchSize = beamSizes.size();
-    Beams beams(batchSize);
+    Beams& beams = beams_;
+    beams.resize(batchSize);
+    for (auto& beam : beams) {
+      beam.clear();
+    }
 
 #if DEBUG
     std::cout << "CALL THE CALLC BEAM CODE " << std::endl;
@@ -265,16 +546,30 @@ bool Search::CalcBeam(
     std::cout << "END ADDING BEAMS" << std::endl;
 #endif
 
-    Beam survivors;
+    Beam& survivors = survivors_;
+    survivors.clear();
     for (size_t batchId = 0; batchId < batchSize; ++batchId) {
+      size_t first = survivors.size();
       for (auto& h : beams[batchId]) {
         if (h->GetWord() != EOS_ID) {
           survivors.push_back(h);
         } else {
           //survivors.push_back(h);
-          --beamSizes[batchId];
         }
       }
+
+      // finished sentences drop out of the batch
+      if (!beams[batchId].empty()
+          && IsConverged(*histories->at(batchId), survivors.begin() + first, survivors.end())) {
+        survivors.resize(first);
+      }
+
+      // pruning may leave fewer rows than the beam size
+      beamSizes[batchId] = survivors.size() - first;
+      if (!beams[batchId].empty()) {
+        liveBeamWidth_ += beams[batchId].size();
+        ++liveBeams_;
+      }
     }
 
     if (survivors.size() == 0) {
@@ -292,6 +587,25 @@ bool Search::CalcBeam(
 
 
 
+bool Search::IsConverged(const History& history,
+                         Beam::const_iterator begin,
+                         Beam::const_iterator end) const
+{
+  if (begin == end) {
+    return true;
+  }
+  if (!earlyStopping_) {
+    return false;
+  }
+
+  float bestLiveCost = (*begin)->GetCost();
+  for (auto it = begin; it != end; ++it) {
+    bestLiveCost = std::max(bestLiveCost, (*it)->GetCost());
+  }
+  return history.IsConverged(bestLiveCost);
+}
+
+
 States Search::NewStates() const {
   States states;
   for (auto& scorer : scorers_) {
@@ -302,12 +616,10 @@ States Search::NewStates() const {
 
 void Search::FilterTargetVocab(const Sentences& sentences) {
   size_t vocabSize = scorers_[0]->GetVocabSize();
-  std::set<Word> srcWords;
+  Words srcWords;
   for (size_t i = 0; i < sentences.size(); ++i) {
-    const Sentence& sentence = *sentences.at(i);
-    for (const auto& srcWord : sentence.GetWords()) {
-      srcWords.insert(srcWord);
-    }
+    const Words& words = sentences.at(i)->GetWords();
+    srcWords.insert(srcWords.end(), words.begin(), words.end());
   }
 
   filterIndices_ = filter_->GetFilteredVocab(srcWords, vocabSize);
@@ -3,28 +3,41 @@
 #include <memory>
 #include <set>
 
+#include "common/god.h"
 #include "common/scorer.h"
 #include "common/sentence.h"
 #include "common/base_best_hyps.h"
 
 namespace amunmt {
 
+class History;
 class Histories;
 class Filter;
 
 class Search {
   public:
-    Search(const God &god);
+    Search(const God &god, God::ModelsPtr models, const DeviceInfo& deviceInfo);
     virtual ~Search();
 
     std::shared_ptr<Histories> Translate(const Sentences& sentences);
 
+    // the scorers the search was created from
+    const God::ModelsPtr& GetModels() const {
+      return models_;
+    }
+
   protected:
     States NewStates() const;
     void FilterTargetVocab(const Sentences& sentences);
-    States Encode(const Sentences& sentences);
+    States& Encode(const Sentences& sentences);
+    States& NextStates();
     void CleanAfterTranslation();
 
+    std::shared_ptr<Histories> TranslateGreedy(const Sentences& sentences);
+    std::shared_ptr<Histories> TranslateBestFirst(const Sentences& sentences);
+
+    bool IsConverged(const History& history, Beam::const_iterator begin, Beam::const_iterator end) const;
+
     bool CalcBeam(
                 std::shared_ptr<Histories>& histories,
                 std::vector<uint>& beamSizes,
@@ -44,13 +57,41 @@ class Search {
 
   protected:
     DeviceInfo deviceInfo_;
+    // kept alive while the scorers use them
+    God::ModelsPtr models_;
     std::vector<ScorerPtr> scorers_;
     std::shared_ptr<const Filter> filter_;
+    bool filterPerSentence_;
     const size_t maxBeamSize_;
     bool normalizeScore_;
     Words filterIndices_;
     BestHypsBasePtr bestHyps_;
     uint batchSize_;
+    bool earlyStopping_;
+    size_t nBest_;
+
+    // beam size 1 with a single scorer that can pick the best word itself
+    bool greedy_;
+    float greedyWeight_;
+
+    bool bestFirst_;
+    size_t bestFirstBatch_;
+    size_t bestFirstFrontier_;
+
+    // candidates kept per sentence and step, for tuning the pruning
+    size_t liveBeamWidth_;
+    size_t liveBeams_;
+
+    // Decoder states of the beam and greedy searches. They are kept from
+    // one batch to the next so that their buffers are only allocated until
+    // they have grown to the working size.
+    States states_;
+    States nextStates_;
+
+    // CalcBeam's candidates and survivors of a step, cleared but not freed
+    // between steps; emptied after every translation
+    Beams beams_;
+    Beam survivors_;
 };
 
 }
@@ -0,0 +1,53 @@
+#include <iostream>
+#include <string>
+#include <boost/program_options.hpp>
+
+#include "common/filter.h"
+#include "common/vocab.h"
+#include "common/logging.h"
+#include "common/exception.h"
+
+using namespace amunmt;
+namespace po = boost::program_options;
+
+// Converts a text alignment file for --softmax-filter to the binary form,
+// which amun loads without parsing. The vocabularies have to be the ones
+// the decoder uses.
+int main(int argc, char* argv[])
+{
+  std::string srcVocabPath, trgVocabPath, inputPath, outputPath;
+
+  po::options_description options("amun-shortlist options");
+  options.add_options()
+    ("source-vocab,s", po::value(&srcVocabPath)->required(), "Source vocabulary of the model")
+    ("target-vocab,t", po::value(&trgVocabPath)->required(), "Target vocabulary of the model")
+    ("input,i", po::value(&inputPath)->required(), "Text alignment file")
+    ("output,o", po::value(&outputPath)->required(), "Binary shortlist file")
+    ("help,h", "Print this help message and exit");
+
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    if (vm.count("help")) {
+      std::cout << options << std::endl;
+      return 0;
+    }
+    po::notify(vm);
+  } catch (const po::error& e) {
+    std::cerr << "Error: " << e.what() << std::endl << std::endl;
+    std::cerr << options << std::endl;
+    return 1;
+  }
+
+  spdlog::stderr_logger_mt("info");
+
+  Vocab srcVocab(srcVocabPath);
+  Vocab trgVocab(trgVocabPath);
+  amunmt_UTIL_THROW_IF2(Filter::IsBinary(inputPath), inputPath << " is already converted");
+
+  Filter filter(srcVocab, trgVocab, inputPath);
+  filter.Save(outputPath);
+  LOG(info)->info("Wrote {}", outputPath);
+
+  return 0;
+}
@@ -29,8 +29,8 @@ void TranslationTaskAndOutput(const God &god, std::shared_ptr<Sentences> sentenc
 
 std::shared_ptr<Histories> TranslationTask(const God &god, std::shared_ptr<Sentences> sentences) {
   try {
-    Search& search = god.GetSearch();
-    auto histories = search.Translate(*sentences);
+    std::shared_ptr<Search> search = god.GetSearch();
+    auto histories = search->Translate(*sentences);
 
     return histories;
   }
@@ -1,6 +1,9 @@
 #include "common/vocab.h"
 
-#include <sstream>
+#include <limits>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
 #include <yaml-cpp/yaml.h>
 
 #include "common/utils.h"
@@ -9,27 +12,137 @@
 
 namespace amunmt {
 
-Vocab::Vocab(const std::string& path) {
-    YAML::Node vocab = YAML::Load(InputFileStream(path));
-    for(auto&& pair : vocab) {
-      auto str = pair.first.as<std::string>();
-      auto id = pair.second.as<Word>();
-      str2id_[str] = id;
-      if(id >= id2str_.size())
-        id2str_.resize(id + 1);
-      id2str_[id] = str;
+namespace {
+
+// binary form: this magic, the number of words and the size of the blob as
+// uint32, then ids_, offsets_ and the blob
+const char MAGIC[8] = {'A', 'M', 'U', 'N', 'V', 'O', 'C', '1'};
+
+const uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+template <class T>
+void Write(std::ofstream& out, const T* data, size_t count) {
+  out.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+template <class T>
+void Read(std::ifstream& in, T* data, size_t count) {
+  in.read(reinterpret_cast<char*>(data), count * sizeof(T));
+}
+
+// FNV-1a, the lower bits pick the slot and the upper half is kept in it
+uint64_t Hash(boost::string_view word) {
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : word) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+  }
+  return hash;
+}
+
+}
+
+Vocab::Vocab(const std::string& path)
+  : offsets_(1, 0)
+{
+  if (IsBinary(path)) {
+    Load(path);
+  } else {
+    ParseYAML(path);
+  }
+  Index(path);
+}
+
+bool Vocab::IsBinary(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(MAGIC)];
+  return in.read(magic, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+void Vocab::ParseYAML(const std::string& path) {
+  YAML::Node vocab = YAML::Load(InputFileStream(path));
+  for(auto&& pair : vocab) {
+    Add(pair.first.as<std::string>(), pair.second.as<Word>());
+  }
+}
+
+void Vocab::Add(boost::string_view word, size_t id) {
+  amunmt_UTIL_THROW_IF2(id >= EMPTY, "Word id " << id << " does not fit in 32 bits");
+  amunmt_UTIL_THROW_IF2(blob_.size() + word.size() >= EMPTY, "Vocabulary larger than 4GB");
+  blob_.append(word.data(), word.size());
+  offsets_.push_back(blob_.size());
+  ids_.push_back(id);
+}
+
+void Vocab::Load(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(MAGIC)];
+  uint32_t sizes[2];
+  Read(in, magic, sizeof(magic));
+  Read(in, sizes, 2);
+  amunmt_UTIL_THROW_IF2(!in, "Broken vocabulary file " << path);
+
+  ids_.resize(sizes[0]);
+  offsets_.resize(sizes[0] + 1);
+  blob_.resize(sizes[1]);
+  Read(in, ids_.data(), ids_.size());
+  Read(in, offsets_.data(), offsets_.size());
+  Read(in, &blob_[0], blob_.size());
+  amunmt_UTIL_THROW_IF2(!in || offsets_.front() != 0 || offsets_.back() != blob_.size(),
+                        "Broken vocabulary file " << path);
+  for (size_t i = 0; i < ids_.size(); ++i) {
+    amunmt_UTIL_THROW_IF2(offsets_[i] > offsets_[i + 1] || ids_[i] == EMPTY,
+                          "Broken vocabulary file " << path);
+  }
+}
+
+void Vocab::Save(const std::string& path) const {
+  std::ofstream out(path, std::ios::binary);
+  uint32_t sizes[2] = {uint32_t(ids_.size()), uint32_t(blob_.size())};
+  Write(out, MAGIC, sizeof(MAGIC));
+  Write(out, sizes, 2);
+  Write(out, ids_.data(), ids_.size());
+  Write(out, offsets_.data(), offsets_.size());
+  Write(out, blob_.data(), blob_.size());
+  amunmt_UTIL_THROW_IF2(!out, "Cannot write vocabulary file " << path);
+}
+
+void Vocab::Index(const std::string& path) {
+  size_t slots = 2;
+  while (slots < 2 * ids_.size()) {
+    slots *= 2;
+  }
+  table_.assign(slots, Slot{EMPTY, 0});
+
+  // a word listed twice keeps its last id
+  for (uint32_t entry = 0; entry < ids_.size(); ++entry) {
+    boost::string_view word = Entry(entry);
+    uint64_t hash = Hash(word);
+    size_t i = hash & (slots - 1);
+    while (table_[i].entry != EMPTY
+           && (table_[i].hash != uint32_t(hash >> 32) || Entry(table_[i].entry) != word)) {
+      i = (i + 1) & (slots - 1);
     }
-    amunmt_UTIL_THROW_IF2(id2str_.empty(), "Empty vocabulary " << path);
-    id2str_[EOS_ID] = EOS_STR;
-    id2str_[UNK_ID] = UNK_STR;
+    table_[i] = Slot{entry, uint32_t(hash >> 32)};
+
+    uint32_t id = ids_[entry];
+    if(id >= id2str_.size())
+      id2str_.resize(id + 1);
+    id2str_[id] = word.to_string();
+  }
+  amunmt_UTIL_THROW_IF2(id2str_.empty(), "Empty vocabulary " << path);
+  id2str_[EOS_ID] = EOS_STR;
+  id2str_[UNK_ID] = UNK_STR;
 }
 
-size_t Vocab::operator[](const std::string& word) const {
-    auto it = str2id_.find(word);
-    if(it != str2id_.end())
-        return it->second;
-    else
-        return UNK_ID;
+size_t Vocab::operator[](boost::string_view word) const {
+  uint64_t hash = Hash(word);
+  size_t mask = table_.size() - 1;
+  for (size_t i = hash & mask; table_[i].entry != EMPTY; i = (i + 1) & mask) {
+    if (table_[i].hash == uint32_t(hash >> 32) && Entry(table_[i].entry) == word) {
+      return ids_[table_[i].entry];
+    }
+  }
+  return UNK_ID;
 }
 
 Words Vocab::operator()(const std::vector<std::string>& lineTokens, bool addEOS) const {
@@ -41,10 +154,20 @@ Words Vocab::operator()(const std::vector<std::string>& lineTokens, bool addEOS)
   return words;
 }
 
+// the tokens are looked up in place, without splitting the line into strings
 Words Vocab::operator()(const std::string& line, bool addEOS) const {
-  std::vector<std::string> lineTokens;
-  Split(line, lineTokens, " ");
-  return (*this)(lineTokens, addEOS);
+  Words words;
+  boost::string_view rest(line);
+  while (!rest.empty()) {
+    size_t end = std::min(rest.find(' '), rest.size());
+    if (end > 0) {
+      words.push_back((*this)[rest.substr(0, end)]);
+    }
+    rest.remove_prefix(std::min(end + 1, rest.size()));
+  }
+  if(addEOS)
+    words.push_back(EOS_ID);
+  return words;
 }
 
 std::vector<std::string> Vocab::operator()(const Words& sentence, bool ignoreEOS) const {
@@ -68,4 +191,3 @@ size_t Vocab::size() const {
 }
 
 }
-
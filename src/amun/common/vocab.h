@@ -1,18 +1,24 @@
 #pragma once
 
-#include <map>
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <boost/utility/string_view.hpp>
 
 #include "common/types.h"
 
 namespace amunmt {
 
+// Word list of a model, read from a YAML or JSON map of words to ids or from
+// the binary form written by Save (see amun-vocab), which is recognized by
+// its header and read without parsing. The words are kept in one blob and
+// looked up in an open addressing hash table of 32-bit entries, so a token
+// is found without building a std::string.
 class Vocab {
   public:
     Vocab(const std::string& path);
 
-    size_t operator[](const std::string& word) const;
+    size_t operator[](boost::string_view word) const;
 
     Words operator()(const std::vector<std::string>& lineTokens, bool addEOS = true) const;
 
@@ -24,9 +30,33 @@ class Vocab {
 
     size_t size() const;
 
+    void Save(const std::string& path) const;
+
+    static bool IsBinary(const std::string& path);
+
   private:
-    typedef std::map<std::string, size_t> Str2Id;
-    Str2Id str2id_;
+    void ParseYAML(const std::string& path);
+    void Load(const std::string& path);
+
+    void Add(boost::string_view word, size_t id);
+    // hash table and decoding list of the words added
+    void Index(const std::string& path);
+
+    boost::string_view Entry(uint32_t entry) const {
+      return boost::string_view(blob_.data() + offsets_[entry], offsets_[entry + 1] - offsets_[entry]);
+    }
+
+    // entry i is the word blob_[offsets_[i] .. offsets_[i + 1]) with id ids_[i]
+    std::string blob_;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint32_t> ids_;
+
+    // a power of two of slots, at most half of them used
+    struct Slot {
+      uint32_t entry;
+      uint32_t hash;  // upper half of the word's hash, compared first
+    };
+    std::vector<Slot> table_;
 
     typedef std::vector<std::string> Id2Str;
     Id2Str id2str_;
@@ -0,0 +1,48 @@
+#include <iostream>
+#include <string>
+#include <boost/program_options.hpp>
+
+#include "common/vocab.h"
+#include "common/logging.h"
+#include "common/exception.h"
+
+using namespace amunmt;
+namespace po = boost::program_options;
+
+// Converts a YAML or JSON vocabulary to the binary form, which amun loads
+// without parsing. Files passed to --source-vocab, --target-vocab and
+// amun-shortlist may be in either form.
+int main(int argc, char* argv[])
+{
+  std::string inputPath, outputPath;
+
+  po::options_description options("amun-vocab options");
+  options.add_options()
+    ("input,i", po::value(&inputPath)->required(), "YAML or JSON vocabulary")
+    ("output,o", po::value(&outputPath)->required(), "Binary vocabulary file")
+    ("help,h", "Print this help message and exit");
+
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    if (vm.count("help")) {
+      std::cout << options << std::endl;
+      return 0;
+    }
+    po::notify(vm);
+  } catch (const po::error& e) {
+    std::cerr << "Error: " << e.what() << std::endl << std::endl;
+    std::cerr << options << std::endl;
+    return 1;
+  }
+
+  spdlog::stderr_logger_mt("info");
+
+  amunmt_UTIL_THROW_IF2(Vocab::IsBinary(inputPath), inputPath << " is already converted");
+
+  Vocab vocab(inputPath);
+  vocab.Save(outputPath);
+  LOG(info)->info("Wrote {}, {} words", outputPath, vocab.size());
+
+  return 0;
+}
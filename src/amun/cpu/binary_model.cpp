@@ -0,0 +1,253 @@
+#include "cpu/binary_model.h"
+
+#include <cstring>
+#include <fstream>
+#include <yaml-cpp/yaml.h>
+
+#include "common/exception.h"
+
+namespace amunmt {
+namespace CPU {
+
+namespace {
+
+const char MAGIC[8] = {'A', 'M', 'U', 'N', 'M', 'O', 'D', 'L'};
+const uint32_t VERSION = 1;
+const size_t ALIGNMENT = mblas::AlignedBuffer<float>::ALIGNMENT;
+
+typedef blaze::CustomMatrix<float, blaze::unaligned,
+  blaze::unpadded, blaze::rowMajor> BlazeWrapper;
+
+template <class T>
+void Write(std::ostream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <class T>
+T Read(const char* p) {
+  T value;
+  std::memcpy(&value, p, sizeof(T));
+  return value;
+}
+
+size_t Align(size_t offset) {
+  return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+}
+
+BinaryModelWriter::BinaryModelWriter(const std::string& type,
+                                     const mblas::QuantizationOptions& quantization)
+{
+  YAML::Emitter metadata;
+  metadata << YAML::BeginMap
+           << YAML::Key << "type" << YAML::Value << type
+           << YAML::Key << "panel-width" << YAML::Value << mblas::PackedMatrix::PANEL_WIDTH
+           << YAML::Key << "int16" << YAML::Value << quantization.int16
+           << YAML::Key << "int8-output" << YAML::Value << quantization.int8Output
+           << YAML::Key << "vocab-major-output" << YAML::Value << quantization.vocabMajorOutput
+           << YAML::EndMap;
+  metadata_ = metadata.c_str();
+}
+
+void BinaryModelWriter::AddTensor(const std::string& name, TensorKind kind,
+                                  size_t rows, size_t columns,
+                                  const void* data, size_t bytes) {
+  tensors_.push_back({name, kind, rows, columns, bytes, [data, bytes](std::ostream& out) {
+    out.write(static_cast<const char*>(data), bytes);
+  }});
+}
+
+void BinaryModelWriter::Add(const std::string& name, const mblas::Matrix& matrix) {
+  // without the padding of the rows
+  const mblas::Matrix* m = &matrix;
+  tensors_.push_back({name, TensorKind::Float32, matrix.rows(), matrix.columns(),
+                      matrix.rows() * matrix.columns() * sizeof(float), [m](std::ostream& out) {
+    for (size_t i = 0; i < m->rows(); ++i) {
+      out.write(reinterpret_cast<const char*>(m->data(i)), m->columns() * sizeof(float));
+    }
+  }});
+}
+
+void BinaryModelWriter::Add(const std::string& name, const mblas::MatrixView& matrix) {
+  AddTensor(name, TensorKind::Float32, matrix.rows(), matrix.columns(),
+            matrix.data(), matrix.rows() * matrix.columns() * sizeof(float));
+}
+
+void BinaryModelWriter::Add(const std::string& name, const mblas::PackedMatrix& matrix) {
+  AddTensor(name, TensorKind::Packed, matrix.rows(), matrix.columns(),
+            matrix.panel(0), matrix.size() * sizeof(float));
+}
+
+void BinaryModelWriter::Add(const std::string& name, const mblas::QuantizedMatrix8& matrix) {
+  AddTensor(name, TensorKind::Int8, matrix.rows(), matrix.columns(),
+            matrix.column(0), matrix.columns() * matrix.stride() * sizeof(int8_t));
+  AddTensor(name + ".scales", TensorKind::Float32, 1, matrix.columns(),
+            matrix.scales(), matrix.columns() * sizeof(float));
+}
+
+void BinaryModelWriter::Add(const std::string& name, const mblas::QuantizedMatrix16& matrix) {
+  AddTensor(name, TensorKind::Int16, matrix.rows(), matrix.columns(),
+            matrix.column(0), matrix.columns() * matrix.stride() * sizeof(int16_t));
+  AddTensor(name + ".scales", TensorKind::Float32, 1, matrix.columns(),
+            matrix.scales(), matrix.columns() * sizeof(float));
+}
+
+void BinaryModelWriter::Save(const std::string& path) const {
+  size_t offset = sizeof(MAGIC) + 2 * sizeof(uint32_t) + sizeof(uint64_t) + metadata_.size();
+  for (const Tensor& tensor : tensors_) {
+    offset += sizeof(uint32_t) + tensor.name.size() + sizeof(uint32_t) + 4 * sizeof(uint64_t);
+  }
+
+  std::ofstream out(path, std::ios::binary);
+  amunmt_UTIL_THROW_IF2(!out, "Cannot write " << path);
+  out.write(MAGIC, sizeof(MAGIC));
+  Write(out, VERSION);
+  Write(out, uint32_t(tensors_.size()));
+  Write(out, uint64_t(metadata_.size()));
+  out.write(metadata_.data(), metadata_.size());
+
+  std::vector<uint64_t> offsets;
+  for (const Tensor& tensor : tensors_) {
+    offset = Align(offset);
+    offsets.push_back(offset);
+    Write(out, uint32_t(tensor.name.size()));
+    out.write(tensor.name.data(), tensor.name.size());
+    Write(out, uint32_t(tensor.kind));
+    Write(out, tensor.rows);
+    Write(out, tensor.columns);
+    Write(out, offset);
+    Write(out, tensor.bytes);
+    offset += tensor.bytes;
+  }
+
+  for (size_t i = 0; i < tensors_.size(); ++i) {
+    std::string padding(offsets[i] - out.tellp(), '\0');
+    out.write(padding.data(), padding.size());
+    tensors_[i].write(out);
+  }
+  amunmt_UTIL_THROW_IF2(!out, "Cannot write " << path);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+bool BinaryModel::IsBinary(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(MAGIC)];
+  return in.read(magic, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+BinaryModel::BinaryModel(const std::string& path, bool hugePages)
+  : file_(new MappedFile(path))
+{
+  file_->WillNeed();
+  if (hugePages && !file_->HugePages()) {
+    std::cerr << "No huge pages for " << path << std::endl;
+  }
+
+  const char* begin = file_->data();
+  const size_t size = file_->size();
+  size_t pos = sizeof(MAGIC) + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+  amunmt_UTIL_THROW_IF2(size < pos || std::memcmp(begin, MAGIC, sizeof(MAGIC)) != 0,
+                        path << " is not a native amun model");
+  uint32_t version = Read<uint32_t>(begin + 8);
+  amunmt_UTIL_THROW_IF2(version != VERSION, path << " is a native model of version " << version
+                        << ", this amun reads version " << VERSION);
+  uint32_t count = Read<uint32_t>(begin + 12);
+  uint64_t metadataSize = Read<uint64_t>(begin + 16);
+  amunmt_UTIL_THROW_IF2(pos + metadataSize > size, "Broken model file " << path);
+
+  YAML::Node metadata = YAML::Load(std::string(begin + pos, metadataSize));
+  pos += metadataSize;
+  type_ = metadata["type"].as<std::string>();
+  quantization_.int16 = metadata["int16"].as<bool>();
+  quantization_.int8Output = metadata["int8-output"].as<bool>();
+  quantization_.vocabMajorOutput = metadata["vocab-major-output"].as<bool>();
+  amunmt_UTIL_THROW_IF2(metadata["panel-width"].as<size_t>() != mblas::PackedMatrix::PANEL_WIDTH,
+                        path << " was packed for panels of " << metadata["panel-width"].as<size_t>()
+                        << " columns, not " << mblas::PackedMatrix::PANEL_WIDTH
+                        << "; convert the model again");
+
+  for (uint32_t i = 0; i < count; ++i) {
+    amunmt_UTIL_THROW_IF2(pos + sizeof(uint32_t) > size, "Broken model file " << path);
+    uint32_t nameLength = Read<uint32_t>(begin + pos);
+    pos += sizeof(uint32_t);
+    amunmt_UTIL_THROW_IF2(pos + nameLength + sizeof(uint32_t) + 4 * sizeof(uint64_t) > size,
+                          "Broken model file " << path);
+    std::string name(begin + pos, nameLength);
+    pos += nameLength;
+
+    Tensor tensor;
+    tensor.kind = TensorKind(Read<uint32_t>(begin + pos));
+    tensor.rows = Read<uint64_t>(begin + pos + 4);
+    tensor.columns = Read<uint64_t>(begin + pos + 12);
+    uint64_t offset = Read<uint64_t>(begin + pos + 20);
+    tensor.bytes = Read<uint64_t>(begin + pos + 28);
+    pos += sizeof(uint32_t) + 4 * sizeof(uint64_t);
+    amunmt_UTIL_THROW_IF2(offset % ALIGNMENT || offset + tensor.bytes > size,
+                          "Broken tensor " << name << " in " << path);
+    tensor.data = begin + offset;
+    tensors_[name] = tensor;
+  }
+}
+
+const BinaryModel::Tensor& BinaryModel::Get(const std::string& name, TensorKind kind) const {
+  auto it = tensors_.find(name);
+  amunmt_UTIL_THROW_IF2(it == tensors_.end(), "Missing " << name << " in " << file_->path());
+  amunmt_UTIL_THROW_IF2(it->second.kind != kind, name << " in " << file_->path()
+                        << " is of kind " << uint32_t(it->second.kind) << ", not " << uint32_t(kind));
+  return it->second;
+}
+
+mblas::Matrix BinaryModel::Matrix(const std::string& name) const {
+  const Tensor& tensor = Get(name, TensorKind::Float32);
+  amunmt_UTIL_THROW_IF2(tensor.bytes != tensor.rows * tensor.columns * sizeof(float),
+                        "Broken tensor " << name << " in " << file_->path());
+  BlazeWrapper values((float*)tensor.data, tensor.rows, tensor.columns);
+  mblas::Matrix matrix(tensor.rows, tensor.columns);
+  matrix = values;
+  return matrix;
+}
+
+mblas::MatrixView BinaryModel::View(const std::string& name) const {
+  const Tensor& tensor = Get(name, TensorKind::Float32);
+  amunmt_UTIL_THROW_IF2(tensor.bytes != tensor.rows * tensor.columns * sizeof(float),
+                        "Broken tensor " << name << " in " << file_->path());
+  return mblas::MatrixView(file_, reinterpret_cast<const float*>(tensor.data),
+                           tensor.rows, tensor.columns);
+}
+
+mblas::PackedMatrix BinaryModel::Packed(const std::string& name) const {
+  const Tensor& tensor = Get(name, TensorKind::Packed);
+  mblas::PackedMatrix packed(file_, reinterpret_cast<const float*>(tensor.data),
+                             tensor.rows, tensor.columns);
+  amunmt_UTIL_THROW_IF2(tensor.bytes != packed.size() * sizeof(float),
+                        "Broken tensor " << name << " in " << file_->path());
+  return packed;
+}
+
+mblas::QuantizedMatrix8 BinaryModel::Quantized8(const std::string& name) const {
+  const Tensor& tensor = Get(name, TensorKind::Int8);
+  const Tensor& scales = Get(name + ".scales", TensorKind::Float32);
+  amunmt_UTIL_THROW_IF2(tensor.bytes != tensor.columns * mblas::QuantizedMatrix8::Stride(tensor.rows)
+                        || scales.bytes != tensor.columns * sizeof(float),
+                        "Broken tensor " << name << " in " << file_->path());
+  return mblas::QuantizedMatrix8(tensor.rows, tensor.columns,
+                                 reinterpret_cast<const int8_t*>(tensor.data),
+                                 reinterpret_cast<const float*>(scales.data));
+}
+
+mblas::QuantizedMatrix16 BinaryModel::Quantized16(const std::string& name) const {
+  const Tensor& tensor = Get(name, TensorKind::Int16);
+  const Tensor& scales = Get(name + ".scales", TensorKind::Float32);
+  amunmt_UTIL_THROW_IF2(tensor.bytes != tensor.columns * mblas::QuantizedMatrix16::Stride(tensor.rows)
+                                          * sizeof(int16_t)
+                        || scales.bytes != tensor.columns * sizeof(float),
+                        "Broken tensor " << name << " in " << file_->path());
+  return mblas::QuantizedMatrix16(tensor.rows, tensor.columns,
+                                  reinterpret_cast<const int16_t*>(tensor.data),
+                                  reinterpret_cast<const float*>(scales.data));
+}
+
+}
+}
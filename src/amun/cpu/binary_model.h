@@ -0,0 +1,130 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include "common/mapped_file.h"
+#include "cpu/mblas/matrix.h"
+#include "cpu/mblas/packed.h"
+#include "cpu/mblas/quantized.h"
+
+namespace amunmt {
+namespace CPU {
+
+// Native model format of the CPU backend, written by amun-convert from an
+// npz model. The weights are stored in the form the decoders use them:
+// biases transposed, GRU matrices concatenated, fp32 matrices packed and,
+// if the model was converted so, quantized. Loading maps the file and uses
+// the packed matrices and embeddings in place. The layout is
+//   "AMUNMODL", version and number of tensors as uint32, metadata size as
+//   uint64;
+//   the metadata, a YAML map with the model type and the weight forms;
+//   per tensor the name length as uint32, the name, the kind as uint32,
+//   rows, columns, offset and size in bytes as uint64;
+//   the tensors, each at a 64-byte aligned offset.
+// A tensor is named after the member of the Weights struct it fills, as
+// listed by the struct's Visit function, e.g. "decGru1.UUx".
+enum class TensorKind : uint32_t {
+  Float32 = 0,  // rows x columns, row by row
+  Packed = 1,   // the panels of a mblas::PackedMatrix
+  Int8 = 2,     // columns x stride, scales in the tensor "<name>.scales"
+  Int16 = 3
+};
+
+class BinaryModelWriter {
+  public:
+    BinaryModelWriter(const std::string& type, const mblas::QuantizationOptions& quantization);
+
+    void Add(const std::string& name, const mblas::Matrix& matrix);
+    void Add(const std::string& name, const mblas::MatrixView& matrix);
+    void Add(const std::string& name, const mblas::PackedMatrix& matrix);
+    void Add(const std::string& name, const mblas::QuantizedMatrix8& matrix);
+    void Add(const std::string& name, const mblas::QuantizedMatrix16& matrix);
+
+    // item i as "<name>.<i>"
+    template <class T>
+    void Add(const std::string& name, const std::vector<T>& items) {
+      for (size_t i = 0; i < items.size(); ++i) {
+        Add(name + "." + std::to_string(i), items[i]);
+      }
+    }
+
+    // the members listed by weights.Visit as "<name>.<member>"
+    template <class W>
+    void Add(const std::string& name, const W& weights) {
+      weights.Visit([&](const std::string& member, const auto& value) {
+        Add(name + "." + member, value);
+      });
+    }
+
+    // the weights are read again here, they have to be alive
+    void Save(const std::string& path) const;
+
+  private:
+    struct Tensor {
+      std::string name;
+      TensorKind kind;
+      uint64_t rows;
+      uint64_t columns;
+      uint64_t bytes;
+      std::function<void(std::ostream&)> write;
+    };
+
+    void AddTensor(const std::string& name, TensorKind kind, size_t rows, size_t columns,
+                   const void* data, size_t bytes);
+
+    std::string metadata_;
+    std::vector<Tensor> tensors_;
+};
+
+class BinaryModel {
+  public:
+    explicit BinaryModel(const std::string& path, bool hugePages = false);
+
+    static bool IsBinary(const std::string& path);
+
+    // dl4mt or nematus2
+    const std::string& Type() const {
+      return type_;
+    }
+
+    // the forms the weights were converted to
+    const mblas::QuantizationOptions& Quantization() const {
+      return quantization_;
+    }
+
+    bool Has(const std::string& name) const {
+      return tensors_.count(name);
+    }
+
+    // The tensor called name, which has to be in the file and of the kind
+    // asked for. The views, the packed matrices and the embeddings point
+    // into the mapped file and keep it mapped.
+    mblas::Matrix Matrix(const std::string& name) const;
+    mblas::MatrixView View(const std::string& name) const;
+    mblas::PackedMatrix Packed(const std::string& name) const;
+    mblas::QuantizedMatrix8 Quantized8(const std::string& name) const;
+    mblas::QuantizedMatrix16 Quantized16(const std::string& name) const;
+
+  private:
+    struct Tensor {
+      TensorKind kind;
+      size_t rows;
+      size_t columns;
+      const char* data;
+      size_t bytes;
+    };
+
+    const Tensor& Get(const std::string& name, TensorKind kind) const;
+
+    MappedFilePtr file_;
+    std::string type_;
+    mblas::QuantizationOptions quantization_;
+    std::map<std::string, Tensor> tensors_;
+};
+
+}
+}
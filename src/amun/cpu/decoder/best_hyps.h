@@ -7,21 +7,12 @@
 #include "common/god.h"
 #include "common/exception.h"
 #include "cpu/mblas/matrix.h"
+#include "cpu/mblas/nth_element.h"
 #include "cpu/decoder/encoder_decoder.h"
 
 namespace amunmt {
 namespace CPU {
 
-struct ProbCompare {
-  ProbCompare(const float* data) : data_(data) {}
-
-  bool operator()(const unsigned a, const unsigned b) {
-    return data_[a] > data_[b];
-  }
-
-  const float* data_;
-};
-
 class BestHyps : public BestHypsBase
 {
   public:
@@ -31,7 +22,10 @@ class BestHyps : public BestHypsBase
           god.Get<bool>("n-best"),
           god.Get<std::vector<std::string>>("softmax-filter").size(),
           god.Get<bool>("return-alignment") || god.Get<bool>("return-soft-alignment"),
-          god.GetScorerWeights())
+          god.GetScorerWeights(),
+          god.Get<float>("prune-relative"),
+          god.Get<float>("prune-absolute"),
+          god.Get<size_t>("max-candidates-per-parent"))
     {}
 
     void CalcBeam(
@@ -41,113 +35,12 @@ class BestHyps : public BestHypsBase
         std::vector<Beam>& beams,
         std::vector<uint>& beamSizes)
     {
-      using namespace mblas;
-
-      mblas::ArrayMatrix& Probs = static_cast<mblas::ArrayMatrix&>(scorers[0]->GetProbs());
-
-      mblas::ArrayMatrix Costs(Probs.rows(), 1);
-      for (size_t i = 0; i < prevHyps.size(); ++i) {
-        Costs.data()[i] = prevHyps[i]->GetCost();
-      }
-
-      Probs *= weights_.at(scorers[0]->GetName());
-      AddBiasVector<byColumn>(Probs, Costs);
-
-      for (size_t i = 1; i < scorers.size(); ++i) {
-        mblas::ArrayMatrix &currProb = static_cast<mblas::ArrayMatrix&>(scorers[i]->GetProbs());
-
-        Probs += weights_.at(scorers[i]->GetName()) * currProb;
-      }
-
-      size_t size = Probs.rows() * Probs.columns(); // Probs.size();
-      std::vector<size_t> keys(size);
-      for (size_t i = 0; i < keys.size(); ++i) {
-        keys[i] = i;
-      }
-
-      size_t beamSize = beamSizes[0];
-
-      std::vector<size_t> bestKeys(beamSize);
-      std::vector<float> bestCosts(beamSize);
-
-      if (forbidUNK_) {
-        blaze::column(Probs, UNK_ID) = std::numeric_limits<float>::lowest();
-      }
-
-      std::nth_element(keys.begin(), keys.begin() + beamSize, keys.end(),
-                       ProbCompare(Probs.data()));
-
-      for (size_t i = 0; i < beamSize; ++i) {
-        bestKeys[i] = keys[i];
-        bestCosts[i] = Probs.data()[keys[i]];
-      }
-
-      std::vector<std::vector<float>> breakDowns;
-      if (returnNBestList_) {
-        breakDowns.push_back(bestCosts);
-        for (auto& scorer : scorers) {
-          std::vector<float> modelCosts(beamSize);
-          mblas::ArrayMatrix &currProb = static_cast<mblas::ArrayMatrix&>(scorer->GetProbs());
-
-          auto it = boost::make_permutation_iterator(currProb.begin(), keys.begin());
-          std::copy(it, it + beamSize, modelCosts.begin());
-          breakDowns.push_back(modelCosts);
-        }
-      }
-
-      for (size_t i = 0; i < beamSize; i++) {
-        size_t wordIndex = bestKeys[i] % Probs.columns();
-
-        if (isInputFiltered_) {
-          wordIndex = filterIndices[wordIndex];
-        }
-
-        size_t hypIndex  = bestKeys[i] / Probs.columns();
-        float cost = bestCosts[i];
-
-        HypothesisPtr hyp;
-        if (returnAttentionWeights_) {
-          std::vector<SoftAlignmentPtr> alignments;
-          for (auto& scorer : scorers) {
-            if (CPU::CPUEncoderDecoderBase* encdec = dynamic_cast<CPU::CPUEncoderDecoderBase*>(scorer.get())) {
-              auto& attention = encdec->GetAttention();
-              alignments.emplace_back(new SoftAlignment(attention.begin(hypIndex),
-                                                        attention.end(hypIndex)));
-            } else {
-              amunmt_UTIL_THROW2("Return Alignment is allowed only with Nematus scorer.");
-            }
-          }
-
-          hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost, alignments));
-        } else {
-          hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost));
-        }
-
-        if (returnNBestList_) {
-          hyp->GetCostBreakdown().resize(scorers.size());
-          float sum = 0;
-          for(size_t j = 0; j < scorers.size(); ++j) {
-            if (j == 0) {
-              hyp->GetCostBreakdown()[0] = breakDowns[0][i];
-            } else {
-              float cost = 0;
-              if (j < scorers.size()) {
-                if (prevHyps[hypIndex]->GetCostBreakdown().size() < scorers.size())
-                  const_cast<HypothesisPtr&>(prevHyps[hypIndex])->GetCostBreakdown().resize(scorers.size(), 0.0);
-                cost = breakDowns[j][i] + const_cast<HypothesisPtr&>(prevHyps[hypIndex])->GetCostBreakdown()[j];
-              }
-              sum += weights_.at(scorers[j]->GetName()) * cost;
-              hyp->GetCostBreakdown()[j] = cost;
-            }
-          }
-          hyp->GetCostBreakdown()[0] -= sum;
-          hyp->GetCostBreakdown()[0] /= weights_.at(scorers[0]->GetName());
-        }
-        beams[0].push_back(hyp);
-      }
+      CalcBeam(prevHyps, scorers, filterIndices, beams, beamSizes, 0);
     }
 
-
+    // beamSizes holds the number of rows of each sentence, custom_beam
+    // (if not 0) the number of candidates to select per sentence; without
+    // it beamSizes is used for both
     void CalcBeam(
         const Beam& prevHyps,
         const std::vector<ScorerPtr>& scorers,
@@ -158,66 +51,117 @@ class BestHyps : public BestHypsBase
     {
       using namespace mblas;
 
-      mblas::ArrayMatrix& Probs = static_cast<mblas::ArrayMatrix&>(scorers[0]->GetProbs());
-
-      mblas::ArrayMatrix Costs(Probs.rows(), 1);
+      prevCosts_.resize(prevHyps.size());
       for (size_t i = 0; i < prevHyps.size(); ++i) {
-        Costs.data()[i] = prevHyps[i]->GetCost();
+        prevCosts_[i] = prevHyps[i]->GetCost();
       }
 
-      Probs *= weights_.at(scorers[0]->GetName());
-      AddBiasVector<byColumn>(Probs, Costs);
+      // a single model may have kept only the best words of every row, the
+      // keys then use the full vocabulary size as row length
+      const bool topK = scorers.size() == 1 && scorers[0]->GetTopK(topKWords_, topKCosts_);
+
+      // scores are combined inside the top-k, the scorers' probabilities
+      // are only read once and left unmodified
+      probs_.resize(scorers.size());
+      scorerWeights_.resize(scorers.size());
+      for (size_t i = 0; i < scorers.size(); ++i) {
+        probs_[i] = static_cast<mblas::ArrayMatrix&>(scorers[i]->GetProbs()).data();
+        scorerWeights_[i] = weights_.at(scorers[i]->GetName());
+      }
 
-      for (size_t i = 1; i < scorers.size(); ++i) {
-        mblas::ArrayMatrix &currProb = static_cast<mblas::ArrayMatrix&>(scorers[i]->GetProbs());
+      const size_t cols = topK ? scorers[0]->GetVocabSize()
+                               : static_cast<mblas::ArrayMatrix&>(scorers[0]->GetProbs()).columns();
+      const size_t maskedColumn = forbidUNK_ ? UNK_ID : cols;
 
-        Probs += weights_.at(scorers[i]->GetName()) * currProb;
-      }
+      // in the first step there is a single hypothesis per sentence,
+      // afterwards sentence b owns beamSizes[b] consecutive rows
+      const bool isFirst = (prevHyps[0]->GetPrevHyp() == nullptr);
 
-      size_t size = Probs.rows() * Probs.columns(); // Probs.size();
-      std::vector<size_t> keys(size);
-      for (size_t i = 0; i < keys.size(); ++i) {
-        keys[i] = i;
-      }
+      size_t rowStart = 0;
+      for (size_t batchId = 0; batchId < beamSizes.size(); ++batchId) {
+        size_t rows = isFirst ? 1 : beamSizes[batchId];
+        if (rows == 0) {
+          continue;
+        }
 
-      size_t beamSize = beamSizes[0];
+        size_t beamSize = custom_beam ? custom_beam : beamSizes[batchId];
+        if (topK) {
+          MergeTopK(topKWords_.size() / prevHyps.size(), scorerWeights_[0], cols,
+                    rowStart, rows, beamSize);
+        } else {
+          nthElement_.getNBestList(probs_, scorerWeights_, prevCosts_.data(),
+                                   cols, rowStart, rows, beamSize, maskedColumn,
+                                   bestCosts_, bestKeys_);
+        }
+        PruneCandidates(bestCosts_, bestKeys_, cols);
 
-      std::vector<size_t> bestKeys(beamSize);
-      std::vector<float> bestCosts(beamSize);
+        AddHyps(prevHyps, scorers, filterIndices, bestKeys_, bestCosts_, cols, batchId, beams[batchId]);
+        rowStart += rows;
+      }
+    }
 
-      if (forbidUNK_) {
-        blaze::column(Probs, UNK_ID) = std::numeric_limits<float>::lowest();
+   void resizeCosts(uint size){
+   }
+
+  private:
+    // The k best candidates of rows [rowStart, rowStart + rows) from the
+    // perRow best words the model kept of each row, in the order
+    // NthElement returns them.
+    void MergeTopK(size_t perRow, float weight, size_t cols,
+                   size_t rowStart, size_t rows, size_t k) {
+      candidates_.clear();
+      for (size_t r = rowStart; r < rowStart + rows; ++r) {
+        for (size_t i = r * perRow; i < (r + 1) * perRow; ++i) {
+          candidates_.emplace_back(-(prevCosts_[r] + weight * topKCosts_[i]),
+                                   r * cols + topKWords_[i]);
+        }
       }
 
-      std::nth_element(keys.begin(), keys.begin() + beamSize, keys.end(),
-                       ProbCompare(Probs.data()));
+      // ascending negated costs are descending costs, ties by smaller key
+      k = std::min(k, candidates_.size());
+      std::partial_sort(candidates_.begin(), candidates_.begin() + k, candidates_.end());
 
-      for (size_t i = 0; i < beamSize; ++i) {
-        bestKeys[i] = keys[i];
-        bestCosts[i] = Probs.data()[keys[i]];
+      bestCosts_.resize(k);
+      bestKeys_.resize(k);
+      for (size_t i = 0; i < k; ++i) {
+        bestCosts_[i] = -candidates_[i].first;
+        bestKeys_[i] = candidates_[i].second;
       }
+    }
 
-      std::vector<std::vector<float>> breakDowns;
-      if (returnNBestList_) {
-        breakDowns.push_back(bestCosts);
-        for (auto& scorer : scorers) {
-          std::vector<float> modelCosts(beamSize);
-          mblas::ArrayMatrix &currProb = static_cast<mblas::ArrayMatrix&>(scorer->GetProbs());
+    void AddHyps(
+        const Beam& prevHyps,
+        const std::vector<ScorerPtr>& scorers,
+        const Words& filterIndices,
+        const std::vector<size_t>& bestKeys,
+        const std::vector<float>& bestCosts,
+        size_t cols,
+        size_t batchId,
+        Beam& beam)
+    {
+      size_t beamSize = bestKeys.size();
 
-          auto it = boost::make_permutation_iterator(currProb.begin(), keys.begin());
-          std::copy(it, it + beamSize, modelCosts.begin());
-          breakDowns.push_back(modelCosts);
+      std::vector<std::vector<float>>& breakDowns = breakDowns_;
+      if (returnNBestList_) {
+        breakDowns.resize(scorers.size());
+        breakDowns[0].assign(bestCosts.begin(), bestCosts.end());
+        for (size_t j = 1; j < scorers.size(); ++j) {
+          breakDowns[j].resize(beamSize);
+          mblas::ArrayMatrix &currProb = static_cast<mblas::ArrayMatrix&>(scorers[j]->GetProbs());
+
+          auto it = boost::make_permutation_iterator(currProb.begin(), bestKeys.begin());
+          std::copy(it, it + beamSize, breakDowns[j].begin());
         }
       }
 
       for (size_t i = 0; i < beamSize; i++) {
-        size_t wordIndex = bestKeys[i] % Probs.columns();
+        size_t wordIndex = bestKeys[i] % cols;
 
         if (isInputFiltered_) {
           wordIndex = filterIndices[wordIndex];
         }
 
-        size_t hypIndex  = bestKeys[i] / Probs.columns();
+        size_t hypIndex  = bestKeys[i] / cols;
         float cost = bestCosts[i];
 
         HypothesisPtr hyp;
@@ -226,16 +170,17 @@ class BestHyps : public BestHypsBase
           for (auto& scorer : scorers) {
             if (CPU::CPUEncoderDecoderBase* encdec = dynamic_cast<CPU::CPUEncoderDecoderBase*>(scorer.get())) {
               auto& attention = encdec->GetAttention();
+              size_t srcLength = encdec->GetSentenceLengths()[batchId];
               alignments.emplace_back(new SoftAlignment(attention.begin(hypIndex),
-                                                        attention.end(hypIndex)));
+                                                        attention.begin(hypIndex) + srcLength));
             } else {
               amunmt_UTIL_THROW2("Return Alignment is allowed only with Nematus scorer.");
             }
           }
 
-          hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost, alignments));
+          hyp = NewHypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost, alignments);
         } else {
-          hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost));
+          hyp = NewHypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost);
         }
 
         if (returnNBestList_) {
@@ -258,18 +203,23 @@ class BestHyps : public BestHypsBase
           hyp->GetCostBreakdown()[0] -= sum;
           hyp->GetCostBreakdown()[0] /= weights_.at(scorers[0]->GetName());
         }
-        beams[0].push_back(hyp);
+        beam.push_back(hyp);
       }
     }
 
-   void resizeCosts(uint size){
-   }
-
-
-
-
-
-
+    mblas::NthElement nthElement_;
+
+    // reused to avoid allocation
+    std::vector<const float*> probs_;
+    std::vector<float> scorerWeights_;
+    std::vector<float> prevCosts_;
+    std::vector<size_t> bestKeys_;
+    std::vector<float> bestCosts_;
+    std::vector<size_t> topKWords_;
+    std::vector<float> topKCosts_;
+    std::vector<std::pair<float, size_t>> candidates_;
+    // per scorer costs of the candidates, for n-best lists
+    std::vector<std::vector<float>> breakDowns_;
 };
 
 }  // namespace CPU
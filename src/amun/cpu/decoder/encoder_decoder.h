@@ -25,8 +25,23 @@ class CPUEncoderDecoderBase : public Scorer {
     virtual void GetAttention(mblas::Matrix& Attention) = 0;
     virtual mblas::Matrix& GetAttention() = 0;
 
+    virtual bool SupportsGreedy() const {
+      return true;
+    }
+
+    virtual bool SupportsTopK() const {
+      return true;
+    }
+
+    const std::vector<size_t>& GetSentenceLengths() const {
+      return SentenceLengths_;
+    }
+
   protected:
+    // source context of all sentences in the batch, each padded to the
+    // longest sentence: row b * maxLength + i is position i of sentence b
     mblas::Matrix SourceContext_;
+    std::vector<size_t> SentenceLengths_;
 };
 
 
@@ -4,6 +4,8 @@
 #include <yaml-cpp/yaml.h>
 
 #include "common/god.h"
+#include "common/exception.h"
+#include "cpu/binary_model.h"
 #include "cpu/decoder/best_hyps.h"
 #include "cpu/dl4mt/encoder_decoder.h"
 #include "cpu/nematus/encoder_decoder.h"
@@ -13,22 +15,71 @@ using namespace std;
 namespace amunmt {
 namespace CPU {
 
+namespace {
+
+std::string Describe(const mblas::QuantizationOptions& quantization) {
+  std::string description = quantization.int16 ? "int16" : "fp32";
+  description += " recurrent and attention matrices and ";
+  if (quantization.int8Output) {
+    description += "an int8";
+  } else if (quantization.vocabMajorOutput) {
+    description += "a vocabulary-major fp32";
+  } else {
+    description += "an fp32";
+  }
+  return description + " output layer";
+}
+
+}
+
 EncoderDecoderLoader::EncoderDecoderLoader(
   const std::string name,
   const YAML::Node& config)
   : Loader(name, config)
 {}
 
-void EncoderDecoderLoader::Load(const God&) {
+void EncoderDecoderLoader::Load(const God& god) {
   std::string path = Get<std::string>("path");
   std::string type = Get<std::string>("type");
+  mblas::QuantizationOptions quantization;
+  quantization.int8Output = god.Get<bool>("cpu-int8-output");
+  quantization.int16 = god.Get<bool>("cpu-int16");
+  // every batch is decoded with a filtered vocabulary, whose columns of the
+  // output layer are gathered from rows; the int8 one is stored that way
+  quantization.vocabMajorOutput = !quantization.int8Output
+      && !god.Get<std::vector<std::string>>("softmax-filter").empty();
 
   LOG(info)->info("Loading model {}", path);
   LOG(info)->info("Model type: {}", type);
-  if (type == "nematus2") {
-    nematusModels_.emplace_back(new Nematus::Weights(path, 0));
+  bool hugePages = god.Get<bool>("cpu-mmap-hugepages");
+  if (BinaryModel::IsBinary(path)) {
+    BinaryModel model(path, hugePages);
+    // every type but nematus2 is decoded as dl4mt
+    amunmt_UTIL_THROW_IF2((model.Type() == "nematus2") != (type == "nematus2"),
+                          path << " was converted as a " << model.Type() << " model, not " << type);
+    amunmt_UTIL_THROW_IF2(model.Quantization() != quantization,
+                          path << " holds " << Describe(model.Quantization())
+                          << ", the options ask for " << Describe(quantization)
+                          << "; convert it again with amun-convert");
+    LOG(info)->info("Native model format");
+    if (type == "nematus2") {
+      nematusModels_.emplace_back(new Nematus::Weights(model));
+    } else {
+      dl4mtModels_.emplace_back(new dl4mt::Weights(model));
+    }
   } else {
-    dl4mtModels_.emplace_back(new dl4mt::Weights(path, 0));
+    NpzConverter model(path, hugePages);
+    if (type == "nematus2") {
+      nematusModels_.emplace_back(new Nematus::Weights(model, 0, quantization));
+    } else {
+      dl4mtModels_.emplace_back(new dl4mt::Weights(model, 0, quantization));
+    }
+  }
+  if (quantization.int8Output) {
+    LOG(info)->info("Output layer quantized to int8");
+  }
+  if (quantization.int16) {
+    LOG(info)->info("Recurrent and attention matrices quantized to int16");
   }
 }
 
@@ -1,9 +1,14 @@
 #pragma once
 
+#include <numeric>
+
 #include "../mblas/matrix.h"
+#include "../mblas/quantized.h"
+#include "../mblas/top_k.h"
 #include "model.h"
 #include "gru.h"
 #include "common/god.h"
+#include "common/exception.h"
 
 namespace amunmt {
 namespace CPU {
@@ -19,12 +24,11 @@ class Decoder {
         {}
 
         void Lookup(mblas::Matrix& Rows, const std::vector<size_t>& ids) {
-          using namespace mblas;
-          std::vector<size_t> tids = ids;
-          for(auto&& id : tids)
-            if(id >= w_.E_.rows())
-              id = 1;
-          Rows = Assemble<byRow, Matrix>(w_.E_, tids);
+          Rows.resize(ids.size(), w_.E_.columns(), false);
+          for (size_t i = 0; i < ids.size(); ++i) {
+            size_t id = ids[i] < w_.E_.rows() ? ids[i] : 1;
+            blaze::row(Rows, i) = blaze::row(w_.E_, id);
+          }
         }
 
         size_t GetCols() {
@@ -48,15 +52,19 @@ class Decoder {
 
         void InitializeState(mblas::Matrix& State,
                              const mblas::Matrix& SourceContext,
-                             const size_t batchSize = 1) {
+                             const std::vector<size_t>& sentenceLengths) {
           using namespace mblas;
 
-          // Calculate mean of source context, rowwise
-          // Repeat mean batchSize times by broadcasting
-          Temp1_ = Mean<byRow, Matrix>(SourceContext);
+          // Calculate mean of source context, rowwise, separately for each
+          // sentence as the padded positions must not contribute
+          size_t batchSize = sentenceLengths.size();
+          size_t maxLength = SourceContext.rows() / batchSize;
           Temp2_.resize(batchSize, SourceContext.columns());
-          Temp2_ = 0.0f;
-          AddBiasVector<byRow>(Temp2_, Temp1_);
+          for (size_t b = 0; b < batchSize; ++b) {
+            Temp1_ = Mean<byRow, Matrix>(blaze::submatrix(SourceContext, b * maxLength, 0,
+                                                          sentenceLengths[b], SourceContext.columns()));
+            blaze::row(Temp2_, b) = blaze::row(Temp1_, 0);
+          }
 
           State = Temp2_ * w_.Wi_;
 
@@ -66,7 +74,7 @@ class Decoder {
           } else {
             AddBiasVector<byRow>(State, w_.Bi_);
           }
-          State = blaze::forEach(State, Tanh());
+          ApplyTanh(State);
         }
 
         void GetNextState(mblas::Matrix& NextState,
@@ -106,13 +114,11 @@ class Decoder {
       public:
         Attention(const Weights& model)
         : w_(model)
-        {
-          V_ = blaze::trans(blaze::row(w_.V_, 0));
-        }
+        {}
 
         void Init(const mblas::Matrix& SourceContext) {
           using namespace mblas;
-          SCU_ = SourceContext * w_.U_;
+          mblas::Multiply(SCU_, SourceContext, w_.U_, w_.Uq_);
           if (w_.Gamma_1_.rows()) {
             LayerNormalization(SCU_, w_.Gamma_1_);
           }
@@ -121,28 +127,52 @@ class Decoder {
 
         void GetAlignedSourceContext(mblas::Matrix& AlignedSourceContext,
                                      const mblas::Matrix& HiddenState,
-                                     const mblas::Matrix& SourceContext) {
+                                     const mblas::Matrix& SourceContext,
+                                     const std::vector<size_t>& sentenceLengths,
+                                     const std::vector<uint>& beamSizes) {
           using namespace mblas;
 
-          Temp2_ = HiddenState * w_.W_;
+          mblas::Multiply(Temp2_, HiddenState, w_.W_, w_.Wq_);
           if (w_.Gamma_2_.rows()) {
             LayerNormalization(Temp2_, w_.Gamma_2_);
           }
 
-          Temp1_ = Broadcast<Matrix>(Tanh(), SCU_, Temp2_);
-
-          A_.resize(Temp1_.rows(), 1);
-          blaze::column(A_, 0) = Temp1_ * V_;
-          size_t words = SourceContext.rows();
-          // batch size, for batching, divide by numer of sentences
-          size_t batchSize = HiddenState.rows();
-          Reshape(A_, batchSize, words); // due to broadcasting above
-
-          float bias = w_.C_(0,0);
-          blaze::forEach(A_, [=](float x) { return x + bias; });
-
-          mblas::SafeSoftmax(A_);
-          AlignedSourceContext = A_ * SourceContext;
+          size_t batchSize = sentenceLengths.size();
+          size_t maxLength = SourceContext.rows() / batchSize;
+          size_t totalRows = std::accumulate(beamSizes.begin(), beamSizes.end(), 0);
+          amunmt_UTIL_THROW_IF2(totalRows != HiddenState.rows(),
+                                "Beam sizes (" << totalRows << ") do not match hidden state rows ("
+                                << HiddenState.rows() << ")");
+
+          // attention is computed per sentence, hypotheses of sentence b
+          // occupy beamSizes[b] consecutive rows of the hidden state
+          A_.resize(HiddenState.rows(), maxLength);
+          A_ = 0.0f;
+          AlignedSourceContext.resize(HiddenState.rows(), SourceContext.columns());
+
+          // the scores are written straight into their rows of A_ and
+          // normalized there; the bias C_ would cancel out in the softmax
+          size_t dim = SCU_.columns();
+          size_t row = 0;
+          for (size_t b = 0; b < batchSize; ++b) {
+            size_t rows = beamSizes[b];
+            size_t words = sentenceLengths[b];
+            if (rows == 0) {
+              continue;
+            }
+
+            AttentionScores(&SCU_(b * maxLength, 0), SCU_.spacing(), words,
+                            &Temp2_(row, 0), Temp2_.spacing(), rows,
+                            &w_.V_(0, 0), dim, &A_(row, 0), A_.spacing());
+            for (size_t r = row; r < row + rows; ++r) {
+              mblas::SafeSoftmax(&A_(r, 0), words);
+            }
+
+            blaze::submatrix(AlignedSourceContext, row, 0, rows, SourceContext.columns())
+              = blaze::submatrix(A_, row, 0, rows, words)
+              * blaze::submatrix(SourceContext, b * maxLength, 0, words, SourceContext.columns());
+            row += rows;
+          }
         }
 
         void GetAttention(mblas::Matrix& Attention) {
@@ -157,10 +187,8 @@ class Decoder {
         const Weights& w_;
 
         mblas::Matrix SCU_;
-        mblas::Matrix Temp1_;
         mblas::Matrix Temp2_;
         mblas::Matrix A_;
-        mblas::ColumnVector V_;
     };
 
     //////////////////////////////////////////////////////////////
@@ -169,7 +197,9 @@ class Decoder {
       public:
         Softmax(const Weights& model)
         : w_(model),
-        filtered_(false)
+        filtered_(false),
+        greedy_(false),
+        topK_(0)
         {}
 
         void GetProbs(mblas::ArrayMatrix& Probs,
@@ -179,48 +209,109 @@ class Decoder {
           using namespace mblas;
 
 
-          T1_ = State * w_.W1_;
+          PackedGemm(State, w_.W1_, T1_);
           if (w_.Gamma_1_.rows()) {
             LayerNormalization(T1_, w_.Gamma_1_);
           }
           AddBiasVector<byRow>(T1_, w_.B1_);
 
-          T2_ = Embedding * w_.W2_;
+          PackedGemm(Embedding, w_.W2_, T2_);
           if (w_.Gamma_0_.rows()) {
             LayerNormalization(T2_, w_.Gamma_0_);
           }
           AddBiasVector<byRow>(T2_, w_.B2_);
 
-          T3_ = AlignedSourceContext * w_.W3_;
+          PackedGemm(AlignedSourceContext, w_.W3_, T3_);
           if (w_.Gamma_2_.rows()) {
             LayerNormalization(T3_, w_.Gamma_2_);
           }
           AddBiasVector<byRow>(T3_, w_.B3_);
 
-          auto t = blaze::forEach(T1_ + T2_ + T3_, Tanh());
-
-          if(!filtered_) {
-            Probs = t * w_.W4_;
-            AddBiasVector<byRow>(Probs, w_.B4_);
+          T1_ += T2_ + T3_;
+          ApplyTanh(T1_);
+          if (topK_) {
+            const Matrix& B4 = filtered_ ? FilteredB4_ : w_.B4_;
+            TopK_.Begin(T1_.rows(), B4.columns(), topK_, maskedColumn_);
+            if (!w_.W4q_.empty()) {
+              Int8GemmTopK(T1_, filtered_ ? FilteredW4q_ : w_.W4q_, B4, TopK_);
+            } else {
+              GemmTopK(T1_, filtered_ ? FilteredW4_ : w_.W4_, B4, TopK_);
+            }
+            TopK_.Finish(TopKWords_, TopKCosts_);
+            return;
+          }
+          if (!w_.W4q_.empty()) {
+            Int8Gemm(T1_, filtered_ ? FilteredW4q_ : w_.W4q_,
+                     filtered_ ? FilteredB4_ : w_.B4_, Probs);
           } else {
-            Probs = t * FilteredW4_;
-            AddBiasVector<byRow>(Probs, FilteredB4_);
+            PackedGemm(T1_, filtered_ ? FilteredW4_ : w_.W4_, Probs);
+            AddBiasVector<byRow>(Probs, filtered_ ? FilteredB4_ : w_.B4_);
           }
-          LogSoftmax(Probs);
+          if (greedy_) {
+            LogSoftmaxArgmax(Probs, maskedColumn_, BestWords_, BestCosts_);
+          } else {
+            LogSoftmax(Probs);
+          }
+        }
+
+        void SetGreedy(bool greedy, size_t maskedColumn) {
+          greedy_ = greedy;
+          maskedColumn_ = maskedColumn;
+        }
+
+        void GetBestWords(std::vector<size_t>& words, std::vector<float>& costs) const {
+          words = BestWords_;
+          costs = BestCosts_;
+        }
+
+        void SetTopK(size_t k, size_t maskedColumn) {
+          topK_ = k;
+          maskedColumn_ = maskedColumn;
+        }
+
+        // the vectors are swapped, not copied; the ones passed in are
+        // filled by the next step
+        bool GetTopK(std::vector<size_t>& words, std::vector<float>& costs) {
+          if (topK_ == 0) {
+            return false;
+          }
+          words.swap(TopKWords_);
+          costs.swap(TopKCosts_);
+          return true;
         }
 
         void Filter(const std::vector<size_t>& ids) {
           filtered_ = true;
           using namespace mblas;
-          FilteredW4_ = Assemble<byColumn, Matrix>(w_.W4_, ids);
-          FilteredB4_ = Assemble<byColumn, Matrix>(w_.B4_, ids);
+          if (!w_.W4q_.empty()) {
+            FilteredW4q_ = QuantizedMatrix8(w_.W4q_, ids);
+          } else {
+            amunmt_UTIL_THROW_IF2(w_.W4T_.rows() == 0,
+                                  "The output layer was not loaded for a filtered vocabulary");
+            FilteredW4_.AssignRows(w_.W4T_, ids);
+          }
+          Assemble<byColumn>(FilteredB4_, w_.B4_, ids);
         }
 
       private:
         const Weights& w_;
         bool filtered_;
 
-        mblas::Matrix FilteredW4_;
+        // greedy decoding only keeps the best word of each row
+        bool greedy_;
+        size_t maskedColumn_;
+        std::vector<size_t> BestWords_;
+        std::vector<float> BestCosts_;
+
+        // beam search of a single model only keeps the topK_ best words of
+        // each row, Probs is left alone
+        size_t topK_;
+        mblas::LogSoftmaxTopK TopK_;
+        std::vector<size_t> TopKWords_;
+        std::vector<float> TopKCosts_;
+
+        mblas::PackedMatrix FilteredW4_;
+        mblas::QuantizedMatrix8 FilteredW4q_;
         mblas::Matrix FilteredB4_;
 
         mblas::Matrix T1_;
@@ -240,9 +331,12 @@ class Decoder {
     void Decode(mblas::Matrix& NextState,
                   const mblas::Matrix& State,
                   const mblas::Matrix& Embeddings,
-                  const mblas::Matrix& SourceContext) {
+                  const mblas::Matrix& SourceContext,
+                  const std::vector<size_t>& sentenceLengths,
+                  const std::vector<uint>& beamSizes) {
       GetHiddenState(HiddenState_, State, Embeddings);
-      GetAlignedSourceContext(AlignedSourceContext_, HiddenState_, SourceContext);
+      GetAlignedSourceContext(AlignedSourceContext_, HiddenState_, SourceContext,
+                              sentenceLengths, beamSizes);
       GetNextState(NextState, HiddenState_, AlignedSourceContext_);
       GetProbs(NextState, Embeddings, AlignedSourceContext_);
     }
@@ -251,9 +345,12 @@ class Decoder {
                   const mblas::Matrix& State,
                   const mblas::Matrix& Embeddings,
                   const mblas::Matrix& SourceContext,
+                  const std::vector<size_t>& sentenceLengths,
+                  const std::vector<uint>& beamSizes,
                   int dim) {
       GetHiddenState(HiddenState_, State, Embeddings);
-      GetAlignedSourceContext(AlignedSourceContext_, HiddenState_, SourceContext);
+      GetAlignedSourceContext(AlignedSourceContext_, HiddenState_, SourceContext,
+                              sentenceLengths, beamSizes);
       GetNextState(NextState, HiddenState_, AlignedSourceContext_);
       GetProbs(NextState, Embeddings, AlignedSourceContext_);
     }
@@ -264,8 +361,8 @@ class Decoder {
 
     void EmptyState(mblas::Matrix& State,
                     const mblas::Matrix& SourceContext,
-                    size_t batchSize = 1) {
-    	rnn1_.InitializeState(State, SourceContext, batchSize);
+                    const std::vector<size_t>& sentenceLengths) {
+    	rnn1_.InitializeState(State, SourceContext, sentenceLengths);
     	attention_.Init(SourceContext);
     }
 
@@ -284,6 +381,22 @@ class Decoder {
       softmax_.Filter(ids);
     }
 
+    void SetGreedy(bool greedy, size_t maskedColumn) {
+      softmax_.SetGreedy(greedy, maskedColumn);
+    }
+
+    void GetBestWords(std::vector<size_t>& words, std::vector<float>& costs) const {
+      softmax_.GetBestWords(words, costs);
+    }
+
+    void SetTopK(size_t k, size_t maskedColumn) {
+      softmax_.SetTopK(k, maskedColumn);
+    }
+
+    bool GetTopK(std::vector<size_t>& words, std::vector<float>& costs) {
+      return softmax_.GetTopK(words, costs);
+    }
+
     void GetAttention(mblas::Matrix& attention) {
     	attention_.GetAttention(attention);
     }
@@ -306,8 +419,11 @@ class Decoder {
 
     void GetAlignedSourceContext(mblas::Matrix& AlignedSourceContext,
                                  const mblas::Matrix& HiddenState,
-                                 const mblas::Matrix& SourceContext) {
-    	attention_.GetAlignedSourceContext(AlignedSourceContext, HiddenState, SourceContext);
+                                 const mblas::Matrix& SourceContext,
+                                 const std::vector<size_t>& sentenceLengths,
+                                 const std::vector<uint>& beamSizes) {
+    	attention_.GetAlignedSourceContext(AlignedSourceContext, HiddenState, SourceContext,
+    	                                   sentenceLengths, beamSizes);
     }
 
     void GetNextState(mblas::Matrix& State,
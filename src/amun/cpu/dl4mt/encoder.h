@@ -1,10 +1,16 @@
 #pragma once
 
+#include <memory>
+
 #include "../mblas/matrix.h"
+#include "common/threadpool.h"
 #include "../dl4mt/model.h"
 #include "../dl4mt/gru.h"
 
 namespace amunmt {
+
+class Sentences;
+
 namespace CPU {
 namespace dl4mt {
 
@@ -19,14 +25,17 @@ class Encoder {
         : w_(model)
         {}
           
-        void Lookup(mblas::Matrix& Row, size_t i) {
-		  size_t len = w_.E_.columns();
-          if(i < w_.E_.rows())
-            Row = blaze::submatrix(w_.E_, i, 0, 1, len);
-          else
-            Row = blaze::submatrix(w_.E_, 1, 0, 1, len); // UNK
+        void Lookup(mblas::Matrix& Rows, const Words& words) {
+          using namespace mblas;
+          std::vector<size_t> knownWords(words.size(), 1);
+          for (size_t i = 0; i < words.size(); ++i) {
+            if (words[i] < w_.E_.rows()) {
+              knownWords[i] = words[i];
+            }
+          }
+          Rows = Assemble<byRow, Matrix>(w_.E_, knownWords);
         }
-      
+
         const Weights& w_;
       private:
     };
@@ -43,31 +52,43 @@ class Encoder {
 		  State_ = 0.0f;
         }
         
+        template <class MT>
         void GetNextState(mblas::Matrix& NextState,
                           const mblas::Matrix& State,
-                          const mblas::Matrix& Embd) {
-          gru_.GetNextState(NextState, State, Embd);
+                          const MT& Input) {
+          gru_.GetNextStateFromInput(NextState, State, Input);
         }
         
-        template <class It>
-        void Encode(It it, It end,
-                        mblas::Matrix& Context, bool invert) {
-          InitializeState();
-          
-          size_t n = std::distance(it, end);
-          size_t i = 0;
-          while(it != end) {
-            GetNextState(State_, State_, *it++);
-            
-			size_t len = gru_.GetStateLength();
-            if(invert)
-              blaze::submatrix(Context, n - i - 1, len, 1, len) = State_;
-            else
-			  blaze::submatrix(Context, i, 0, 1, len) = State_;
-            ++i;
+        // Embeddings holds one block of batchSize rows per timestep.
+        // The input projections of all timesteps are computed with a
+        // single GEMM, only the recurrent part is done step by step.
+        void Encode(const mblas::Matrix& Embeddings,
+                mblas::Matrix& Context,
+                const std::vector<size_t>& sentenceLengths,
+                bool invert) {
+          size_t batchSize = sentenceLengths.size();
+          InitializeState(batchSize);
+
+          gru_.GetInputProjection(Input_, Embeddings);
+
+          size_t n = Embeddings.rows() / batchSize;
+          size_t len = gru_.GetStateLength();
+          for (size_t i = 0; i < n; ++i) {
+            size_t pos = invert ? n - i - 1 : i;
+            GetNextState(State_, State_,
+                         blaze::submatrix(Input_, pos * batchSize, 0, batchSize, Input_.columns()));
+
+            for (size_t b = 0; b < batchSize; ++b) {
+              if (pos >= sentenceLengths[b]) {
+                // padding, the backward state must stay empty until the sentence starts
+                blaze::row(State_, b) = 0.0f;
+              }
+              blaze::submatrix(Context, b * n + pos, invert ? len : 0, 1, len)
+                = blaze::submatrix(State_, b, 0, 1, len);
+            }
           }
         }
-        
+
         size_t GetStateLength() const {
           return gru_.GetStateLength();
         }
@@ -77,23 +98,33 @@ class Encoder {
         const GRU<Weights> gru_;
         
         mblas::Matrix State_;
+        mblas::Matrix Input_;
     };
     
   /////////////////////////////////////////////////////////////////
   public:
-    Encoder(const Weights& model)
+    Encoder(const Weights& model, bool parallel = false)
     : embeddings_(model.encEmbeddings_),
       forwardRnn_(model.encForwardGRU_),
-      backwardRnn_(model.encBackwardGRU_)
+      backwardRnn_(model.encBackwardGRU_),
+      backwardThread_(parallel ? new ThreadPool(1) : nullptr)
     {}
     
-    void Encode(const std::vector<size_t>& words,
-                    mblas::Matrix& context);
-    
+    void Encode(const Sentences& sources, size_t tab,
+                mblas::Matrix& context,
+                std::vector<size_t>& sentenceLengths);
+
   private:
     Embeddings<Weights::Embeddings> embeddings_;
     RNN<Weights::GRU> forwardRnn_;
     RNN<Weights::GRU> backwardRnn_;
+
+    // runs the backward direction while the calling thread runs the forward
+    // one, started once and kept for all sentences; null if not parallel
+    std::unique_ptr<ThreadPool> backwardThread_;
+
+    // reusing memory
+    mblas::Matrix embeddedWords_;
 };
 
 }
@@ -21,58 +21,114 @@ EncoderDecoder::EncoderDecoder(const God &god,
                                const dl4mt::Weights& model)
   : CPUEncoderDecoderBase(god, name, config, tab),
     model_(model),
-    encoder_(new dl4mt::Encoder(model_)),
+    encoder_(new dl4mt::Encoder(model_, god.Get<bool>("cpu-parallel-encoder"))),
     decoder_(new dl4mt::Decoder(model_))
 {}
 
 
-void EncoderDecoder::Decode(const State& in, State& out, const std::vector<uint>&) {
+void EncoderDecoder::Decode(const State& in, State& out, const std::vector<uint>& beamSizes) {
   const EDState& edIn = in.get<EDState>();
   EDState& edOut = out.get<EDState>();
 
   decoder_->Decode(edOut.GetStates(), edIn.GetStates(),
-                   edIn.GetEmbeddings(), SourceContext_);
+                   edIn.GetEmbeddings(), SourceContext_,
+                   SentenceLengths_, beamSizes);
 }
 
-void EncoderDecoder::Decode(const State& in, State& out, const std::vector<uint>&, int dim) {
+void EncoderDecoder::Decode(const State& in, State& out, const std::vector<uint>& beamSizes, int dim) {
   const EDState& edIn = in.get<EDState>();
   EDState& edOut = out.get<EDState>();
 
   decoder_->Decode(edOut.GetStates(), edIn.GetStates(),
-                   edIn.GetEmbeddings(), SourceContext_);
+                   edIn.GetEmbeddings(), SourceContext_,
+                   SentenceLengths_, beamSizes);
 }
 
 
 void EncoderDecoder::BeginSentenceState(State& state, size_t batchSize) {
   EDState& edState = state.get<EDState>();
-  decoder_->EmptyState(edState.GetStates(), SourceContext_, batchSize);
+  decoder_->EmptyState(edState.GetStates(), SourceContext_, SentenceLengths_);
   decoder_->EmptyEmbedding(edState.GetEmbeddings(), batchSize);
 }
 
 
 void EncoderDecoder::Encode(const Sentences& sources) {
-  encoder_->Encode(sources.at(0)->GetWords(tab_), SourceContext_);
+  encoder_->Encode(sources, tab_, SourceContext_, SentenceLengths_);
 }
 
 
 void EncoderDecoder::AssembleBeamState(const State& in,
                                        const Beam& beam,
                                        State& out) {
-  std::vector<size_t> beamWords;
-  std::vector<size_t> beamStateIds;
+  beamWords_.clear();
+  beamStateIds_.clear();
   for(auto h : beam) {
-      beamWords.push_back(h->GetWord());
-      beamStateIds.push_back(h->GetPrevStateIndex());
+      beamWords_.push_back(h->GetWord());
+      beamStateIds_.push_back(h->GetPrevStateIndex());
   }
 
   const EDState& edIn = in.get<EDState>();
   EDState& edOut = out.get<EDState>();
 
-  edOut.GetStates() = mblas::Assemble<mblas::byRow, mblas::Matrix>(edIn.GetStates(), beamStateIds);
+  mblas::Assemble<mblas::byRow>(edOut.GetStates(), edIn.GetStates(), beamStateIds_);
+  decoder_->Lookup(edOut.GetEmbeddings(), beamWords_);
+}
+
+
+void EncoderDecoder::AssembleFrontierState(const std::vector<const State*>& ins,
+                                           const Beam& beam,
+                                           State& out) {
+  EDState& edOut = out.get<EDState>();
+  mblas::Matrix& States = edOut.GetStates();
+
+  std::vector<size_t> beamWords(beam.size());
+  States.resize(beam.size(), ins[0]->get<EDState>().GetStates().columns());
+  for (size_t i = 0; i < beam.size(); ++i) {
+    blaze::row(States, i) = blaze::row(ins[i]->get<EDState>().GetStates(), beam[i]->GetPrevStateIndex());
+    beamWords[i] = beam[i]->GetWord();
+  }
   decoder_->Lookup(edOut.GetEmbeddings(), beamWords);
 }
 
 
+void EncoderDecoder::SetGreedy(bool greedy, bool forbidUNK) {
+  decoder_->SetGreedy(greedy, forbidUNK ? UNK_ID : GetVocabSize());
+}
+
+
+void EncoderDecoder::GetBestWords(std::vector<size_t>& words, std::vector<float>& costs) const {
+  decoder_->GetBestWords(words, costs);
+}
+
+
+void EncoderDecoder::SetTopK(size_t k, bool forbidUNK) {
+  decoder_->SetTopK(k, forbidUNK ? UNK_ID : GetVocabSize());
+}
+
+
+bool EncoderDecoder::GetTopK(std::vector<size_t>& words, std::vector<float>& costs) {
+  return decoder_->GetTopK(words, costs);
+}
+
+
+void EncoderDecoder::AssembleGreedyState(State& in,
+                                         const std::vector<size_t>& words,
+                                         const std::vector<size_t>& rows,
+                                         State& out) {
+  EDState& edIn = in.get<EDState>();
+  EDState& edOut = out.get<EDState>();
+
+  // rows only drop out when a sentence is finished, otherwise every state
+  // is continued where it is
+  if (rows.size() == edIn.GetStates().rows()) {
+    edOut.GetStates().swap(edIn.GetStates());
+  } else {
+    mblas::Assemble<mblas::byRow>(edOut.GetStates(), edIn.GetStates(), rows);
+  }
+  decoder_->Lookup(edOut.GetEmbeddings(), words);
+}
+
+
 void EncoderDecoder::GetAttention(mblas::Matrix& Attention) {
   decoder_->GetAttention(Attention);
 }
@@ -49,6 +49,10 @@ class EncoderDecoder : public CPUEncoderDecoderBase {
                                    const Beam& beam,
                                    State& out);
 
+    virtual void AssembleFrontierState(const std::vector<const State*>& ins,
+                                       const Beam& beam,
+                                       State& out);
+
     void GetAttention(mblas::Matrix& Attention);
     mblas::Matrix& GetAttention();
 
@@ -58,10 +62,25 @@ class EncoderDecoder : public CPUEncoderDecoderBase {
 
     void Filter(const std::vector<size_t>& filterIds);
 
+    virtual void SetGreedy(bool greedy, bool forbidUNK);
+
+    virtual void GetBestWords(std::vector<size_t>& words, std::vector<float>& costs) const;
+
+    virtual void AssembleGreedyState(State& in, const std::vector<size_t>& words,
+                                     const std::vector<size_t>& rows, State& out);
+
+    virtual void SetTopK(size_t k, bool forbidUNK);
+
+    virtual bool GetTopK(std::vector<size_t>& words, std::vector<float>& costs);
+
   protected:
     const Weights& model_;
     std::unique_ptr<Encoder> encoder_;
     std::unique_ptr<Decoder> decoder_;
+
+    // reused by AssembleBeamState
+    std::vector<size_t> beamWords_;
+    std::vector<size_t> beamStateIds_;
 };
 
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include "cpu/mblas/matrix.h"
+#include "cpu/mblas/packed.h"
+#include "cpu/mblas/quantized.h"
 
 namespace amunmt {
 namespace CPU {
@@ -9,65 +11,61 @@ template <class Weights>
 class GRU {
   public:
     GRU(const Weights& model)
-    : w_(model) {
-      using namespace mblas;
-      WWx_ = Concat<byColumn, Matrix>(w_.W_, w_.Wx_);
-      UUx_ = Concat<byColumn, Matrix>(w_.U_, w_.Ux_);
-    }
+    : w_(model) {}
 
     void GetNextState(mblas::Matrix& NextState,
                       const mblas::Matrix& State,
                       const mblas::Matrix& Context) const {
-      RUH_ = Context * WWx_;
+      GetInputProjection(RUH_, Context);
+      GetNextStateFromInput(NextState, State, RUH_);
+    }
+
+    // The input part does not depend on the state, the encoder computes
+    // it for all timesteps at once and passes the rows of each step to
+    // GetNextStateFromInput
+    void GetInputProjection(mblas::Matrix& RUH,
+                            const mblas::Matrix& Context) const {
+      mblas::Multiply(RUH, Context, w_.WWx_, w_.WWxq_);
       if (w_.Gamma_1_.rows()) {
-        LayerNormalization(RUH_, w_.Gamma_1_);
+        LayerNormalization(RUH, w_.Gamma_1_);
       }
+    }
 
-      Temp_ = State * UUx_;
+    template <class MT>
+    void GetNextStateFromInput(mblas::Matrix& NextState,
+                               const mblas::Matrix& State,
+                               const MT& RUH) const {
+      mblas::Multiply(Temp_, State, w_.UUx_, w_.UUxq_);
       if (w_.Gamma_2_.rows()) {
         LayerNormalization(Temp_, w_.Gamma_2_);
       }
 
       // @TODO: once broadcasting is available
       // implement this using blaze idioms
-      ElementwiseOps(NextState, State);
+      ElementwiseOps(NextState, State, RUH);
     }
 
+    template <class MT>
     void ElementwiseOps(mblas::Matrix& NextState,
-                        const mblas::Matrix& State) const {
-
-      using namespace mblas;
-      using namespace blaze;
+                        const mblas::Matrix& State,
+                        const MT& RUH) const {
 
       const size_t rowNo = State.rows();
       const size_t colNo = State.columns();
       NextState.resize(rowNo, colNo);
 
-      for(int j = 0; j < rowNo; ++j) {
-        auto rowOut = row(NextState, j);
-        auto rowState = row(State, j);
-
-        auto rowRuh = row(RUH_, j);
-        auto rowT   = row(Temp_, j);
-
-        auto rowH   = subvector(rowRuh, 2 * colNo, colNo);
-        auto rowT2  = subvector(rowT, 2 * colNo, colNo);
-
-        for(int i = 0; i < colNo; ++i) {
-          float ev1 = expapprox(-(rowRuh[i] + w_.B_(0, i) + rowT[i]));
-          float r = 1.0 / (1.0 + ev1);
-
-          int k = i + colNo;
-          float ev2 = expapprox(-(rowRuh[k] + w_.B_(0, k) + rowT[k]));
-          float u = 1.0 / (1.0 + ev2);
-
-          float hv = rowH[i] + w_.Bx1_(0, i);
-          float t2v = rowT2[i] + w_.Bx2_(0, i);
-          hv = tanhapprox(hv + r * t2v);
-          rowOut[i] = (1.0 - u) * hv + u * rowState[i];
-        }
+      mblas::GRUGates gates;
+      gates.ruBias = &w_.B_(0, 0);
+      gates.hInputBias = &w_.Bx1_(0, 0);
+      gates.hStateBias = &w_.Bx2_(0, 0);
+
+      for (size_t j = 0; j < rowNo; ++j) {
+        gates.ruInput = &RUH(j, 0);
+        gates.hInput = gates.ruInput + 2 * colNo;
+        gates.ruState = &Temp_(j, 0);
+        gates.hState = gates.ruState + 2 * colNo;
+        mblas::GRUStep(gates, &State(j, 0), &NextState(j, 0), colNo);
       }
-
     }
 
     size_t GetStateLength() const {
@@ -78,8 +76,6 @@ class GRU {
   private:
     // Model matrices
     const Weights& w_;
-    mutable mblas::Matrix WWx_;
-    mutable mblas::Matrix UUx_;
 
     // reused to avoid allocation
     mutable mblas::Matrix RUH_;
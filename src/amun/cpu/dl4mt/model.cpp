@@ -1,98 +1,193 @@
 #include "model.h"
 
+#include "cpu/weights_source.h"
+
 using namespace std;
 
 namespace amunmt {
 namespace CPU {
 namespace dl4mt {
 
-Weights::Embeddings::Embeddings(const NpzConverter& model, const std::string &key)
-  : E_(model[key])
-{}
+namespace {
+
+// hidden x vocabulary, or transposed; tied to the target embeddings in
+// models without ff_logit_W
+std::vector<std::pair<std::string, bool>> OutputLayer(bool transposed) {
+  return {std::make_pair(std::string("ff_logit_W"), transposed),
+          std::make_pair(std::string("Wemb_dec"), !transposed)};
+}
+
+}
 
-Weights::Embeddings::Embeddings(const NpzConverter& model, const std::vector<std::pair<std::string, bool>> keys)
-  : E_(model.getFirstOfMany(keys))
+template <class Model>
+Weights::Embeddings::Embeddings(const Model& model, const std::string& name,
+                                const std::vector<std::pair<std::string, bool>>& keys)
+  : E_(model.View(name + ".E", [&](const NpzConverter& npz) { return npz.View(keys); }))
 {}
 
-Weights::GRU::GRU(const NpzConverter& model, const std::vector<std::string> &keys)
-  : W_(model[keys.at(0)]),
-    B_(model(keys.at(1), true)),
-    U_(model[keys.at(2)]),
-    Wx_(model[keys.at(3)]),
-    Bx1_(model(keys.at(4), true)),
+template <class Model>
+Weights::GRU::GRU(const Model& model, const std::string& name, const std::vector<std::string>& keys)
+  : W_(model.Matrix(name + ".W", keys.at(0))),
+    B_(model.Matrix(name + ".B", keys.at(1), true)),
+    U_(model.Matrix(name + ".U", keys.at(2))),
+    Wx_(model.Matrix(name + ".Wx", keys.at(3))),
+    Bx1_(model.Matrix(name + ".Bx1", keys.at(4), true)),
     Bx2_(Bx1_.rows(), Bx1_.columns()),
-    Ux_(model[keys.at(5)]),
-    Gamma_1_(model[keys.at(6)]),
-    Gamma_2_(model[keys.at(7)])
+    Ux_(model.Matrix(name + ".Ux", keys.at(5))),
+    Gamma_1_(model.Matrix(name + ".Gamma_1", keys.at(6))),
+    Gamma_2_(model.Matrix(name + ".Gamma_2", keys.at(7))),
+    WWx_(model.Packed(name + ".WWx", [&](const NpzConverter&) {
+      return model.Quantization().int16 ? mblas::PackedMatrix() : mblas::PackedMatrix(W_, Wx_);
+    })),
+    UUx_(model.Packed(name + ".UUx", [&](const NpzConverter&) {
+      return model.Quantization().int16 ? mblas::PackedMatrix() : mblas::PackedMatrix(U_, Ux_);
+    })),
+    WWxq_(model.Quantized16(name + ".WWxq", [&](const NpzConverter&) {
+      return model.Quantization().int16 ? mblas::QuantizedMatrix16(W_, Wx_) : mblas::QuantizedMatrix16();
+    })),
+    UUxq_(model.Quantized16(name + ".UUxq", [&](const NpzConverter&) {
+      return model.Quantization().int16 ? mblas::QuantizedMatrix16(U_, Ux_) : mblas::QuantizedMatrix16();
+    }))
 {
     const_cast<mblas::Matrix&>(Bx2_) = 0.0f;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 
-Weights::DecInit::DecInit(const NpzConverter& model)
-  : Wi_(model["ff_state_W"]),
-    Bi_(model("ff_state_b", true)),
-    Gamma_(model["ff_state_gamma"])
+template <class Model>
+Weights::DecInit::DecInit(const Model& model, const std::string& name)
+  : Wi_(model.Matrix(name + ".Wi", "ff_state_W")),
+    Bi_(model.Matrix(name + ".Bi", "ff_state_b", true)),
+    Gamma_(model.Matrix(name + ".Gamma", "ff_state_gamma"))
 {}
 
-Weights::DecGRU2::DecGRU2(const NpzConverter& model)
-: W_(model["decoder_Wc"]),
-  B_(model("decoder_b_nl", true)),
-  U_(model["decoder_U_nl"]),
-  Wx_(model["decoder_Wcx"]),
-  Bx2_(model("decoder_bx_nl", true)),
+template <class Model>
+Weights::DecGRU2::DecGRU2(const Model& model, const std::string& name)
+: W_(model.Matrix(name + ".W", "decoder_Wc")),
+  B_(model.Matrix(name + ".B", "decoder_b_nl", true)),
+  U_(model.Matrix(name + ".U", "decoder_U_nl")),
+  Wx_(model.Matrix(name + ".Wx", "decoder_Wcx")),
+  Bx2_(model.Matrix(name + ".Bx2", "decoder_bx_nl", true)),
   Bx1_(Bx2_.rows(), Bx2_.columns()),
-  Ux_(model["decoder_Ux_nl"]),
-  Gamma_1_(model["decoder_cell2_gamma1"]),
-  Gamma_2_(model["decoder_cell2_gamma2"])
+  Ux_(model.Matrix(name + ".Ux", "decoder_Ux_nl")),
+  Gamma_1_(model.Matrix(name + ".Gamma_1", "decoder_cell2_gamma1")),
+  Gamma_2_(model.Matrix(name + ".Gamma_2", "decoder_cell2_gamma2")),
+  WWx_(model.Packed(name + ".WWx", [&](const NpzConverter&) {
+    return model.Quantization().int16 ? mblas::PackedMatrix() : mblas::PackedMatrix(W_, Wx_);
+  })),
+  UUx_(model.Packed(name + ".UUx", [&](const NpzConverter&) {
+    return model.Quantization().int16 ? mblas::PackedMatrix() : mblas::PackedMatrix(U_, Ux_);
+  })),
+  WWxq_(model.Quantized16(name + ".WWxq", [&](const NpzConverter&) {
+    return model.Quantization().int16 ? mblas::QuantizedMatrix16(W_, Wx_) : mblas::QuantizedMatrix16();
+  })),
+  UUxq_(model.Quantized16(name + ".UUxq", [&](const NpzConverter&) {
+    return model.Quantization().int16 ? mblas::QuantizedMatrix16(U_, Ux_) : mblas::QuantizedMatrix16();
+  }))
 {
     const_cast<mblas::Matrix&>(Bx1_) = 0.0f;
 }
 
-Weights::DecAttention::DecAttention(const NpzConverter& model)
-: V_(model("decoder_U_att", true)),
-  W_(model["decoder_W_comb_att"]),
-  B_(model("decoder_b_att", true)),
-  U_(model["decoder_Wc_att"]),
-  C_(model["decoder_c_tt"]), // scalar?
-  Gamma_1_(model["decoder_att_gamma1"]),
-  Gamma_2_(model["decoder_att_gamma2"])
+template <class Model>
+Weights::DecAttention::DecAttention(const Model& model, const std::string& name)
+: V_(model.Matrix(name + ".V", "decoder_U_att", true)),
+  W_(model.Packed(name + ".W", [&](const NpzConverter& npz) {
+    return model.Quantization().int16 ? mblas::PackedMatrix()
+                                      : mblas::PackedMatrix(npz["decoder_W_comb_att"]);
+  })),
+  B_(model.Matrix(name + ".B", "decoder_b_att", true)),
+  U_(model.Packed(name + ".U", [&](const NpzConverter& npz) {
+    return model.Quantization().int16 ? mblas::PackedMatrix()
+                                      : mblas::PackedMatrix(npz["decoder_Wc_att"]);
+  })),
+  C_(model.Matrix(name + ".C", "decoder_c_tt")), // scalar?
+  Gamma_1_(model.Matrix(name + ".Gamma_1", "decoder_att_gamma1")),
+  Gamma_2_(model.Matrix(name + ".Gamma_2", "decoder_att_gamma2")),
+  Wq_(model.Quantized16(name + ".Wq", [&](const NpzConverter& npz) {
+    return model.Quantization().int16 ? mblas::QuantizedMatrix16(npz["decoder_W_comb_att"])
+                                      : mblas::QuantizedMatrix16();
+  })),
+  Uq_(model.Quantized16(name + ".Uq", [&](const NpzConverter& npz) {
+    return model.Quantization().int16 ? mblas::QuantizedMatrix16(npz["decoder_Wc_att"])
+                                      : mblas::QuantizedMatrix16();
+  }))
 {}
 
-Weights::DecSoftmax::DecSoftmax(const NpzConverter& model)
-: W1_(model["ff_logit_lstm_W"]),
-  B1_(model("ff_logit_lstm_b", true)),
-  W2_(model["ff_logit_prev_W"]),
-  B2_(model("ff_logit_prev_b", true)),
-  W3_(model["ff_logit_ctx_W"]),
-  B3_(model("ff_logit_ctx_b", true)),
-  W4_(model.getFirstOfMany({std::pair<std::string, bool>(std::string("ff_logit_W"), false),
-             std::make_pair(std::string("Wemb_dec"), true)})),
-  B4_(model("ff_logit_b", true)),
-  Gamma_0_(model["ff_logit_l1_gamma0"]),
-  Gamma_1_(model["ff_logit_l1_gamma1"]),
-  Gamma_2_(model["ff_logit_l1_gamma2"])
+template <class Model>
+Weights::DecSoftmax::DecSoftmax(const Model& model, const std::string& name)
+: W1_(model.Packed(name + ".W1", [](const NpzConverter& npz) {
+    return mblas::PackedMatrix(npz["ff_logit_lstm_W"]);
+  })),
+  B1_(model.Matrix(name + ".B1", "ff_logit_lstm_b", true)),
+  W2_(model.Packed(name + ".W2", [](const NpzConverter& npz) {
+    return mblas::PackedMatrix(npz["ff_logit_prev_W"]);
+  })),
+  B2_(model.Matrix(name + ".B2", "ff_logit_prev_b", true)),
+  W3_(model.Packed(name + ".W3", [](const NpzConverter& npz) {
+    return mblas::PackedMatrix(npz["ff_logit_ctx_W"]);
+  })),
+  B3_(model.Matrix(name + ".B3", "ff_logit_ctx_b", true)),
+  W4_(model.Packed(name + ".W4", [&](const NpzConverter& npz) {
+    const mblas::QuantizationOptions& quantization = model.Quantization();
+    return quantization.vocabMajorOutput || quantization.int8Output ? mblas::PackedMatrix() :
+        mblas::PackedMatrix(npz.getFirstOfMany(OutputLayer(false)));
+  })),
+  W4T_(model.View(name + ".W4T", [&](const NpzConverter& npz) {
+    return model.Quantization().vocabMajorOutput ? npz.View(OutputLayer(true)) : mblas::MatrixView();
+  })),
+  B4_(model.Matrix(name + ".B4", "ff_logit_b", true)),
+  W4q_(model.Quantized8(name + ".W4q", [&](const NpzConverter& npz) {
+    return model.Quantization().int8Output
+        ? mblas::QuantizedMatrix8(npz.getFirstOfMany(OutputLayer(false)))
+        : mblas::QuantizedMatrix8();
+  })),
+  Gamma_0_(model.Matrix(name + ".Gamma_0", "ff_logit_l1_gamma0")),
+  Gamma_1_(model.Matrix(name + ".Gamma_1", "ff_logit_l1_gamma1")),
+  Gamma_2_(model.Matrix(name + ".Gamma_2", "ff_logit_l1_gamma2"))
 {}
 
 //////////////////////////////////////////////////////////////////////////////
 
-Weights::Weights(const NpzConverter& model, size_t)
-: encEmbeddings_(model, "Wemb"),
-  encForwardGRU_(model, {"encoder_W", "encoder_b", "encoder_U", "encoder_Wx", "encoder_bx",
-                         "encoder_Ux", "encoder_gamma1", "encoder_gamma2"}),
-  encBackwardGRU_(model, {"encoder_r_W", "encoder_r_b", "encoder_r_U", "encoder_r_Wx",
-                          "encoder_r_bx", "encoder_r_Ux", "encoder_r_gamma1", "encoder_r_gamma2"}),
-  decEmbeddings_(model, std::vector<std::pair<std::string, bool>>({std::make_pair(std::string("Wemb_dec"), false),
-                         std::make_pair(std::string("Wemb"), false)})),
-  decInit_(model),
-  decGru1_(model, {"decoder_W", "decoder_b", "decoder_U", "decoder_Wx", "decoder_bx", "decoder_Ux",
-                   "decoder_cell1_gamma1", "decoder_cell1_gamma2"}),
-  decGru2_(model),
-  decAttention_(model),
-  decSoftmax_(model)
+Weights::Weights(const NpzConverter& model, size_t, const mblas::QuantizationOptions& quantization)
+  : Weights(NpzSource(model, quantization))
 {}
 
+Weights::Weights(const BinaryModel& model, size_t)
+  : Weights(BinarySource(model))
+{}
+
+template <class Model>
+Weights::Weights(const Model& model)
+: encEmbeddings_(model, "encEmbeddings", {std::make_pair(std::string("Wemb"), false)}),
+  decEmbeddings_(model, "decEmbeddings", {std::make_pair(std::string("Wemb_dec"), false),
+                                          std::make_pair(std::string("Wemb"), false)}),
+  encForwardGRU_(model, "encForwardGRU",
+                 {"encoder_W", "encoder_b", "encoder_U", "encoder_Wx", "encoder_bx",
+                  "encoder_Ux", "encoder_gamma1", "encoder_gamma2"}),
+  encBackwardGRU_(model, "encBackwardGRU",
+                  {"encoder_r_W", "encoder_r_b", "encoder_r_U", "encoder_r_Wx",
+                   "encoder_r_bx", "encoder_r_Ux", "encoder_r_gamma1", "encoder_r_gamma2"}),
+  decInit_(model, "decInit"),
+  decGru1_(model, "decGru1",
+           {"decoder_W", "decoder_b", "decoder_U", "decoder_Wx", "decoder_bx", "decoder_Ux",
+            "decoder_cell1_gamma1", "decoder_cell1_gamma2"}),
+  decGru2_(model, "decGru2"),
+  decAttention_(model, "decAttention"),
+  decSoftmax_(model, "decSoftmax")
+{}
+
+void Weights::Save(BinaryModelWriter& writer) const {
+  writer.Add("encEmbeddings", encEmbeddings_);
+  writer.Add("decEmbeddings", decEmbeddings_);
+  writer.Add("encForwardGRU", encForwardGRU_);
+  writer.Add("encBackwardGRU", encBackwardGRU_);
+  writer.Add("decInit", decInit_);
+  writer.Add("decGru1", decGru1_);
+  writer.Add("decGru2", decGru2_);
+  writer.Add("decAttention", decAttention_);
+  writer.Add("decSoftmax", decSoftmax_);
+}
+
 }  // namespace dl4mt
 }  // namespace cpu
 }  // namespace amunmt
@@ -5,7 +5,10 @@
 #include <string>
 
 #include "cpu/npz_converter.h"
+#include "cpu/binary_model.h"
 #include "cpu/mblas/matrix.h"
+#include "cpu/mblas/packed.h"
+#include "cpu/mblas/quantized.h"
 
 namespace amunmt {
 namespace CPU {
@@ -16,14 +19,41 @@ struct Weights {
   //////////////////////////////////////////////////////////////////////////////
 
   struct Embeddings {
-    Embeddings(const NpzConverter& model, const std::string &key);
-    Embeddings(const NpzConverter& model, const std::vector<std::pair<std::string, bool>> keys);
-
-    const mblas::Matrix E_;
+    template <class Model>
+    Embeddings(const Model& model, const std::string& name,
+               const std::vector<std::pair<std::string, bool>>& keys);
+
+    // the members by name, for the native model format
+    template <class F>
+    void Visit(F&& f) const {
+      f("E", E_);
+    }
+
+    // in the mapped model file
+    const mblas::MatrixView E_;
   };
 
   struct GRU {
-	GRU(const NpzConverter& model, const std::vector<std::string> &keys);
+    template <class Model>
+    GRU(const Model& model, const std::string& name, const std::vector<std::string>& keys);
+
+    // the members by name, for the native model format
+    template <class F>
+    void Visit(F&& f) const {
+      f("W", W_);
+      f("B", B_);
+      f("U", U_);
+      f("Wx", Wx_);
+      f("Bx1", Bx1_);
+      f("Bx2", Bx2_);
+      f("Ux", Ux_);
+      f("Gamma_1", Gamma_1_);
+      f("Gamma_2", Gamma_2_);
+      f("WWx", WWx_);
+      f("UUx", UUx_);
+      f("WWxq", WWxq_);
+      f("UUxq", UUxq_);
+    }
 
     const mblas::Matrix W_;
     const mblas::Matrix B_;
@@ -34,12 +64,28 @@ struct Weights {
     const mblas::Matrix Ux_;
     const mblas::Matrix Gamma_1_;
     const mblas::Matrix Gamma_2_;
+
+    // [W Wx] and [U Ux], shared by the GRUs of all threads; the packed ones
+    // are empty with --cpu-int16, the quantized ones without
+    const mblas::PackedMatrix WWx_;
+    const mblas::PackedMatrix UUx_;
+    const mblas::QuantizedMatrix16 WWxq_;
+    const mblas::QuantizedMatrix16 UUxq_;
   };
 
   //////////////////////////////////////////////////////////////////////////////
 
   struct DecInit {
-    DecInit(const NpzConverter& model);
+    template <class Model>
+    DecInit(const Model& model, const std::string& name);
+
+    // the members by name, for the native model format
+    template <class F>
+    void Visit(F&& f) const {
+      f("Wi", Wi_);
+      f("Bi", Bi_);
+      f("Gamma", Gamma_);
+    }
 
     const mblas::Matrix Wi_;
     const mblas::Matrix Bi_;
@@ -47,7 +93,26 @@ struct Weights {
   };
 
   struct DecGRU2 {
-    DecGRU2(const NpzConverter& model);
+    template <class Model>
+    DecGRU2(const Model& model, const std::string& name);
+
+    // the members by name, for the native model format
+    template <class F>
+    void Visit(F&& f) const {
+      f("W", W_);
+      f("B", B_);
+      f("U", U_);
+      f("Wx", Wx_);
+      f("Bx1", Bx1_);
+      f("Bx2", Bx2_);
+      f("Ux", Ux_);
+      f("Gamma_1", Gamma_1_);
+      f("Gamma_2", Gamma_2_);
+      f("WWx", WWx_);
+      f("UUx", UUx_);
+      f("WWxq", WWxq_);
+      f("UUxq", UUxq_);
+    }
 
     const mblas::Matrix W_;
     const mblas::Matrix B_;
@@ -58,31 +123,84 @@ struct Weights {
     const mblas::Matrix Ux_;
     const mblas::Matrix Gamma_1_;
     const mblas::Matrix Gamma_2_;
+
+    // [W Wx] and [U Ux], shared by the GRUs of all threads; the packed ones
+    // are empty with --cpu-int16, the quantized ones without
+    const mblas::PackedMatrix WWx_;
+    const mblas::PackedMatrix UUx_;
+    const mblas::QuantizedMatrix16 WWxq_;
+    const mblas::QuantizedMatrix16 UUxq_;
   };
 
   struct DecAttention {
-    DecAttention(const NpzConverter& model);
+    template <class Model>
+    DecAttention(const Model& model, const std::string& name);
+
+    // the members by name, for the native model format
+    template <class F>
+    void Visit(F&& f) const {
+      f("V", V_);
+      f("W", W_);
+      f("B", B_);
+      f("U", U_);
+      f("C", C_);
+      f("Gamma_1", Gamma_1_);
+      f("Gamma_2", Gamma_2_);
+      f("Wq", Wq_);
+      f("Uq", Uq_);
+    }
 
     const mblas::Matrix V_;
-    const mblas::Matrix W_;
+    // W_ and U_ are empty with --cpu-int16
+    const mblas::PackedMatrix W_;
     const mblas::Matrix B_;
-    const mblas::Matrix U_;
+    const mblas::PackedMatrix U_;
     const mblas::Matrix C_;
     const mblas::Matrix Gamma_1_;
     const mblas::Matrix Gamma_2_;
+
+    // only prepared for --cpu-int16, empty otherwise
+    const mblas::QuantizedMatrix16 Wq_;
+    const mblas::QuantizedMatrix16 Uq_;
   };
 
   struct DecSoftmax {
-    DecSoftmax(const NpzConverter& model);
-
-    const mblas::Matrix W1_;
+    template <class Model>
+    DecSoftmax(const Model& model, const std::string& name);
+
+    // the members by name, for the native model format
+    template <class F>
+    void Visit(F&& f) const {
+      f("W1", W1_);
+      f("B1", B1_);
+      f("W2", W2_);
+      f("B2", B2_);
+      f("W3", W3_);
+      f("B3", B3_);
+      f("W4", W4_);
+      f("W4T", W4T_);
+      f("B4", B4_);
+      f("W4q", W4q_);
+      f("Gamma_0", Gamma_0_);
+      f("Gamma_1", Gamma_1_);
+      f("Gamma_2", Gamma_2_);
+    }
+
+    const mblas::PackedMatrix W1_;
     const mblas::Matrix B1_;
-    const mblas::Matrix W2_;
+    const mblas::PackedMatrix W2_;
     const mblas::Matrix B2_;
-    const mblas::Matrix W3_;
+    const mblas::PackedMatrix W3_;
     const mblas::Matrix B3_;
-    const mblas::Matrix W4_;
+    // the output layer is kept in one of three forms: W4_ by default, W4T_
+    // for QuantizationOptions::vocabMajorOutput and W4q_ for
+    // --cpu-int8-output; the other two are empty
+    const mblas::PackedMatrix W4_;
+    // W4_ transposed, a row per target word; in the mapped model file
+    // when the output layer is tied to the target embeddings
+    const mblas::MatrixView W4T_;
     const mblas::Matrix B4_;
+    const mblas::QuantizedMatrix8 W4q_;
     const mblas::Matrix Gamma_0_;
     const mblas::Matrix Gamma_1_;
     const mblas::Matrix Gamma_2_;
@@ -90,11 +208,18 @@ struct Weights {
 
   //////////////////////////////////////////////////////////////////////////////
 
-  Weights(const std::string& npzFile, size_t device = 0)
-    : Weights(NpzConverter(npzFile), device)
+  Weights(const std::string& npzFile, size_t device = 0,
+          const mblas::QuantizationOptions& quantization = mblas::QuantizationOptions())
+    : Weights(NpzConverter(npzFile), device, quantization)
   {}
 
-  Weights(const NpzConverter& model, size_t device = 0);
+  Weights(const NpzConverter& model, size_t device = 0,
+          const mblas::QuantizationOptions& quantization = mblas::QuantizationOptions());
+
+  // a model converted by amun-convert, in the forms it was converted to
+  Weights(const BinaryModel& model, size_t device = 0);
+
+  void Save(BinaryModelWriter& writer) const;
 
   size_t GetDevice() {
     return std::numeric_limits<size_t>::max();
@@ -109,6 +234,11 @@ struct Weights {
   const DecGRU2 decGru2_;
   const DecAttention decAttention_;
   const DecSoftmax decSoftmax_;
+
+ private:
+  // from an NpzSource or a BinarySource, see cpu/weights_source.h
+  template <class Model>
+  explicit Weights(const Model& model);
 };
 
 inline std::ostream& operator<<(std::ostream &out, const Weights::Embeddings &obj)
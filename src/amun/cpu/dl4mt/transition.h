@@ -88,7 +88,6 @@ class Transition {
     const Weights& w_;
 
     // reused to avoid allocation
-    mutable mblas::Matrix UUx_;
     mutable mblas::Matrix RUH_;
     mutable mblas::Matrix RUH_1_;
     mutable mblas::Matrix RUH_2_;
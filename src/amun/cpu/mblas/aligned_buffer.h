@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <algorithm>
+
+#include "common/allocation_counter.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+// Storage of the CPU matrices that do not own a blaze::DynamicMatrix.
+// Memory is 64-byte aligned and padded to whole cache lines, and it only
+// ever grows: resizing below the capacity reuses the allocation.
+template <typename T>
+class AlignedBuffer {
+  public:
+    static const size_t ALIGNMENT = 64;
+
+    AlignedBuffer()
+      : data_(nullptr), size_(0), capacity_(0)
+    {}
+
+    explicit AlignedBuffer(size_t size, T val = T())
+      : AlignedBuffer()
+    {
+      resize(size, val);
+    }
+
+    AlignedBuffer(const AlignedBuffer& other)
+      : AlignedBuffer()
+    {
+      *this = other;
+    }
+
+    // BlazeMatrix relies on moves keeping the allocation, its view still
+    // points at it afterwards
+    AlignedBuffer(AlignedBuffer&& other) noexcept
+      : AlignedBuffer()
+    {
+      swap(other);
+    }
+
+    ~AlignedBuffer() {
+      free(data_);
+    }
+
+    AlignedBuffer& operator=(const AlignedBuffer& other) {
+      if (this != &other) {
+        size_ = 0;
+        reserve(other.size_);
+        std::copy(other.data_, other.data_ + other.size_, data_);
+        size_ = other.size_;
+      }
+      return *this;
+    }
+
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept {
+      swap(other);
+      return *this;
+    }
+
+    // new values are set to val, existing ones are kept
+    void resize(size_t size, T val = T()) {
+      reserve(size);
+      if (size > size_) {
+        std::fill(data_ + size_, data_ + size, val);
+      }
+      size_ = size;
+    }
+
+    void reserve(size_t size) {
+      if (size <= capacity_) {
+        return;
+      }
+
+      size_t bytes = (size * sizeof(T) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+      void* data = nullptr;
+      if (posix_memalign(&data, ALIGNMENT, bytes) != 0) {
+        throw std::bad_alloc();
+      }
+      if (size_) {
+        std::memcpy(data, data_, size_ * sizeof(T));
+      }
+      free(data_);
+      data_ = static_cast<T*>(data);
+      capacity_ = bytes / sizeof(T);
+      CountAllocation();
+    }
+
+    void swap(AlignedBuffer& other) {
+      std::swap(data_, other.data_);
+      std::swap(size_, other.size_);
+      std::swap(capacity_, other.capacity_);
+    }
+
+    T* data() {
+      return data_;
+    }
+
+    const T* data() const {
+      return data_;
+    }
+
+    size_t size() const {
+      return size_;
+    }
+
+    size_t capacity() const {
+      return capacity_;
+    }
+
+  private:
+    T* data_;
+    size_t size_;
+    size_t capacity_;
+};
+
+}
+}
+}
@@ -2,11 +2,14 @@
 
 #include <cmath>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <sstream>
 
 #include <blaze/Math.h>
 #include "phoenix_functions.h"
+#include "vector_math.h"
+#include "aligned_buffer.h"
 #include "common/base_matrix.h"
 #include "common/exception.h"
 
@@ -30,11 +33,43 @@ public:
 
   Matrix(size_t rows, size_t cols)
     : Parent(rows, cols)
+  {
+    if (rows * cols) {
+      CountAllocation();
+    }
+  }
+
+  Matrix(const Matrix& other)
+    : BaseMatrix(other), Parent(other)
+  {
+    if (other.rows() * other.columns()) {
+      CountAllocation();
+    }
+  }
+
+  Matrix(Matrix&& other)
+    : BaseMatrix(other), Parent(std::move(other))
   {}
 
+  Matrix& operator=(const Matrix& other) {
+    size_t capacity = Parent::capacity();
+    Parent::operator=(other);
+    CountIfGrown(capacity);
+    return *this;
+  }
+
   template<typename T>
   Parent& operator=(const T &other) {
-    return Parent::operator=(other);
+    size_t capacity = Parent::capacity();
+    Parent::operator=(other);
+    CountIfGrown(capacity);
+    return *this;
+  }
+
+  void resize(size_t rows, size_t cols, bool preserve = true) {
+    size_t capacity = Parent::capacity();
+    Parent::resize(rows, cols, preserve);
+    CountIfGrown(capacity);
   }
 
   virtual size_t dim(size_t i) const
@@ -54,6 +89,13 @@ public:
     amunmt_UTIL_THROW2("Not implemented");
   }
 
+private:
+  // blaze only reallocates when the capacity is exceeded
+  void CountIfGrown(size_t capacity) const {
+    if (Parent::capacity() != capacity) {
+      CountAllocation();
+    }
+  }
 };
 
 
@@ -64,8 +106,8 @@ class BlazeMatrix : public BaseMatrix, public blaze::CustomMatrix<T, blaze::unal
                                              blaze::rowMajor> {
   public:
     typedef T value_type;
-    typedef typename std::vector<value_type>::iterator iterator;
-    typedef typename std::vector<value_type>::const_iterator const_iterator;
+    typedef value_type* iterator;
+    typedef const value_type* const_iterator;
     typedef blaze::CustomMatrix<value_type,
                                 blaze::unaligned,
                                 blaze::unpadded,
@@ -127,19 +169,19 @@ class BlazeMatrix : public BaseMatrix, public blaze::CustomMatrix<T, blaze::unal
     }
 
     iterator begin() {
-      return data_.begin();
+      return data_.data();
     }
 
     iterator end() {
-      return data_.end();
+      return data_.data() + data_.size();
     }
 
     const_iterator begin() const{
-      return data_.begin();
+      return data_.data();
     }
 
     const_iterator end() const {
-      return data_.end();
+      return data_.data() + data_.size();
     }
 
     size_t size() const {
@@ -147,12 +189,12 @@ class BlazeMatrix : public BaseMatrix, public blaze::CustomMatrix<T, blaze::unal
     }
 
     void swap(BlazeMatrix<T, SO>& rhs) {
-      std::swap(data_, rhs.data_);
+      data_.swap(rhs.data_);
       std::swap(static_cast<BlazeBase&>(*this), static_cast<BlazeBase&>(rhs));
     }
 
   private:
-    std::vector<value_type> data_;
+    AlignedBuffer<value_type> data_;
 };
 
 ////////////////////////////////////////////////////////////////////////
@@ -173,6 +215,47 @@ class ArrayMatrix : public BlazeMatrix<float, blaze::rowMajor>
       : Parent(rhs)
     {}
 
+    // assign expressions into the existing buffer instead of a temporary
+    using Parent::operator=;
+};
+
+////////////////////////////////////////////////////////////////////////
+// Read-only weight matrix used in place, usually in the pages of a mapped
+// model file. Holds a reference to whatever owns the values; the rows are
+// neither padded nor aligned.
+class MatrixView : public blaze::CustomMatrix<float, blaze::unaligned,
+                                              blaze::unpadded,
+                                              blaze::rowMajor>
+{
+  public:
+    typedef blaze::CustomMatrix<float, blaze::unaligned,
+                                blaze::unpadded,
+                                blaze::rowMajor> Parent;
+
+    MatrixView()
+      : Parent()
+    {}
+
+    MatrixView(std::shared_ptr<const void> owner, const float* data, size_t rows, size_t columns)
+      : Parent(const_cast<float*>(data), rows, columns),
+        owner_(std::move(owner))
+    {}
+
+    MatrixView(const MatrixView&) = default;
+    MatrixView(MatrixView&&) = default;
+
+    // blaze assigns custom matrices element by element, which would write
+    // into the owner; a view can only be pointed at other values
+    MatrixView& operator=(const MatrixView&) = delete;
+
+    MatrixView& operator=(MatrixView&& other) {
+      Parent::reset(other.data(), other.rows(), other.columns());
+      owner_ = std::move(other.owner_);
+      return *this;
+    }
+
+  private:
+    std::shared_ptr<const void> owner_;
 };
 
 ////////////////////////////////////////////////////////////////////////
@@ -256,71 +339,71 @@ typedef std::vector<RowPair> DeviceRowPairs;
 const bool byRow = true;
 const bool byColumn = false;
 
+// out must not be m1 or m2; reuses the buffer of out
 template <bool byRow, class MT, class MT1, class MT2>
-MT Concat(const MT1& m1, const MT2& m2) {
-  MT out = m1;
+void Concat(MT& out, const MT1& m1, const MT2& m2) {
   if(byRow) {
     assert(m1.columns() == m2.columns());
     size_t rows1 = m1.rows();
-    size_t rows2 = m2.rows();
-    size_t rows = rows1 + rows2;
-    size_t cols = m1.columns();
-    out.resize(rows, cols);
-    for(size_t i = 0; i < rows2; ++i)
-      blaze::row(out, rows1 + i) = blaze::row(m2, i);
+    out.resize(rows1 + m2.rows(), m1.columns(), false);
+    blaze::submatrix(out, 0, 0, rows1, m1.columns()) = m1;
+    blaze::submatrix(out, rows1, 0, m2.rows(), m2.columns()) = m2;
   }
   else {
     assert(m1.rows() == m2.rows());
     size_t cols1 = m1.columns();
-    size_t cols2 = m2.columns();
-    size_t cols = cols1 + cols2;
-    size_t rows = m1.rows();
-    out.resize(rows, cols);
-    for(size_t i = 0; i < cols2; ++i)
-      blaze::column(out, cols1 + i) = blaze::column(m2, i);
+    out.resize(m1.rows(), cols1 + m2.columns(), false);
+    blaze::submatrix(out, 0, 0, m1.rows(), cols1) = m1;
+    blaze::submatrix(out, 0, cols1, m2.rows(), m2.columns()) = m2;
   }
+}
+
+template <bool byRow, class MT, class MT1, class MT2>
+MT Concat(const MT1& m1, const MT2& m2) {
+  MT out;
+  Concat<byRow>(out, m1, m2);
   return std::move(out);
 }
 
+// out must not be in; reuses the buffer of out
 template <bool byRow, class MT, class MT1>
-MT Assemble(const MT1& in,
-            const std::vector<size_t>& indices) {
-  MT out;
+void Assemble(MT& out, const MT1& in, const std::vector<size_t>& indices) {
   if(byRow) {
     size_t rows = indices.size();
     size_t cols = in.columns();
-    out.resize(rows, cols);
+    out.resize(rows, cols, false);
     for(size_t i = 0; i < rows; ++i)
       blaze::row(out, i) = blaze::row(in, indices[i]);
   }
   else {
     size_t rows = in.rows();
     size_t cols = indices.size();
-    out.resize(rows, cols);
+    out.resize(rows, cols, false);
     for(size_t i = 0; i < cols; ++i)
       blaze::column(out, i) = blaze::column(in, indices[i]);
   }
+}
+
+template <bool byRow, class MT, class MT1>
+MT Assemble(const MT1& in,
+            const std::vector<size_t>& indices) {
+  MT out;
+  Assemble<byRow>(out, in, indices);
   return std::move(out);
 }
 
+inline void SafeSoftmax(float* row, size_t cols) {
+  float maxRowValue = std::max(0.0f, RowMax(row, cols));
+  float sum = RowExpSum(row, row, cols, maxRowValue);
+  RowScale(row, cols, 1.0f / sum);
+}
+
 template <class MT>
 void SafeSoftmax(MT& Out) {
   size_t rows = Out.rows();
   size_t cols = Out.columns();
-  float sum[rows];
-  for (int j = 0; j < rows; ++j) {
-    float maxRowValue = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      maxRowValue = std::max(maxRowValue, Out(j,i));
-    }
-    sum[j] = 0;
-    for (int i = 0; i < cols; ++i) {
-      Out(j, i) = expapprox(Out(j, i) - maxRowValue);
-      sum[j] += Out(j, i);
-    }
-    for(int i = 0; i < cols; ++i) {
-      Out(j, i) /= sum[j];
-    }
+  for (size_t j = 0; j < rows; ++j) {
+    SafeSoftmax(&Out(j, 0), cols);
   }
 }
 
@@ -328,41 +411,41 @@ template <class MT>
 void LogSoftmax(MT& Out) {
   size_t rows = Out.rows();
   size_t cols = Out.columns();
-  float sum[rows];
-  for (int j = 0; j < rows; ++j) {
-    sum[j] = 0;
-    for (int i = 0; i < cols; ++i) {
-      sum[j] += expapprox(Out(j, i));
-    }
-    for(int i = 0; i < cols; ++i) {
-      Out(j, i) -= logapprox(sum[j]);
-    }
+  for (size_t j = 0; j < rows; ++j) {
+    float* row = &Out(j, 0);
+    RowAdd(row, cols, -logapprox(RowSumExp(row, cols)));
   }
 }
 
+// Greedy decoding: the best column of each row and its log-softmax value,
+// computed in the same pass as the normalizer. The row itself is left
+// unnormalized. Column maskedColumn (if < cols) is never selected.
 template <class MT>
-void Softmax(MT& Out) {
-  size_t rows = Out.rows();
-  size_t cols = Out.columns();
-  float sum[rows];
-  for (int j = 0; j < rows; ++j) {
-    float maxRowValue = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      maxRowValue = std::max(maxRowValue, Out(j,i));
-    }
-
-    sum[j] = 0;
-    for (int i = 0; i < cols; ++i) {
-      Out(j,i) = expapprox(Out(j, i) - maxRowValue);
-      sum[j] += Out(j, i);
-    }
-
-    for(int i = 0; i < cols; ++i) {
-      Out(j, i) /= sum[j];
+void LogSoftmaxArgmax(const MT& In, size_t maskedColumn,
+                      std::vector<size_t>& ids, std::vector<float>& costs) {
+  size_t rows = In.rows();
+  size_t cols = In.columns();
+  ids.resize(rows);
+  costs.resize(rows);
+  for (size_t j = 0; j < rows; ++j) {
+    const float* row = &In(j, 0);
+    float sum = RowSumExp(row, cols);
+    size_t best = (maskedColumn == 0) ? 1 : 0;
+    for (size_t i = 0; i < cols; ++i) {
+      if (row[i] > row[best] && i != maskedColumn) {
+        best = i;
+      }
     }
+    ids[j] = best;
+    costs[j] = In(j, best) - logapprox(sum);
   }
 }
 
+template <class MT>
+void Softmax(MT& Out) {
+  SafeSoftmax(Out);
+}
+
 template <class MT, class Functor, class MT1, class MT2>
 MT Broadcast(const Functor& functor, const MT1& m1, const MT2& m2) {
   size_t rows1 = m1.rows();
@@ -383,79 +466,51 @@ MT Broadcast(const Functor& functor, const MT1& m1, const MT2& m2) {
   return std::move(out);
 }
 
+// Layer normalization parameters are column vectors, i.e. one value per
+// padded row. Copies them to contiguous memory for the row kernels.
+template<class MT>
+const float* VectorData(const MT& v, std::vector<float>& buffer) {
+  if (v.rows() == 1) {
+    return &v(0, 0);
+  }
+  buffer.resize(v.rows());
+  for (size_t i = 0; i < v.rows(); ++i) {
+    buffer[i] = v(i, 0);
+  }
+  return buffer.data();
+}
+
 template<class MT>
 void LayerNormalization(MT& in, const MT& gamma, const MT& beta, float eps=1e-5f) {
   eps=1e-5f;
-  // std::cerr << "LAYER NORM" << std::endl;
-  // std::cerr << std::endl;
-  size_t rows = in.rows();
-  size_t cols = in.columns();
-
-  for (int j = 0; j < rows; ++j) {
-    // std::cerr << "PRE ";
-    // for (int i = 0; i < 10; ++i) {
-      // std::cerr << in(j, i) << " ";
-    // }
-    // std::cerr << std::endl;
-    //
-    float sum = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      sum += in(j, i);
-    }
-
-    float mean = sum / cols;
-
-    float sigma = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      sigma += (in(j, i) - mean) * (in(j, i) - mean);
-    }
-    sigma /= cols;
-
-    sigma = sqrt(sigma + eps);
-
-    // std::cerr << "MIDD ";
-    // for (int i = 0; i < 10; ++i) {
-      // std::cerr << ( (in(j, i) - mean) / sigma) << " ";
-    // }
-    // std::cerr << std::endl;
+  thread_local std::vector<float> gammaBuffer, betaBuffer;
+  const float* g = VectorData(gamma, gammaBuffer);
+  const float* b = VectorData(beta, betaBuffer);
 
-    for (int i = 0; i < cols; ++i) {
-      in(j, i) = gamma(i, 0) * ( (in(j, i) - mean) / sigma) + beta(i, 0);
-    }
-
-    // std::cerr << "POST ";
-    // for (int i = 0; i < 10; ++i) {
-      // std::cerr << in(j, i) << " ";
-    // }
-    // std::cerr << std::endl;
+  size_t cols = in.columns();
+  for (size_t j = 0; j < in.rows(); ++j) {
+    RowLayerNorm(&in(j, 0), cols, g, b, eps);
   }
-  // std::cerr << "LAYER NORM: DONE" << std::endl;
 }
 
 template<class MT>
 void LayerNormalization(MT& in, const MT& gamma, float eps=1e-9) {
-  size_t rows = in.rows();
-  size_t cols = in.columns();
-
-  for (int j = 0; j < rows; ++j) {
-    float sum = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      sum += in(j, i);
-    }
-
-    float mean = sum / cols;
-
-    float sigma = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      sigma += (in(j, i) - mean) * (in(j, i) - mean);
-    }
-    sigma /= cols;
+  thread_local std::vector<float> gammaBuffer;
+  const float* g = VectorData(gamma, gammaBuffer);
 
-    sigma = sqrt(sigma + eps);
+  size_t cols = in.columns();
+  for (size_t j = 0; j < in.rows(); ++j) {
+    RowLayerNorm(&in(j, 0), cols, g, nullptr, eps);
+  }
+}
 
-    for (int i = 0; i < cols; ++i) {
-      in(j, i) = gamma(i, 0) * ( (in(j, i) - mean) / sigma);
-    }
+// In-place tanh of every element
+template<class MT>
+void ApplyTanh(MT& M) {
+  size_t cols = M.columns();
+  for (size_t j = 0; j < M.rows(); ++j) {
+    float* row = &M(j, 0);
+    RowTanh(row, row, cols);
   }
 }
 
@@ -0,0 +1,116 @@
+#include "cpu/mblas/nth_element.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "cpu/mblas/vector_math.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+namespace {
+
+const size_t CHUNK_SIZE = 16;
+
+struct Better {
+  template <class Entry>
+  bool operator()(const Entry& a, const Entry& b) const {
+    return a.cost > b.cost || (a.cost == b.cost && a.key < b.key);
+  }
+};
+
+}
+
+inline void NthElement::Push(float cost, size_t key, size_t k) {
+  Entry entry = {cost, key};
+  if (heap_.size() < k) {
+    heap_.push_back(entry);
+    std::push_heap(heap_.begin(), heap_.end(), Better());
+  } else if (Better()(entry, heap_.front())) {
+    std::pop_heap(heap_.begin(), heap_.end(), Better());
+    heap_.back() = entry;
+    std::push_heap(heap_.begin(), heap_.end(), Better());
+  }
+}
+
+void NthElement::getNBestList(const float* probs, size_t cols,
+                              size_t rowStart, size_t rows, size_t k,
+                              std::vector<float>& outCosts,
+                              std::vector<size_t>& outKeys)
+{
+  singleProbs_.assign(1, probs);
+  singleWeights_.assign(1, 1.0f);
+  getNBestList(singleProbs_, singleWeights_, nullptr,
+               cols, rowStart, rows, k, cols, outCosts, outKeys);
+}
+
+void NthElement::getNBestList(const std::vector<const float*>& probs,
+                              const std::vector<float>& weights,
+                              const float* prevCosts,
+                              size_t cols,
+                              size_t rowStart, size_t rows, size_t k,
+                              size_t maskedColumn,
+                              std::vector<float>& outCosts,
+                              std::vector<size_t>& outKeys)
+{
+  const bool masking = maskedColumn < cols;
+  k = std::min(k, rows * (masking ? cols - 1 : cols));
+  heap_.clear();
+  heap_.reserve(k);
+  if (k == 0) {
+    outCosts.clear();
+    outKeys.clear();
+    return;
+  }
+
+  float chunk[CHUNK_SIZE];
+  for (size_t r = rowStart; r < rowStart + rows; ++r) {
+    const size_t offset = r * cols;
+    const float prior = prevCosts ? prevCosts[r] : 0.0f;
+
+    for (size_t c = 0; c < cols; c += CHUNK_SIZE) {
+      const size_t n = std::min(CHUNK_SIZE, cols - c);
+
+      const float* p = probs[0] + offset + c;
+      for (size_t i = 0; i < n; ++i) {
+        chunk[i] = prior + weights[0] * p[i];
+      }
+      for (size_t s = 1; s < probs.size(); ++s) {
+        p = probs[s] + offset + c;
+        for (size_t i = 0; i < n; ++i) {
+          chunk[i] += weights[s] * p[i];
+        }
+      }
+      // the masked column is left out of the maximum and never pushed
+      const size_t masked = (masking && maskedColumn >= c && maskedColumn < c + n)
+                            ? maskedColumn - c : CHUNK_SIZE;
+      if (masked < n) {
+        chunk[masked] = std::numeric_limits<float>::lowest();
+      }
+
+      // later keys are larger, so an equal cost never wins the tie
+      if (heap_.size() == k && RowMax(chunk, n) <= heap_.front().cost) {
+        continue;
+      }
+      for (size_t i = 0; i < n; ++i) {
+        if (i != masked) {
+          Push(chunk[i], offset + c + i, k);
+        }
+      }
+    }
+  }
+
+  std::sort_heap(heap_.begin(), heap_.end(), Better());
+
+  outCosts.resize(heap_.size());
+  outKeys.resize(heap_.size());
+  for (size_t i = 0; i < heap_.size(); ++i) {
+    outCosts[i] = heap_[i].cost;
+    outKeys[i] = heap_[i].key;
+  }
+}
+
+}
+}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Selects the k best scores of a block of rows of a row-major probability
+// matrix in a single pass. Scores of an ensemble are combined on the fly
+// while streaming over the rows, nothing is written back. A min-heap of
+// the current k best is kept in preallocated scratch, the heap root is the
+// threshold a score has to beat.
+// Rows are scanned in chunks, a chunk whose maximum (RowMax) does not beat
+// the threshold is skipped without touching the heap.
+class NthElement {
+  public:
+    NthElement() = default;
+    NthElement(const NthElement&) = delete;
+
+    // Returns the k best (cost, key) pairs of rows [rowStart, rowStart + rows),
+    // keys are flat indices into probs. The output is sorted best first,
+    // ties are broken by the smaller key.
+    void getNBestList(const float* probs, size_t cols,
+                      size_t rowStart, size_t rows, size_t k,
+                      std::vector<float>& outCosts,
+                      std::vector<size_t>& outKeys);
+
+    // Same, for the score prevCosts[row] + sum_s weights[s] * probs[s][key].
+    // prevCosts may be null, column maskedColumn (if < cols) is left out.
+    void getNBestList(const std::vector<const float*>& probs,
+                      const std::vector<float>& weights,
+                      const float* prevCosts,
+                      size_t cols,
+                      size_t rowStart, size_t rows, size_t k,
+                      size_t maskedColumn,
+                      std::vector<float>& outCosts,
+                      std::vector<size_t>& outKeys);
+
+  private:
+    struct Entry {
+      float cost;
+      size_t key;
+    };
+
+    void Push(float cost, size_t key, size_t k);
+
+    std::vector<Entry> heap_;
+
+    // arguments of the single matrix getNBestList
+    std::vector<const float*> singleProbs_;
+    std::vector<float> singleWeights_;
+};
+
+}
+}
+}
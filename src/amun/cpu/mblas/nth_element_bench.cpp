@@ -0,0 +1,90 @@
+// Times NthElement against the nth_element over all keys it replaced, on
+// random scores of the size of a CPU decoding step:
+//   amun-bench-nth-element [vocab size] [beam size] [steps]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "common/logging.h"
+#include "cpu/mblas/nth_element.h"
+
+using namespace amunmt::CPU::mblas;
+
+namespace {
+
+// milliseconds per call of f, averaged over steps calls
+template <class F>
+double Time(size_t steps, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < steps; ++i) {
+    f(i);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() / steps;
+}
+
+}
+
+int main(int argc, char** argv) {
+  spdlog::stderr_logger_mt("info");
+
+  const size_t vocab = argc > 1 ? std::atoi(argv[1]) : 80000;
+  const size_t beam = argc > 2 ? std::atoi(argv[2]) : 12;
+  const size_t steps = argc > 3 ? std::atoi(argv[3]) : 200;
+
+  std::mt19937 gen(1);
+  std::normal_distribution<float> logProbs(-10.0f, 3.0f);
+  std::vector<float> probs(vocab * beam);
+  std::vector<float> probs2(vocab * beam);
+  for (size_t i = 0; i < probs.size(); ++i) {
+    probs[i] = logProbs(gen);
+    probs2[i] = logProbs(gen);
+  }
+  std::vector<float> prevCosts(beam);
+  for (float& cost : prevCosts) {
+    cost = logProbs(gen);
+  }
+
+  // the result is used so that no loop is optimized away
+  size_t check = 0;
+
+  double keys = Time(steps, [&](size_t i) {
+    probs[i % probs.size()] += 0.001f;
+    std::vector<size_t> keys(probs.size());
+    std::iota(keys.begin(), keys.end(), 0);
+    std::nth_element(keys.begin(), keys.begin() + beam, keys.end(),
+                     [&](size_t a, size_t b) { return probs[a] > probs[b]; });
+    check += keys[0];
+  });
+
+  NthElement nthElement;
+  std::vector<float> costs;
+  std::vector<size_t> bestKeys;
+  double single = Time(steps, [&](size_t i) {
+    probs[i % probs.size()] += 0.001f;
+    nthElement.getNBestList(probs.data(), vocab, 0, beam, beam, costs, bestKeys);
+    check += bestKeys[0];
+  });
+
+  // two scorers, previous costs and UNK left out, as BestHyps calls it
+  std::vector<const float*> ensemble = {probs.data(), probs2.data()};
+  std::vector<float> weights = {0.7f, 0.3f};
+  double combined = Time(steps, [&](size_t i) {
+    probs[i % probs.size()] += 0.001f;
+    nthElement.getNBestList(ensemble, weights, prevCosts.data(), vocab, 0, beam, beam, 1,
+                            costs, bestKeys);
+    check += bestKeys[0];
+  });
+
+  std::printf("vocab %zu, beam %zu, %zu steps\n", vocab, beam, steps);
+  std::printf("nth_element over keys:   %.3f ms/step\n", keys);
+  std::printf("NthElement:              %.3f ms/step (%.1fx)\n", single, keys / single);
+  std::printf("NthElement, 2 scorers:   %.3f ms/step\n", combined);
+  std::printf("(%zu)\n", check);
+  return 0;
+}
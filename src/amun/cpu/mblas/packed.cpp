@@ -0,0 +1,126 @@
+#include "cpu/mblas/packed.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "common/exception.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+PackedMatrix::PackedMatrix(const Matrix& W)
+  : panels_(nullptr)
+{
+  Resize(W.rows(), W.columns());
+  PackColumns(W, 0);
+}
+
+
+PackedMatrix::PackedMatrix(const Matrix& a, const Matrix& b)
+  : panels_(nullptr)
+{
+  amunmt_UTIL_THROW_IF2(a.rows() != b.rows(),
+                        "PackedMatrix: " << a.rows() << " and " << b.rows() << " rows");
+  Resize(a.rows(), a.columns() + b.columns());
+  PackColumns(a, 0);
+  PackColumns(b, a.columns());
+}
+
+
+PackedMatrix::PackedMatrix(std::shared_ptr<const void> owner, const float* panels,
+                           size_t rows, size_t cols)
+  : rows_(rows), cols_(cols), owner_(std::move(owner)), panels_(panels)
+{
+  amunmt_UTIL_THROW_IF2(reinterpret_cast<uintptr_t>(panels) % AlignedBuffer<float>::ALIGNMENT,
+                        "PackedMatrix: panels are not aligned");
+}
+
+
+void PackedMatrix::Resize(size_t rows, size_t cols) {
+  owner_.reset();
+  panels_ = nullptr;
+  rows_ = rows;
+  cols_ = cols;
+  size_t panels = (cols + PANEL_WIDTH - 1) / PANEL_WIDTH;
+  data_.resize(panels * rows * PANEL_WIDTH);
+
+  // padding columns of the last panel
+  if (cols % PANEL_WIDTH) {
+    float* last = data_.data() + (panels - 1) * rows * PANEL_WIDTH;
+    for (size_t i = 0; i < rows; ++i) {
+      std::fill(last + i * PANEL_WIDTH + cols % PANEL_WIDTH, last + (i + 1) * PANEL_WIDTH, 0.0f);
+    }
+  }
+}
+
+
+void PackedMatrix::PackColumns(const Matrix& W, size_t offset) {
+  for (size_t i = 0; i < W.rows(); ++i) {
+    const float* row = W.data(i);
+    for (size_t j = 0; j < W.columns(); ++j) {
+      size_t col = offset + j;
+      data_.data()[(col / PANEL_WIDTH * rows_ + i) * PANEL_WIDTH + col % PANEL_WIDTH] = row[j];
+    }
+  }
+}
+
+
+void PackedMatrix::AssignRows(const MatrixView& WT, const std::vector<size_t>& rows) {
+  Resize(WT.columns(), rows.size());
+
+  // the rows of a panel are read side by side, each sequentially
+  const float* src[PANEL_WIDTH];
+  for (size_t j = 0; j < cols_; j += PANEL_WIDTH) {
+    size_t n = std::min(PANEL_WIDTH, cols_ - j);
+    for (size_t c = 0; c < n; ++c) {
+      src[c] = WT.data(rows[j + c]);
+    }
+    float* dst = data_.data() + j * rows_;
+    for (size_t i = 0; i < rows_; ++i) {
+      for (size_t c = 0; c < n; ++c) {
+        dst[i * PANEL_WIDTH + c] = src[c][i];
+      }
+    }
+  }
+}
+
+
+void PackedGemm(const Matrix& In, const PackedMatrix& W, size_t col, size_t n,
+                float* out, size_t stride)
+{
+  amunmt_UTIL_THROW_IF2(In.columns() != W.rows(),
+                        "PackedGemm: " << In.columns() << " input columns, " << W.rows() << " weight rows");
+  Kernels().packedGemm(In.data(), In.spacing(), In.rows(), In.columns(),
+                       W.panel(col / PackedMatrix::PANEL_WIDTH), n, out, stride);
+}
+
+
+void PackedGemm(const Matrix& In, const PackedMatrix& W, Matrix& Out)
+{
+  Out.resize(In.rows(), W.columns(), false);
+  PackedGemm(In, W, 0, W.columns(), Out.data(), Out.spacing());
+}
+
+
+void PackedGemm(const Matrix& In, const PackedMatrix& W, ArrayMatrix& Out)
+{
+  Out.Resize(In.rows(), W.columns());
+  PackedGemm(In, W, 0, W.columns(), Out.data(), W.columns());
+}
+
+
+std::ostream& operator<<(std::ostream& out, const PackedMatrix& W) {
+  for (size_t i = 0; i < W.rows(); ++i) {
+    out << "( ";
+    for (size_t j = 0; j < W.columns(); ++j) {
+      out << W(i, j) << " ";
+    }
+    out << ")\n";
+  }
+  return out;
+}
+
+}
+}
+}
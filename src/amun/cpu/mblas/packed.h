@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <iostream>
+
+#include "cpu/mblas/matrix.h"
+#include "cpu/mblas/aligned_buffer.h"
+#include "cpu/mblas/vector_math.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// fp32 weight matrix packed once at model load for PackedGemm. The columns
+// are cut into panels of PANEL_WIDTH, stored one after the other; a panel
+// holds its rows() x PANEL_WIDTH values row by row, one cache line per row,
+// so the kernel streams through it while a block of output rows stays in
+// registers. The last panel is padded with zero columns.
+class PackedMatrix {
+  public:
+    static const size_t PANEL_WIDTH = PACKED_PANEL_WIDTH;
+
+    PackedMatrix()
+      : rows_(0), cols_(0), panels_(nullptr)
+    {}
+
+    explicit PackedMatrix(const Matrix& W);
+
+    // the columns of a followed by the columns of b
+    PackedMatrix(const Matrix& a, const Matrix& b);
+
+    // panels already packed, such as those of a mapped native model file,
+    // used in place; they have to be 64-byte aligned
+    PackedMatrix(std::shared_ptr<const void> owner, const float* panels, size_t rows, size_t cols);
+
+    // column j is row rows[j] of WT, a matrix stored by columns such as
+    // the output layer kept by target word. Reuses the allocation, for a
+    // filtered vocabulary packed for every batch.
+    void AssignRows(const MatrixView& WT, const std::vector<size_t>& rows);
+
+    size_t rows() const {
+      return rows_;
+    }
+
+    size_t columns() const {
+      return cols_;
+    }
+
+    bool empty() const {
+      return cols_ == 0;
+    }
+
+    // number of stored values, all panels with their padding
+    size_t size() const {
+      return (cols_ + PANEL_WIDTH - 1) / PANEL_WIDTH * rows_ * PANEL_WIDTH;
+    }
+
+    // panel p, for columns [p * PANEL_WIDTH, (p + 1) * PANEL_WIDTH)
+    const float* panel(size_t p) const {
+      return (owner_ ? panels_ : data_.data()) + p * rows_ * PANEL_WIDTH;
+    }
+
+    float operator()(size_t i, size_t j) const {
+      return panel(j / PANEL_WIDTH)[i * PANEL_WIDTH + j % PANEL_WIDTH];
+    }
+
+  private:
+    void Resize(size_t rows, size_t cols);
+
+    void PackColumns(const Matrix& W, size_t offset);
+
+    size_t rows_;
+    size_t cols_;
+    AlignedBuffer<float> data_;
+    // set instead of data_ for panels used in place
+    std::shared_ptr<const void> owner_;
+    const float* panels_;
+};
+
+// Out = In * W
+void PackedGemm(const Matrix& In, const PackedMatrix& W, Matrix& Out);
+
+void PackedGemm(const Matrix& In, const PackedMatrix& W, ArrayMatrix& Out);
+
+// columns [col, col + n) of In * W into out, whose rows are stride apart;
+// col is a multiple of PackedMatrix::PANEL_WIDTH
+void PackedGemm(const Matrix& In, const PackedMatrix& W, size_t col, size_t n,
+                float* out, size_t stride);
+
+std::ostream& operator<<(std::ostream& out, const PackedMatrix& W);
+
+}
+}
+}
@@ -0,0 +1,290 @@
+#include "cpu/mblas/quantized.h"
+#include "cpu/mblas/top_k.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "cpu/mblas/vector_math.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+namespace {
+
+// The dot products are VectorKernels::dot8 and dot16. COLUMN_BLOCK columns
+// of W are streamed together and reused for all rows of In, which are
+// processed ROW_BLOCK at a time.
+const size_t COLUMN_BLOCK = QUANTIZED_COLUMN_BLOCK;
+const size_t ROW_BLOCK = QUANTIZED_ROW_BLOCK;
+
+const size_t ALIGN8 = QUANTIZED_ALIGN;
+
+inline size_t RoundUp(size_t n, size_t m) {
+  return (n + m - 1) / m * m;
+}
+
+const size_t ALIGN16 = QUANTIZED_ALIGN;
+
+// Quantizes n values to [-range, range] and returns the scale back to fp32;
+// out holds stride values, the ones after n are zero.
+template <class T>
+float QuantizeRow(const float* in, size_t n, size_t stride, float range, T* out) {
+  float maxAbs = 0.0f;
+  for (size_t i = 0; i < n; ++i) {
+    maxAbs = std::max(maxAbs, std::abs(in[i]));
+  }
+  float scale = (maxAbs > 0.0f) ? maxAbs / range : 1.0f;
+  float inverse = 1.0f / scale;
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = static_cast<T>(std::lrint(in[i] * inverse));
+  }
+  std::fill(out + n, out + stride, 0);
+  return scale;
+}
+
+inline float QuantizeRow8(const float* in, size_t n, size_t stride, int8_t* out) {
+  return QuantizeRow(in, n, stride, 127.0f, out);
+}
+
+// Largest value such that stride products of two values in [-range, range]
+// add up without overflowing int32.
+inline float Range16(size_t stride) {
+  double range = std::floor(std::sqrt(2147483647.0 / std::max<size_t>(stride, 1)));
+  return float(std::min(range, 32767.0));
+}
+
+}
+
+QuantizedMatrix8::QuantizedMatrix8(const Matrix& W)
+  : rows_(W.rows()),
+    cols_(W.columns()),
+    stride_(RoundUp(W.rows(), ALIGN8)),
+    data_(cols_ * stride_),
+    scales_(cols_)
+{
+  std::vector<float> column(rows_);
+  for (size_t j = 0; j < cols_; ++j) {
+    for (size_t i = 0; i < rows_; ++i) {
+      column[i] = W(i, j);
+    }
+    scales_[j] = QuantizeRow8(column.data(), rows_, stride_, data_.data() + j * stride_);
+  }
+}
+
+
+QuantizedMatrix8::QuantizedMatrix8(size_t rows, size_t cols, const int8_t* data, const float* scales)
+  : rows_(rows),
+    cols_(cols),
+    stride_(Stride(rows)),
+    data_(data, data + cols_ * stride_),
+    scales_(scales, scales + cols_)
+{}
+
+
+size_t QuantizedMatrix8::Stride(size_t rows) {
+  return RoundUp(rows, ALIGN8);
+}
+
+
+QuantizedMatrix8::QuantizedMatrix8(const QuantizedMatrix8& other, const std::vector<size_t>& columns)
+  : rows_(other.rows_),
+    cols_(columns.size()),
+    stride_(other.stride_),
+    data_(cols_ * stride_),
+    scales_(cols_)
+{
+  for (size_t j = 0; j < cols_; ++j) {
+    std::copy(other.column(columns[j]), other.column(columns[j]) + stride_,
+              data_.begin() + j * stride_);
+    scales_[j] = other.scales_[columns[j]];
+  }
+}
+
+
+namespace {
+
+// quantized input, kept hot in cache while W is streamed once
+struct Input8 {
+  std::vector<int8_t> rows;
+  std::vector<float> scales;
+};
+
+const Input8& QuantizeInput8(const Matrix& In, const QuantizedMatrix8& W) {
+  amunmt_UTIL_THROW_IF2(In.columns() != W.rows(),
+                        "Int8Gemm: " << In.columns() << " input columns, " << W.rows() << " weight rows");
+
+  const size_t stride = W.stride();
+  thread_local Input8 input;
+  input.rows.resize(In.rows() * stride);
+  input.scales.resize(In.rows());
+  for (size_t i = 0; i < In.rows(); ++i) {
+    input.scales[i] = QuantizeRow8(&In(i, 0), In.columns(), stride, input.rows.data() + i * stride);
+  }
+  return input;
+}
+
+// columns [begin, end) of In * W + Bias, row r of them at out + r * outStride
+void Int8GemmColumns(const Input8& input, const QuantizedMatrix8& W, const float* bias,
+                     size_t begin, size_t end, float* out, size_t outStride)
+{
+  const size_t rows = input.scales.size();
+  const size_t stride = W.stride();
+
+  const int8_t* columns[COLUMN_BLOCK];
+  const int8_t* inRows[ROW_BLOCK];
+  int32_t sums[ROW_BLOCK][COLUMN_BLOCK];
+  for (size_t j = begin; j < end; j += COLUMN_BLOCK) {
+    size_t n = std::min(COLUMN_BLOCK, end - j);
+    for (size_t c = 0; c < n; ++c) {
+      columns[c] = W.column(j + c);
+    }
+    for (size_t i = 0; i < rows; i += ROW_BLOCK) {
+      size_t m = std::min(ROW_BLOCK, rows - i);
+      for (size_t r = 0; r < m; ++r) {
+        inRows[r] = input.rows.data() + (i + r) * stride;
+      }
+      Kernels().dot8(inRows, m, columns, n, stride, sums);
+      for (size_t r = 0; r < m; ++r) {
+        for (size_t c = 0; c < n; ++c) {
+          out[(i + r) * outStride + j - begin + c] =
+            sums[r][c] * input.scales[i + r] * W.scale(j + c) + bias[j + c];
+        }
+      }
+    }
+  }
+}
+
+}
+
+
+void Int8Gemm(const Matrix& In, const QuantizedMatrix8& W, const Matrix& Bias,
+              ArrayMatrix& Out)
+{
+  const Input8& input = QuantizeInput8(In, W);
+  Out.Resize(In.rows(), W.columns());
+  Int8GemmColumns(input, W, Bias.data(), 0, W.columns(), Out.data(), W.columns());
+}
+
+
+void Int8GemmTopK(const Matrix& In, const QuantizedMatrix8& W, const Matrix& Bias,
+                  LogSoftmaxTopK& topK)
+{
+  const Input8& input = QuantizeInput8(In, W);
+
+  // tiles of about 128KB, as GemmTopK
+  const size_t rows = In.rows();
+  const size_t cols = W.columns();
+  const size_t tileCols = std::max(RoundUp(32768 / std::max<size_t>(rows, 1), COLUMN_BLOCK),
+                                   size_t(256));
+
+  thread_local std::vector<float> tile;
+  tile.resize(rows * tileCols);
+  for (size_t j = 0; j < cols; j += tileCols) {
+    size_t n = std::min(tileCols, cols - j);
+    Int8GemmColumns(input, W, Bias.data(), j, j + n, tile.data(), n);
+    topK.Add(tile.data(), n, j, n);
+  }
+}
+
+
+QuantizedMatrix16::QuantizedMatrix16(const Matrix& W)
+  : rows_(W.rows()),
+    cols_(W.columns()),
+    stride_(RoundUp(W.rows(), ALIGN16)),
+    range_(Range16(stride_)),
+    data_(cols_ * stride_),
+    scales_(cols_)
+{
+  QuantizeColumns(W, 0);
+}
+
+
+QuantizedMatrix16::QuantizedMatrix16(const Matrix& a, const Matrix& b)
+  : rows_(a.rows()),
+    cols_(a.columns() + b.columns()),
+    stride_(RoundUp(a.rows(), ALIGN16)),
+    range_(Range16(stride_)),
+    data_(cols_ * stride_),
+    scales_(cols_)
+{
+  amunmt_UTIL_THROW_IF2(a.rows() != b.rows(),
+                        "QuantizedMatrix16: " << a.rows() << " vs " << b.rows() << " rows");
+  QuantizeColumns(a, 0);
+  QuantizeColumns(b, a.columns());
+}
+
+
+QuantizedMatrix16::QuantizedMatrix16(size_t rows, size_t cols, const int16_t* data, const float* scales)
+  : rows_(rows),
+    cols_(cols),
+    stride_(Stride(rows)),
+    range_(Range16(stride_)),
+    data_(data, data + cols_ * stride_),
+    scales_(scales, scales + cols_)
+{}
+
+
+size_t QuantizedMatrix16::Stride(size_t rows) {
+  return RoundUp(rows, ALIGN16);
+}
+
+
+void QuantizedMatrix16::QuantizeColumns(const Matrix& W, size_t offset) {
+  std::vector<float> column(rows_);
+  for (size_t j = 0; j < W.columns(); ++j) {
+    for (size_t i = 0; i < rows_; ++i) {
+      column[i] = W(i, j);
+    }
+    scales_[offset + j] = QuantizeRow(column.data(), rows_, stride_, range_,
+                                      data_.data() + (offset + j) * stride_);
+  }
+}
+
+
+void Int16Gemm(const Matrix& In, const QuantizedMatrix16& W, Matrix& Out)
+{
+  amunmt_UTIL_THROW_IF2(In.columns() != W.rows(),
+                        "Int16Gemm: " << In.columns() << " input columns, " << W.rows() << " weight rows");
+
+  const size_t rows = In.rows();
+  const size_t cols = W.columns();
+  const size_t stride = W.stride();
+
+  thread_local std::vector<int16_t> quantized;
+  thread_local std::vector<float> inScales;
+  quantized.resize(rows * stride);
+  inScales.resize(rows);
+  for (size_t i = 0; i < rows; ++i) {
+    inScales[i] = QuantizeRow(&In(i, 0), In.columns(), stride, W.range(),
+                              quantized.data() + i * stride);
+  }
+
+  Out.resize(rows, cols);
+
+  const int16_t* columns[COLUMN_BLOCK];
+  const int16_t* inRows[ROW_BLOCK];
+  int32_t sums[ROW_BLOCK][COLUMN_BLOCK];
+  for (size_t j = 0; j < cols; j += COLUMN_BLOCK) {
+    size_t n = std::min(COLUMN_BLOCK, cols - j);
+    for (size_t c = 0; c < n; ++c) {
+      columns[c] = W.column(j + c);
+    }
+    for (size_t i = 0; i < rows; i += ROW_BLOCK) {
+      size_t m = std::min(ROW_BLOCK, rows - i);
+      for (size_t r = 0; r < m; ++r) {
+        inRows[r] = quantized.data() + (i + r) * stride;
+      }
+      Kernels().dot16(inRows, m, columns, n, stride, sums);
+      for (size_t r = 0; r < m; ++r) {
+        for (size_t c = 0; c < n; ++c) {
+          Out(i + r, j + c) = sums[r][c] * inScales[i + r] * W.scale(j + c);
+        }
+      }
+    }
+  }
+}
+
+}
+}
+}
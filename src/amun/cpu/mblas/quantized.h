@@ -0,0 +1,176 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "cpu/mblas/matrix.h"
+#include "cpu/mblas/packed.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+class LogSoftmaxTopK;
+
+// How a model keeps its weights, decided when it is loaded
+struct QuantizationOptions {
+  bool int8Output = false;  // output layer
+  bool int16 = false;       // recurrent and attention matrices
+  // fp32 output layer stored by target word, only for --softmax-filter
+  bool vocabMajorOutput = false;
+
+  bool operator!=(const QuantizationOptions& other) const {
+    return int8Output != other.int8Output || int16 != other.int16
+        || vocabMajorOutput != other.vocabMajorOutput;
+  }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Weight matrix quantized to int8 with one scale per column, prepared once
+// at model load. Stored transposed, column j of the original matrix is the
+// contiguous row j here, padded with zeros to a multiple of 32 values so
+// the kernels need no tail handling. Values are in [-127, 127].
+class QuantizedMatrix8 {
+  public:
+    QuantizedMatrix8()
+      : rows_(0), cols_(0), stride_(0)
+    {}
+
+    explicit QuantizedMatrix8(const Matrix& W);
+
+    // only the given columns, for a filtered target vocabulary
+    QuantizedMatrix8(const QuantizedMatrix8& other, const std::vector<size_t>& columns);
+
+    // the stored form, columns x stride() values and a scale per column,
+    // as written to a native model file
+    QuantizedMatrix8(size_t rows, size_t cols, const int8_t* data, const float* scales);
+
+    // stride() of a matrix with the given number of rows
+    static size_t Stride(size_t rows);
+
+    size_t rows() const {
+      return rows_;
+    }
+
+    size_t columns() const {
+      return cols_;
+    }
+
+    size_t stride() const {
+      return stride_;
+    }
+
+    bool empty() const {
+      return cols_ == 0;
+    }
+
+    const int8_t* column(size_t j) const {
+      return data_.data() + j * stride_;
+    }
+
+    float scale(size_t j) const {
+      return scales_[j];
+    }
+
+    const float* scales() const {
+      return scales_.data();
+    }
+
+  private:
+    size_t rows_;
+    size_t cols_;
+    size_t stride_;
+    std::vector<int8_t> data_;
+    std::vector<float> scales_;
+};
+
+// Out = In * W + Bias with W quantized to int8. The rows of In are quantized
+// on the fly with one scale per row, products are accumulated in int32 and
+// scaled back to fp32 together with the bias.
+void Int8Gemm(const Matrix& In, const QuantizedMatrix8& W, const Matrix& Bias,
+              ArrayMatrix& Out);
+
+// topK of the same product, computed a tile of columns at a time as GemmTopK
+void Int8GemmTopK(const Matrix& In, const QuantizedMatrix8& W, const Matrix& Bias,
+                  LogSoftmaxTopK& topK);
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Weight matrix quantized to int16 with one scale per column, same layout
+// as QuantizedMatrix8. Values are limited to +-range() so that a full dot
+// product of two quantized vectors cannot overflow int32.
+class QuantizedMatrix16 {
+  public:
+    QuantizedMatrix16()
+      : rows_(0), cols_(0), stride_(0), range_(0)
+    {}
+
+    explicit QuantizedMatrix16(const Matrix& W);
+
+    // the columns of a followed by the columns of b
+    QuantizedMatrix16(const Matrix& a, const Matrix& b);
+
+    // the stored form, as for QuantizedMatrix8
+    QuantizedMatrix16(size_t rows, size_t cols, const int16_t* data, const float* scales);
+
+    static size_t Stride(size_t rows);
+
+    size_t rows() const {
+      return rows_;
+    }
+
+    size_t columns() const {
+      return cols_;
+    }
+
+    size_t stride() const {
+      return stride_;
+    }
+
+    float range() const {
+      return range_;
+    }
+
+    bool empty() const {
+      return cols_ == 0;
+    }
+
+    const int16_t* column(size_t j) const {
+      return data_.data() + j * stride_;
+    }
+
+    float scale(size_t j) const {
+      return scales_[j];
+    }
+
+    const float* scales() const {
+      return scales_.data();
+    }
+
+  private:
+    void QuantizeColumns(const Matrix& W, size_t offset);
+
+    size_t rows_;
+    size_t cols_;
+    size_t stride_;
+    float range_;
+    std::vector<int16_t> data_;
+    std::vector<float> scales_;
+};
+
+// Out = In * W with W quantized to int16, the rows of In are quantized on
+// the fly with the same range.
+void Int16Gemm(const Matrix& In, const QuantizedMatrix16& W, Matrix& Out);
+
+// Out = In * W, through the int16 kernel if the model keeps W quantized as Wq
+inline void Multiply(Matrix& Out, const Matrix& In, const PackedMatrix& W, const QuantizedMatrix16& Wq) {
+  if (Wq.empty()) {
+    PackedGemm(In, W, Out);
+  } else {
+    Int16Gemm(In, Wq, Out);
+  }
+}
+
+}
+}
+}
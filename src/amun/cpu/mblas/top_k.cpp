@@ -0,0 +1,109 @@
+#include "cpu/mblas/top_k.h"
+
+#include <algorithm>
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+namespace {
+
+const size_t CHUNK_SIZE = 16;
+
+// logits per tile, about 128KB
+const size_t TILE_SIZE = 32768;
+
+struct Better {
+  template <class Entry>
+  bool operator()(const Entry& a, const Entry& b) const {
+    return a.cost > b.cost || (a.cost == b.cost && a.word < b.word);
+  }
+};
+
+}
+
+void LogSoftmaxTopK::Begin(size_t rows, size_t cols, size_t k, size_t maskedColumn) {
+  rows_ = rows;
+  k_ = std::min(k, maskedColumn < cols ? cols - 1 : cols);
+  maskedColumn_ = maskedColumn;
+
+  heaps_.resize(rows_ * k_);
+  sizes_.assign(rows_, 0);
+  sums_.assign(rows_, 0.0f);
+}
+
+inline void LogSoftmaxTopK::Push(size_t row, float cost, size_t word) {
+  Entry entry = {cost, word};
+  auto begin = heaps_.begin() + row * k_;
+  size_t& size = sizes_[row];
+  if (size < k_) {
+    begin[size++] = entry;
+    std::push_heap(begin, begin + size, Better());
+  } else if (Better()(entry, begin[0])) {
+    std::pop_heap(begin, begin + size, Better());
+    begin[size - 1] = entry;
+    std::push_heap(begin, begin + size, Better());
+  }
+}
+
+void LogSoftmaxTopK::Add(const float* tile, size_t stride, size_t col, size_t n) {
+  if (k_ == 0) {
+    return;
+  }
+  for (size_t r = 0; r < rows_; ++r) {
+    const float* row = tile + r * stride;
+    sums_[r] += RowSumExp(row, n);
+
+    for (size_t c = 0; c < n; c += CHUNK_SIZE) {
+      const size_t m = std::min(CHUNK_SIZE, n - c);
+      // words come in increasing order, so an equal cost never wins the tie
+      if (sizes_[r] == k_ && RowMax(row + c, m) <= heaps_[r * k_].cost) {
+        continue;
+      }
+      for (size_t i = 0; i < m; ++i) {
+        if (col + c + i != maskedColumn_) {
+          Push(r, row[c + i], col + c + i);
+        }
+      }
+    }
+  }
+}
+
+void LogSoftmaxTopK::Finish(std::vector<size_t>& words, std::vector<float>& costs) {
+  words.resize(rows_ * k_);
+  costs.resize(rows_ * k_);
+  for (size_t r = 0; r < rows_; ++r) {
+    auto begin = heaps_.begin() + r * k_;
+    std::sort_heap(begin, begin + k_, Better());
+
+    // as LogSoftmax
+    float shift = -logapprox(sums_[r]);
+    for (size_t i = 0; i < k_; ++i) {
+      words[r * k_ + i] = begin[i].word;
+      costs[r * k_ + i] = begin[i].cost + shift;
+    }
+  }
+}
+
+void GemmTopK(const Matrix& In, const PackedMatrix& W, const Matrix& Bias, LogSoftmaxTopK& topK) {
+  static_assert(CHUNK_SIZE % PackedMatrix::PANEL_WIDTH == 0, "tiles start at a panel");
+  const size_t rows = In.rows();
+  const size_t cols = W.columns();
+  const size_t tileCols = std::max(TILE_SIZE / std::max<size_t>(rows, 1) / CHUNK_SIZE, size_t(16))
+                          * CHUNK_SIZE;
+
+  thread_local Matrix tile;
+  for (size_t c = 0; c < cols; c += tileCols) {
+    const size_t n = std::min(tileCols, cols - c);
+    tile.resize(rows, n, false);
+    PackedGemm(In, W, c, n, tile.data(), tile.spacing());
+    for (size_t r = 0; r < rows; ++r) {
+      blaze::row(tile, r) += blaze::subvector(blaze::row(Bias, 0), c, n);
+    }
+    topK.Add(tile.data(), tile.spacing(), c, n);
+  }
+}
+
+}
+}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "cpu/mblas/matrix.h"
+#include "cpu/mblas/packed.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// The k best words of every row of a log-softmax, without the rows x
+// vocabulary matrix. The logits are passed in tiles of columns right after
+// they are computed. Every row keeps the running sum of exp(logit) for its
+// normalizer and a min-heap of its k largest logits; the normalizer is only
+// applied to those k at the end. Beam search over a single model never
+// needs more of a row than its beam size best words.
+class LogSoftmaxTopK {
+  public:
+    LogSoftmaxTopK()
+      : rows_(0), k_(0), maskedColumn_(0)
+    {}
+
+    LogSoftmaxTopK(const LogSoftmaxTopK&) = delete;
+
+    // rows x cols logits follow, column maskedColumn (if < cols) never wins
+    void Begin(size_t rows, size_t cols, size_t k, size_t maskedColumn);
+
+    // columns [col, col + n) of all rows, row r starts at tile + r * stride
+    void Add(const float* tile, size_t stride, size_t col, size_t n);
+
+    // min(k, cols) entries per row, those of row r start at r * min(k, cols).
+    // Sorted best first, ties are broken by the smaller word; costs are
+    // log-probabilities.
+    void Finish(std::vector<size_t>& words, std::vector<float>& costs);
+
+  private:
+    struct Entry {
+      float cost;
+      size_t word;
+    };
+
+    void Push(size_t row, float cost, size_t word);
+
+    size_t rows_;
+    size_t k_;
+    size_t maskedColumn_;
+
+    // k_ entries per row, sizes_[r] of them in use
+    std::vector<Entry> heaps_;
+    std::vector<size_t> sizes_;
+    std::vector<float> sums_;
+};
+
+// topK of In * W + Bias. W is multiplied a tile of columns at a time, small
+// enough for the tile of logits to be still in the cache when it is scanned.
+void GemmTopK(const Matrix& In, const PackedMatrix& W, const Matrix& Bias, LogSoftmaxTopK& topK);
+
+}
+}
+}
@@ -0,0 +1,106 @@
+#include "cpu/mblas/vector_math_impl.h"
+
+#include <cstdint>
+
+#include "common/logging.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AMUN_X86
+#include <emmintrin.h>
+#endif
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+namespace {
+
+#ifdef AMUN_X86
+
+// SSE2 is part of every x86-64 CPU
+struct Sse2 {
+  typedef __m128 F;
+  typedef __m128i I;
+  static const size_t width = 4;
+
+  static F Set1(float v) { return _mm_set1_ps(v); }
+  static F Zero() { return _mm_setzero_ps(); }
+  static F Load(const float* p) { return _mm_loadu_ps(p); }
+  static void Store(float* p, F v) { _mm_storeu_ps(p, v); }
+  static F Add(F a, F b) { return _mm_add_ps(a, b); }
+  static F Sub(F a, F b) { return _mm_sub_ps(a, b); }
+  static F Mul(F a, F b) { return _mm_mul_ps(a, b); }
+  static F Div(F a, F b) { return _mm_div_ps(a, b); }
+  static F Min(F a, F b) { return _mm_min_ps(a, b); }
+  static F Max(F a, F b) { return _mm_max_ps(a, b); }
+  static F MulAdd(F a, F b, F c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+  static I Truncate(F v) { return _mm_cvttps_epi32(v); }
+  static I And(I v, int m) { return _mm_and_si128(v, _mm_set1_epi32(m)); }
+  static I Or(I v, int m) { return _mm_or_si128(v, _mm_set1_epi32(m)); }
+  static F AsFloat(I v) { return _mm_castsi128_ps(v); }
+};
+
+typedef Sse2 Generic;
+
+#else
+
+struct Scalar {
+  typedef float F;
+  typedef int32_t I;
+  static const size_t width = 1;
+
+  static F Set1(float v) { return v; }
+  static F Zero() { return 0.0f; }
+  static F Load(const float* p) { return *p; }
+  static void Store(float* p, F v) { *p = v; }
+  static F Add(F a, F b) { return a + b; }
+  static F Sub(F a, F b) { return a - b; }
+  static F Mul(F a, F b) { return a * b; }
+  static F Div(F a, F b) { return a / b; }
+  static F Min(F a, F b) { return a < b ? a : b; }
+  static F Max(F a, F b) { return a > b ? a : b; }
+  static F MulAdd(F a, F b, F c) { return a * b + c; }
+  static I Truncate(F v) { return (I)v; }
+  static I And(I v, int m) { return v & m; }
+  static I Or(I v, int m) { return v | m; }
+  static F AsFloat(I v) { F f; __builtin_memcpy(&f, &v, sizeof(f)); return f; }
+};
+
+typedef Scalar Generic;
+
+#endif
+
+const VectorKernels* SelectKernels() {
+  const VectorKernels* kernels = GenericKernels();
+#ifdef AMUN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    kernels = Avx512Kernels();
+  } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    kernels = Avx2Kernels();
+  }
+#endif
+  LOG(info)->info("CPU element-wise kernels: {}, quantized GEMM kernels: {}",
+                  kernels->isa, kernels->quantizedIsa);
+  return kernels;
+}
+
+}
+
+const VectorKernels* GenericKernels() {
+#ifdef AMUN_X86
+  static const VectorKernels kernels = MakeKernels<Generic>("sse2");
+#else
+  static const VectorKernels kernels = MakeKernels<Generic>("scalar");
+#endif
+  return &kernels;
+}
+
+const VectorKernels& Kernels() {
+  static const VectorKernels* kernels = SelectKernels();
+  return *kernels;
+}
+
+}
+}
+}
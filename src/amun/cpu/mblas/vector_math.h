@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+// Element-wise kernels on contiguous rows of floats. They use the same
+// approximations as phoenix_functions.h, computed 4, 8 or 16 lanes at a
+// time. The instruction set (SSE2, AVX2+FMA or AVX-512F) is picked once at
+// runtime from what the CPU supports, not from the build flags. So are the
+// integer dot products of the int8 and int16 GEMMs in quantized.cpp, which
+// may also use AVX-512BW and AVX-512 VNNI.
+
+// Inputs of one GRU step for a row of n units, the gates are
+//   r = sigmoid(ruInput[i]     + ruBias[i]     + ruState[i])
+//   u = sigmoid(ruInput[n + i] + ruBias[n + i] + ruState[n + i])
+//   h = tanh(hInput[i] + hInputBias[i] + r * (hState[i] + hStateBias[i]))
+//   out[i] = (1 - u) * h + u * state[i]
+// Null pointers count as zeros, except for ruState and hState.
+struct GRUGates {
+  const float* ruInput = nullptr;
+  const float* ruBias = nullptr;
+  const float* ruState = nullptr;
+  const float* hInput = nullptr;
+  const float* hInputBias = nullptr;
+  const float* hState = nullptr;
+  const float* hStateBias = nullptr;
+};
+
+// Blocking of the quantized GEMMs: up to QUANTIZED_ROW_BLOCK rows of the
+// input times up to QUANTIZED_COLUMN_BLOCK columns of the weights at a time,
+// all of them padded with zeros to a multiple of QUANTIZED_ALIGN values.
+const size_t QUANTIZED_ROW_BLOCK = 3;
+const size_t QUANTIZED_COLUMN_BLOCK = 4;
+const size_t QUANTIZED_ALIGN = 32;
+
+struct VectorKernels {
+  const char* isa;
+  const char* quantizedIsa;
+
+  float (*max)(const float* in, size_t n);
+  // out = exp(in - shift), returns the sum of out; out may be in
+  float (*expSum)(const float* in, float* out, size_t n, float shift);
+  // sum of exp(in)
+  float (*sumExp)(const float* in, size_t n);
+  void (*scale)(float* x, size_t n, float factor);
+  void (*add)(float* x, size_t n, float value);
+  void (*exp)(const float* in, float* out, size_t n);
+  void (*tanh)(const float* in, float* out, size_t n);
+  void (*sigmoid)(const float* in, float* out, size_t n);
+  // x = gamma * (x - mean) / sigma + beta, beta may be null
+  void (*layerNorm)(float* x, size_t n, const float* gamma, const float* beta, float eps);
+  // out may be state
+  void (*gru)(const GRUGates& gates, const float* state, float* out, size_t n);
+  // scores[r * scoresStride + s] = v . tanh(context[s] + hidden[r]) for all
+  // source rows s < words and hypotheses r < hyps, rows have dim values
+  void (*attentionScores)(const float* context, size_t contextStride, size_t words,
+                          const float* hidden, size_t hiddenStride, size_t hyps,
+                          const float* v, size_t dim, float* scores, size_t scoresStride);
+  // out = in * W for rows x depth in and W packed into panels of
+  // PACKED_PANEL_WIDTH columns, panel after panel, each depth rows of
+  // PACKED_PANEL_WIDTH values; see PackedMatrix
+  void (*packedGemm)(const float* in, size_t inStride, size_t rows, size_t depth,
+                     const float* panels, size_t cols, float* out, size_t outStride);
+  // out[r][c] = a[r] . b[c] for r < rows and c < cols, over stride values.
+  // The int8 values are never -128.
+  void (*dot8)(const int8_t* const* a, size_t rows, const int8_t* const* b, size_t cols,
+               size_t stride, int32_t (*out)[QUANTIZED_COLUMN_BLOCK]);
+  void (*dot16)(const int16_t* const* a, size_t rows, const int16_t* const* b, size_t cols,
+                size_t stride, int32_t (*out)[QUANTIZED_COLUMN_BLOCK]);
+};
+
+const size_t PACKED_PANEL_WIDTH = 16;
+
+const VectorKernels& Kernels();
+
+inline float RowMax(const float* in, size_t n) {
+  return Kernels().max(in, n);
+}
+
+inline float RowExpSum(const float* in, float* out, size_t n, float shift) {
+  return Kernels().expSum(in, out, n, shift);
+}
+
+inline float RowSumExp(const float* in, size_t n) {
+  return Kernels().sumExp(in, n);
+}
+
+inline void RowScale(float* x, size_t n, float factor) {
+  Kernels().scale(x, n, factor);
+}
+
+inline void RowAdd(float* x, size_t n, float value) {
+  Kernels().add(x, n, value);
+}
+
+inline void RowExp(const float* in, float* out, size_t n) {
+  Kernels().exp(in, out, n);
+}
+
+inline void RowTanh(const float* in, float* out, size_t n) {
+  Kernels().tanh(in, out, n);
+}
+
+inline void RowSigmoid(const float* in, float* out, size_t n) {
+  Kernels().sigmoid(in, out, n);
+}
+
+inline void RowLayerNorm(float* x, size_t n, const float* gamma, const float* beta, float eps) {
+  Kernels().layerNorm(x, n, gamma, beta, eps);
+}
+
+inline void GRUStep(const GRUGates& gates, const float* state, float* out, size_t n) {
+  Kernels().gru(gates, state, out, n);
+}
+
+inline void AttentionScores(const float* context, size_t contextStride, size_t words,
+                            const float* hidden, size_t hiddenStride, size_t hyps,
+                            const float* v, size_t dim, float* scores, size_t scoresStride) {
+  Kernels().attentionScores(context, contextStride, words, hidden, hiddenStride, hyps,
+                            v, dim, scores, scoresStride);
+}
+
+}
+}
+}
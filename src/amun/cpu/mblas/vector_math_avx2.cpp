@@ -0,0 +1,156 @@
+// Compiled with -mavx2 -mfma, only called after a runtime check
+
+#include "cpu/mblas/vector_math_impl.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+namespace {
+
+struct Avx2 {
+  typedef __m256 F;
+  typedef __m256i I;
+  static const size_t width = 8;
+
+  static F Set1(float v) { return _mm256_set1_ps(v); }
+  static F Zero() { return _mm256_setzero_ps(); }
+  static F Load(const float* p) { return _mm256_loadu_ps(p); }
+  static void Store(float* p, F v) { _mm256_storeu_ps(p, v); }
+  static F Add(F a, F b) { return _mm256_add_ps(a, b); }
+  static F Sub(F a, F b) { return _mm256_sub_ps(a, b); }
+  static F Mul(F a, F b) { return _mm256_mul_ps(a, b); }
+  static F Div(F a, F b) { return _mm256_div_ps(a, b); }
+  static F Min(F a, F b) { return _mm256_min_ps(a, b); }
+  static F Max(F a, F b) { return _mm256_max_ps(a, b); }
+  static F MulAdd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+  static I Truncate(F v) { return _mm256_cvttps_epi32(v); }
+  static I And(I v, int m) { return _mm256_and_si256(v, _mm256_set1_epi32(m)); }
+  static I Or(I v, int m) { return _mm256_or_si256(v, _mm256_set1_epi32(m)); }
+  static F AsFloat(I v) { return _mm256_castsi256_ps(v); }
+};
+
+inline int32_t HorizontalSum(__m256i v) {
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum);
+}
+
+// a * b for signed a and b as |a| * (b with the sign of a), which is the
+// unsigned * signed product maddubs provides. Neither side is -128, so the
+// int16 pair sums cannot saturate.
+template <size_t R>
+void Dot8(const int8_t* const* a, const int8_t* const* b, size_t n, size_t stride,
+          int32_t (*out)[QUANTIZED_COLUMN_BLOCK]) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i acc[R][QUANTIZED_COLUMN_BLOCK];
+  for (size_t r = 0; r < R; ++r) {
+    for (size_t c = 0; c < QUANTIZED_COLUMN_BLOCK; ++c) {
+      acc[r][c] = _mm256_setzero_si256();
+    }
+  }
+  for (size_t k = 0; k < stride; k += 32) {
+    __m256i va[R];
+    __m256i absA[R];
+    for (size_t r = 0; r < R; ++r) {
+      va[r] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a[r] + k));
+      absA[r] = _mm256_sign_epi8(va[r], va[r]);
+    }
+    for (size_t c = 0; c < n; ++c) {
+      __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b[c] + k));
+      for (size_t r = 0; r < R; ++r) {
+        __m256i pairs = _mm256_maddubs_epi16(absA[r], _mm256_sign_epi8(vb, va[r]));
+        acc[r][c] = _mm256_add_epi32(acc[r][c], _mm256_madd_epi16(pairs, ones));
+      }
+    }
+  }
+  for (size_t r = 0; r < R; ++r) {
+    for (size_t c = 0; c < n; ++c) {
+      out[r][c] = HorizontalSum(acc[r][c]);
+    }
+  }
+}
+
+template <size_t R>
+void Dot16(const int16_t* const* a, const int16_t* const* b, size_t n, size_t stride,
+           int32_t (*out)[QUANTIZED_COLUMN_BLOCK]) {
+  __m256i acc[R][QUANTIZED_COLUMN_BLOCK];
+  for (size_t r = 0; r < R; ++r) {
+    for (size_t c = 0; c < QUANTIZED_COLUMN_BLOCK; ++c) {
+      acc[r][c] = _mm256_setzero_si256();
+    }
+  }
+  for (size_t k = 0; k < stride; k += 16) {
+    __m256i va[R];
+    for (size_t r = 0; r < R; ++r) {
+      va[r] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a[r] + k));
+    }
+    for (size_t c = 0; c < n; ++c) {
+      __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b[c] + k));
+      for (size_t r = 0; r < R; ++r) {
+        acc[r][c] = _mm256_add_epi32(acc[r][c], _mm256_madd_epi16(va[r], vb));
+      }
+    }
+  }
+  for (size_t r = 0; r < R; ++r) {
+    for (size_t c = 0; c < n; ++c) {
+      out[r][c] = HorizontalSum(acc[r][c]);
+    }
+  }
+}
+
+static_assert(QUANTIZED_ROW_BLOCK == 3, "Dot8Rows and Dot16Rows handle up to 3 rows");
+
+// every loaded value of a is used n times and every one of b rows times
+void Dot8Rows(const int8_t* const* a, size_t rows, const int8_t* const* b, size_t n,
+              size_t stride, int32_t (*out)[QUANTIZED_COLUMN_BLOCK]) {
+  switch (rows) {
+    case 3: Dot8<3>(a, b, n, stride, out); break;
+    case 2: Dot8<2>(a, b, n, stride, out); break;
+    default: Dot8<1>(a, b, n, stride, out); break;
+  }
+}
+
+void Dot16Rows(const int16_t* const* a, size_t rows, const int16_t* const* b, size_t n,
+               size_t stride, int32_t (*out)[QUANTIZED_COLUMN_BLOCK]) {
+  switch (rows) {
+    case 3: Dot16<3>(a, b, n, stride, out); break;
+    case 2: Dot16<2>(a, b, n, stride, out); break;
+    default: Dot16<1>(a, b, n, stride, out); break;
+  }
+}
+
+VectorKernels MakeAvx2Kernels() {
+  VectorKernels kernels = MakeKernels<Avx2>("avx2");
+  kernels.quantizedIsa = "avx2";
+  kernels.dot8 = &Dot8Rows;
+  kernels.dot16 = &Dot16Rows;
+  return kernels;
+}
+
+}
+
+const VectorKernels* Avx2Kernels() {
+  static const VectorKernels kernels = MakeAvx2Kernels();
+  return &kernels;
+}
+
+#else
+
+// compiler without AVX2 support
+const VectorKernels* Avx2Kernels() {
+  return GenericKernels();
+}
+
+#endif
+
+}
+}
+}
@@ -0,0 +1,178 @@
+// Compiled with -mavx512f, only called after a runtime check
+
+#include "cpu/mblas/vector_math_impl.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+#if defined(__AVX512F__)
+
+namespace {
+
+struct Avx512 {
+  typedef __m512 F;
+  typedef __m512i I;
+  static const size_t width = 16;
+
+  static F Set1(float v) { return _mm512_set1_ps(v); }
+  static F Zero() { return _mm512_setzero_ps(); }
+  static F Load(const float* p) { return _mm512_loadu_ps(p); }
+  static void Store(float* p, F v) { _mm512_storeu_ps(p, v); }
+  static F Add(F a, F b) { return _mm512_add_ps(a, b); }
+  static F Sub(F a, F b) { return _mm512_sub_ps(a, b); }
+  static F Mul(F a, F b) { return _mm512_mul_ps(a, b); }
+  static F Div(F a, F b) { return _mm512_div_ps(a, b); }
+  static F Min(F a, F b) { return _mm512_min_ps(a, b); }
+  static F Max(F a, F b) { return _mm512_max_ps(a, b); }
+  static F MulAdd(F a, F b, F c) { return _mm512_fmadd_ps(a, b, c); }
+  static I Truncate(F v) { return _mm512_cvttps_epi32(v); }
+  static I And(I v, int m) { return _mm512_and_si512(v, _mm512_set1_epi32(m)); }
+  static I Or(I v, int m) { return _mm512_or_si512(v, _mm512_set1_epi32(m)); }
+  static F AsFloat(I v) { return _mm512_castsi512_ps(v); }
+};
+
+inline int32_t HorizontalSum(__m256i v) {
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum);
+}
+
+inline int32_t HorizontalSum(__m512i v) {
+  return HorizontalSum(_mm256_add_epi32(_mm512_castsi512_si256(v), _mm512_extracti64x4_epi64(v, 1)));
+}
+
+// AVX-512F alone has no 8 or 16-bit arithmetic, these two are only used
+// when __builtin_cpu_supports says so
+#pragma GCC push_options
+#pragma GCC target("avx512bw")
+
+template <size_t R>
+void Dot16(const int16_t* const* a, const int16_t* const* b, size_t n, size_t stride,
+           int32_t (*out)[QUANTIZED_COLUMN_BLOCK]) {
+  __m512i acc[R][QUANTIZED_COLUMN_BLOCK];
+  for (size_t r = 0; r < R; ++r) {
+    for (size_t c = 0; c < QUANTIZED_COLUMN_BLOCK; ++c) {
+      acc[r][c] = _mm512_setzero_si512();
+    }
+  }
+  for (size_t k = 0; k < stride; k += 32) {
+    __m512i va[R];
+    for (size_t r = 0; r < R; ++r) {
+      va[r] = _mm512_loadu_si512(a[r] + k);
+    }
+    for (size_t c = 0; c < n; ++c) {
+      __m512i vb = _mm512_loadu_si512(b[c] + k);
+      for (size_t r = 0; r < R; ++r) {
+        acc[r][c] = _mm512_add_epi32(acc[r][c], _mm512_madd_epi16(va[r], vb));
+      }
+    }
+  }
+  for (size_t r = 0; r < R; ++r) {
+    for (size_t c = 0; c < n; ++c) {
+      out[r][c] = HorizontalSum(acc[r][c]);
+    }
+  }
+}
+
+void Dot16Rows(const int16_t* const* a, size_t rows, const int16_t* const* b, size_t n,
+               size_t stride, int32_t (*out)[QUANTIZED_COLUMN_BLOCK]) {
+  switch (rows) {
+    case 3: Dot16<3>(a, b, n, stride, out); break;
+    case 2: Dot16<2>(a, b, n, stride, out); break;
+    default: Dot16<1>(a, b, n, stride, out); break;
+  }
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512vl,avx512vnni")
+
+// as the AVX2 Dot8, |a| * (b with the sign of a), but summed into int32 in
+// one instruction
+template <size_t R>
+void Dot8(const int8_t* const* a, const int8_t* const* b, size_t n, size_t stride,
+          int32_t (*out)[QUANTIZED_COLUMN_BLOCK]) {
+  __m256i acc[R][QUANTIZED_COLUMN_BLOCK];
+  for (size_t r = 0; r < R; ++r) {
+    for (size_t c = 0; c < QUANTIZED_COLUMN_BLOCK; ++c) {
+      acc[r][c] = _mm256_setzero_si256();
+    }
+  }
+  for (size_t k = 0; k < stride; k += 32) {
+    __m256i va[R];
+    __m256i absA[R];
+    for (size_t r = 0; r < R; ++r) {
+      va[r] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a[r] + k));
+      absA[r] = _mm256_sign_epi8(va[r], va[r]);
+    }
+    for (size_t c = 0; c < n; ++c) {
+      __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b[c] + k));
+      for (size_t r = 0; r < R; ++r) {
+        acc[r][c] = _mm256_dpbusd_epi32(acc[r][c], absA[r], _mm256_sign_epi8(vb, va[r]));
+      }
+    }
+  }
+  for (size_t r = 0; r < R; ++r) {
+    for (size_t c = 0; c < n; ++c) {
+      out[r][c] = HorizontalSum(acc[r][c]);
+    }
+  }
+}
+
+void Dot8Rows(const int8_t* const* a, size_t rows, const int8_t* const* b, size_t n,
+              size_t stride, int32_t (*out)[QUANTIZED_COLUMN_BLOCK]) {
+  switch (rows) {
+    case 3: Dot8<3>(a, b, n, stride, out); break;
+    case 2: Dot8<2>(a, b, n, stride, out); break;
+    default: Dot8<1>(a, b, n, stride, out); break;
+  }
+}
+
+#pragma GCC pop_options
+
+static_assert(QUANTIZED_ROW_BLOCK == 3, "Dot8Rows and Dot16Rows handle up to 3 rows");
+
+// the AVX2 quantized kernels unless AVX-512BW or VNNI are there as well
+VectorKernels MakeAvx512Kernels() {
+  VectorKernels kernels = MakeKernels<Avx512>("avx512");
+  const VectorKernels* avx2 = Avx2Kernels();
+  kernels.quantizedIsa = avx2->quantizedIsa;
+  kernels.dot8 = avx2->dot8;
+  kernels.dot16 = avx2->dot16;
+  if (__builtin_cpu_supports("avx512bw")) {
+    kernels.quantizedIsa = "avx512bw";
+    kernels.dot16 = &Dot16Rows;
+  }
+  if (__builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512vnni")) {
+    kernels.quantizedIsa = "avx512vnni";
+    kernels.dot8 = &Dot8Rows;
+  }
+  return kernels;
+}
+
+}
+
+const VectorKernels* Avx512Kernels() {
+  static const VectorKernels kernels = MakeAvx512Kernels();
+  return &kernels;
+}
+
+#else
+
+// compiler without AVX-512 support
+const VectorKernels* Avx512Kernels() {
+  return Avx2Kernels();
+}
+
+#endif
+
+}
+}
+}
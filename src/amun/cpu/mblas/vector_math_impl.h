@@ -0,0 +1,426 @@
+#pragma once
+
+// Kernel bodies shared by the per instruction set translation units. Each
+// of them defines a struct V wrapping its intrinsics and calls
+// MakeKernels<V>(). Everything here has internal linkage and calls nothing
+// but intrinsics and builtins: an inline function with external linkage
+// compiled for AVX-512 could otherwise be picked by the linker for the
+// whole binary.
+
+#include "vector_math.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+const VectorKernels* GenericKernels();
+const VectorKernels* Avx2Kernels();
+const VectorKernels* Avx512Kernels();
+
+namespace {
+
+template <class V>
+struct KernelsImpl {
+  typedef typename V::F F;
+  static const size_t W = V::width;
+
+  // expapprox
+  static F Exp(F x) {
+    F v = V::MulAdd(V::Set1(12102203.1615614f), x, V::Set1(1065353216.f));
+    v = V::Max(V::Min(v, V::Set1(2139095040.f)), V::Zero());
+    typename V::I i = V::Truncate(v);
+    F xu = V::AsFloat(V::And(i, 0x7F800000));
+    F b = V::AsFloat(V::Or(V::And(i, 0x7FFFFF), 0x3F800000));
+
+    F p = V::MulAdd(b, V::Set1(1.3671023382430374383648148e-2f),
+                    V::Set1(-2.88093587581985443087955e-3f));
+    p = V::MulAdd(b, p, V::Set1(0.168143436463395944830000f));
+    p = V::MulAdd(b, p, V::Set1(0.310670891004095530771135f));
+    p = V::MulAdd(b, p, V::Set1(0.510397365625862338668154f));
+    return V::Mul(xu, p);
+  }
+
+  // tanhapprox
+  static F Tanh(F x) {
+    x = V::Max(V::Min(x, V::Set1(4.97f)), V::Set1(-4.97f));
+    F x2 = V::Mul(x, x);
+    F a = V::Add(x2, V::Set1(378.0f));
+    a = V::MulAdd(x2, a, V::Set1(17325.0f));
+    a = V::MulAdd(x2, a, V::Set1(135135.0f));
+    a = V::Mul(x, a);
+    F b = V::MulAdd(x2, V::Set1(28.0f), V::Set1(3150.0f));
+    b = V::MulAdd(x2, b, V::Set1(62370.0f));
+    b = V::MulAdd(x2, b, V::Set1(135135.0f));
+    return V::Div(a, b);
+  }
+
+  static F Sigmoid(F x) {
+    F one = V::Set1(1.0f);
+    return V::Div(one, V::Add(one, Exp(V::Sub(V::Zero(), x))));
+  }
+
+  // count values from p + i, the rest of the lanes are zero;
+  // a null p reads as zeros
+  static F Get(const float* p, size_t i, size_t count) {
+    if (!p) {
+      return V::Zero();
+    }
+    if (count == W) {
+      return V::Load(p + i);
+    }
+    float buf[W];
+    for (size_t k = 0; k < W; ++k) {
+      buf[k] = k < count ? p[i + k] : 0.0f;
+    }
+    return V::Load(buf);
+  }
+
+  static void Put(float* p, size_t i, size_t count, F v) {
+    if (count == W) {
+      V::Store(p + i, v);
+      return;
+    }
+    float buf[W];
+    V::Store(buf, v);
+    for (size_t k = 0; k < count; ++k) {
+      p[i + k] = buf[k];
+    }
+  }
+
+  // sum of the first count lanes
+  static float Sum(F v, size_t count = W) {
+    float buf[W];
+    V::Store(buf, v);
+    float sum = 0.0f;
+    for (size_t k = 0; k < count; ++k) {
+      sum += buf[k];
+    }
+    return sum;
+  }
+
+  static size_t Count(size_t i, size_t n) {
+    return n - i < W ? n - i : W;
+  }
+
+  static float Max(const float* in, size_t n) {
+    float best = -3.402823466e+38f;
+    size_t i = 0;
+    if (n >= W) {
+      F m = V::Load(in);
+      for (i = W; i + W <= n; i += W) {
+        m = V::Max(m, V::Load(in + i));
+      }
+      float buf[W];
+      V::Store(buf, m);
+      for (size_t k = 0; k < W; ++k) {
+        best = buf[k] > best ? buf[k] : best;
+      }
+    }
+    for (; i < n; ++i) {
+      best = in[i] > best ? in[i] : best;
+    }
+    return best;
+  }
+
+  static float ExpSum(const float* in, float* out, size_t n, float shift) {
+    F s = V::Set1(shift);
+    F acc = V::Zero();
+    size_t i = 0;
+    for (; i + W <= n; i += W) {
+      F e = Exp(V::Sub(V::Load(in + i), s));
+      V::Store(out + i, e);
+      acc = V::Add(acc, e);
+    }
+    float sum = Sum(acc);
+    if (i < n) {
+      size_t count = n - i;
+      F e = Exp(V::Sub(Get(in, i, count), s));
+      Put(out, i, count, e);
+      sum += Sum(e, count);
+    }
+    return sum;
+  }
+
+  static float SumExp(const float* in, size_t n) {
+    F acc = V::Zero();
+    size_t i = 0;
+    for (; i + W <= n; i += W) {
+      acc = V::Add(acc, Exp(V::Load(in + i)));
+    }
+    float sum = Sum(acc);
+    if (i < n) {
+      sum += Sum(Exp(Get(in, i, n - i)), n - i);
+    }
+    return sum;
+  }
+
+  static void Scale(float* x, size_t n, float factor) {
+    F f = V::Set1(factor);
+    for (size_t i = 0; i < n; i += W) {
+      size_t count = Count(i, n);
+      Put(x, i, count, V::Mul(Get(x, i, count), f));
+    }
+  }
+
+  static void Add(float* x, size_t n, float value) {
+    F a = V::Set1(value);
+    for (size_t i = 0; i < n; i += W) {
+      size_t count = Count(i, n);
+      Put(x, i, count, V::Add(Get(x, i, count), a));
+    }
+  }
+
+  static void ExpRow(const float* in, float* out, size_t n) {
+    for (size_t i = 0; i < n; i += W) {
+      size_t count = Count(i, n);
+      Put(out, i, count, Exp(Get(in, i, count)));
+    }
+  }
+
+  static void TanhRow(const float* in, float* out, size_t n) {
+    for (size_t i = 0; i < n; i += W) {
+      size_t count = Count(i, n);
+      Put(out, i, count, Tanh(Get(in, i, count)));
+    }
+  }
+
+  static void SigmoidRow(const float* in, float* out, size_t n) {
+    for (size_t i = 0; i < n; i += W) {
+      size_t count = Count(i, n);
+      Put(out, i, count, Sigmoid(Get(in, i, count)));
+    }
+  }
+
+  static void LayerNorm(float* x, size_t n, const float* gamma, const float* beta, float eps) {
+    F acc = V::Zero();
+    for (size_t i = 0; i < n; i += W) {
+      acc = V::Add(acc, Get(x, i, Count(i, n)));
+    }
+    float mean = Sum(acc) / n;
+
+    // padding lanes read as zero, their (0 - mean)^2 is masked out by
+    // counting only the valid lanes of the last block
+    F m = V::Set1(mean);
+    acc = V::Zero();
+    float sigma = 0.0f;
+    for (size_t i = 0; i < n; i += W) {
+      size_t count = Count(i, n);
+      F d = V::Sub(Get(x, i, count), m);
+      if (count == W) {
+        acc = V::MulAdd(d, d, acc);
+      } else {
+        sigma += Sum(V::Mul(d, d), count);
+      }
+    }
+    sigma = __builtin_sqrtf((sigma + Sum(acc)) / n + eps);
+
+    F inv = V::Set1(1.0f / sigma);
+    for (size_t i = 0; i < n; i += W) {
+      size_t count = Count(i, n);
+      F v = V::Mul(V::Sub(Get(x, i, count), m), inv);
+      v = V::MulAdd(Get(gamma, i, count), v, Get(beta, i, count));
+      Put(x, i, count, v);
+    }
+  }
+
+  static void GRU(const GRUGates& g, const float* state, float* out, size_t n) {
+    const float* uInput = g.ruInput ? g.ruInput + n : nullptr;
+    const float* uBias = g.ruBias ? g.ruBias + n : nullptr;
+    const float* uState = g.ruState + n;
+    F one = V::Set1(1.0f);
+
+    for (size_t i = 0; i < n; i += W) {
+      size_t count = Count(i, n);
+      F r = Sigmoid(V::Add(V::Add(Get(g.ruInput, i, count), Get(g.ruBias, i, count)),
+                           Get(g.ruState, i, count)));
+      F u = Sigmoid(V::Add(V::Add(Get(uInput, i, count), Get(uBias, i, count)),
+                           Get(uState, i, count)));
+      F hs = V::Add(Get(g.hState, i, count), Get(g.hStateBias, i, count));
+      F h = Tanh(V::MulAdd(r, hs, V::Add(Get(g.hInput, i, count),
+                                         Get(g.hInputBias, i, count))));
+      F s = Get(state, i, count);
+      Put(out, i, count, V::MulAdd(V::Sub(one, u), h, V::Mul(u, s)));
+    }
+  }
+
+  static void AttentionScores(const float* context, size_t contextStride, size_t words,
+                              const float* hidden, size_t hiddenStride, size_t hyps,
+                              const float* v, size_t dim, float* scores, size_t scoresStride) {
+    // source rows are processed in tiles of about 128KB that stay in the
+    // cache while all hypotheses are scored against them
+    size_t tile = dim < 32768 ? 32768 / dim : 1;
+    for (size_t s0 = 0; s0 < words; s0 += tile) {
+      size_t s1 = s0 + tile < words ? s0 + tile : words;
+      for (size_t r = 0; r < hyps; ++r) {
+        const float* h = hidden + r * hiddenStride;
+        float* out = scores + r * scoresStride;
+        for (size_t s = s0; s < s1; ++s) {
+          const float* c = context + s * contextStride;
+          F acc = V::Zero();
+          size_t k = 0;
+          for (; k + W <= dim; k += W) {
+            acc = V::MulAdd(V::Load(v + k), Tanh(V::Add(V::Load(c + k), V::Load(h + k))), acc);
+          }
+          float sum = Sum(acc);
+          if (k < dim) {
+            size_t count = dim - k;
+            F t = Tanh(V::Add(Get(c, k, count), Get(h, k, count)));
+            sum += Sum(V::Mul(Get(v, k, count), t), count);
+          }
+          out[s] = sum;
+        }
+      }
+    }
+  }
+
+  static const size_t PANEL = PACKED_PANEL_WIDTH;
+  static const size_t PANEL_VECTORS = PANEL / W;
+  // rows per block, so that the accumulators of a block fill about half of
+  // the registers and the panel values the loads need the rest
+  static const size_t BLOCK_ROWS = W >= 16 ? 8 : W >= 8 ? 4 : W >= 4 ? 2 : 1;
+  // panels next to each other for a single row, for as many independent
+  // sums
+  static const size_t ROW_PANELS = PANEL_VECTORS >= 8 ? 1 : 8 / PANEL_VECTORS;
+
+  // R rows of in times P consecutive panels into the first n columns of
+  // out. Every output value is summed in the order of depth, as blaze does.
+  template <size_t R, size_t P>
+  static void GemmBlock(const float* in, size_t inStride, size_t depth,
+                        const float* panel, size_t panelSize,
+                        float* out, size_t outStride, size_t n) {
+    F acc[R][P][PANEL_VECTORS];
+    for (size_t r = 0; r < R; ++r) {
+      for (size_t p = 0; p < P; ++p) {
+        for (size_t v = 0; v < PANEL_VECTORS; ++v) {
+          acc[r][p][v] = V::Zero();
+        }
+      }
+    }
+
+    for (size_t k = 0; k < depth; ++k) {
+      F b[P][PANEL_VECTORS];
+      for (size_t p = 0; p < P; ++p) {
+        for (size_t v = 0; v < PANEL_VECTORS; ++v) {
+          b[p][v] = V::Load(panel + p * panelSize + k * PANEL + v * W);
+        }
+      }
+      for (size_t r = 0; r < R; ++r) {
+        F a = V::Set1(in[r * inStride + k]);
+        for (size_t p = 0; p < P; ++p) {
+          for (size_t v = 0; v < PANEL_VECTORS; ++v) {
+            acc[r][p][v] = V::MulAdd(a, b[p][v], acc[r][p][v]);
+          }
+        }
+      }
+    }
+
+    for (size_t r = 0; r < R; ++r) {
+      float* row = out + r * outStride;
+      if (n == P * PANEL) {
+        for (size_t p = 0; p < P; ++p) {
+          for (size_t v = 0; v < PANEL_VECTORS; ++v) {
+            V::Store(row + p * PANEL + v * W, acc[r][p][v]);
+          }
+        }
+      } else {
+        float buf[P * PANEL];
+        for (size_t p = 0; p < P; ++p) {
+          for (size_t v = 0; v < PANEL_VECTORS; ++v) {
+            V::Store(buf + p * PANEL + v * W, acc[r][p][v]);
+          }
+        }
+        for (size_t j = 0; j < n; ++j) {
+          row[j] = buf[j];
+        }
+      }
+    }
+  }
+
+  static void PackedGemm(const float* in, size_t inStride, size_t rows, size_t depth,
+                         const float* panels, size_t cols, float* out, size_t outStride) {
+    const size_t panelSize = depth * PANEL;
+
+    // pairs of rows and more go through blocks of rows, a panel at a time,
+    // which stays in the cache for all of them
+    const size_t blocked = BLOCK_ROWS > 1 ? rows - rows % 2 : 0;
+    for (size_t j = 0; j < cols; j += PANEL) {
+      const float* panel = panels + j / PANEL * panelSize;
+      const size_t n = cols - j < PANEL ? cols - j : PANEL;
+      size_t i = 0;
+      for (; i + BLOCK_ROWS <= blocked; i += BLOCK_ROWS) {
+        GemmBlock<BLOCK_ROWS, 1>(in + i * inStride, inStride, depth, panel, panelSize,
+                                 out + i * outStride + j, outStride, n);
+      }
+      if (BLOCK_ROWS > 4) {
+        for (; i + 4 <= blocked; i += 4) {
+          GemmBlock<4, 1>(in + i * inStride, inStride, depth, panel, panelSize,
+                          out + i * outStride + j, outStride, n);
+        }
+      }
+      for (; i < blocked; i += 2) {
+        GemmBlock<2, 1>(in + i * inStride, inStride, depth, panel, panelSize,
+                        out + i * outStride + j, outStride, n);
+      }
+    }
+
+    // a single row has too few sums for one panel to hide the latency of
+    // the multiply-adds, it goes through several panels at once
+    for (size_t i = blocked; i < rows; ++i) {
+      const float* row = in + i * inStride;
+      float* outRow = out + i * outStride;
+      size_t j = 0;
+      for (; j + ROW_PANELS * PANEL <= cols; j += ROW_PANELS * PANEL) {
+        GemmBlock<1, ROW_PANELS>(row, inStride, depth, panels + j / PANEL * panelSize, panelSize,
+                                 outRow + j, outStride, ROW_PANELS * PANEL);
+      }
+      for (; j < cols; j += PANEL) {
+        GemmBlock<1, 1>(row, inStride, depth, panels + j / PANEL * panelSize, panelSize,
+                        outRow + j, outStride, cols - j < PANEL ? cols - j : PANEL);
+      }
+    }
+  }
+};
+
+template <class T>
+void ScalarDot(const T* const* a, size_t rows, const T* const* b, size_t cols, size_t stride,
+               int32_t (*out)[QUANTIZED_COLUMN_BLOCK]) {
+  for (size_t r = 0; r < rows; ++r) {
+    for (size_t c = 0; c < cols; ++c) {
+      int32_t sum = 0;
+      for (size_t k = 0; k < stride; ++k) {
+        sum += int32_t(a[r][k]) * int32_t(b[c][k]);
+      }
+      out[r][c] = sum;
+    }
+  }
+}
+
+// the quantized kernels are scalar unless the caller sets its own
+template <class V>
+VectorKernels MakeKernels(const char* isa) {
+  typedef KernelsImpl<V> K;
+  VectorKernels kernels;
+  kernels.isa = isa;
+  kernels.max = &K::Max;
+  kernels.expSum = &K::ExpSum;
+  kernels.sumExp = &K::SumExp;
+  kernels.scale = &K::Scale;
+  kernels.add = &K::Add;
+  kernels.exp = &K::ExpRow;
+  kernels.tanh = &K::TanhRow;
+  kernels.sigmoid = &K::SigmoidRow;
+  kernels.layerNorm = &K::LayerNorm;
+  kernels.gru = &K::GRU;
+  kernels.attentionScores = &K::AttentionScores;
+  kernels.packedGemm = &K::PackedGemm;
+  kernels.quantizedIsa = "scalar";
+  kernels.dot8 = &ScalarDot<int8_t>;
+  kernels.dot16 = &ScalarDot<int16_t>;
+  return kernels;
+}
+
+}
+
+}
+}
+}
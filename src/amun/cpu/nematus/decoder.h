@@ -1,10 +1,15 @@
 #pragma once
 
+#include <numeric>
+
 #include "../mblas/matrix.h"
+#include "../mblas/quantized.h"
+#include "../mblas/top_k.h"
 #include "model.h"
 #include "gru.h"
 #include "transition.h"
 #include "common/god.h"
+#include "common/exception.h"
 
 namespace amunmt {
 namespace CPU {
@@ -20,14 +25,11 @@ class Decoder {
         {}
 
         void Lookup(mblas::Matrix& Rows, const std::vector<size_t>& ids) {
-          using namespace mblas;
-          std::vector<size_t> tids = ids;
-          for (auto&& id : tids) {
-            if (id >= w_.E_.rows()) {
-              id = 1;
-            }
+          Rows.resize(ids.size(), w_.E_.columns(), false);
+          for (size_t i = 0; i < ids.size(); ++i) {
+            size_t id = ids[i] < w_.E_.rows() ? ids[i] : 1;
+            blaze::row(Rows, i) = blaze::row(w_.E_, id);
           }
-          Rows = Assemble<byRow, Matrix>(w_.E_, tids);
         }
 
         size_t GetCols() {
@@ -54,17 +56,20 @@ class Decoder {
         void InitializeState(
           mblas::Matrix& State,
           const mblas::Matrix& SourceContext,
-          const size_t batchSize = 1)
+          const std::vector<size_t>& sentenceLengths)
         {
           using namespace mblas;
 
-          // Calculate mean of source context, rowwise
-          // Repeat mean batchSize times by broadcasting
-          Temp1_ = Mean<byRow, Matrix>(SourceContext);
-
+          // Calculate mean of source context, rowwise, separately for each
+          // sentence as the padded positions must not contribute
+          size_t batchSize = sentenceLengths.size();
+          size_t maxLength = SourceContext.rows() / batchSize;
           Temp2_.resize(batchSize, SourceContext.columns());
-          Temp2_ = 0.0f;
-          AddBiasVector<byRow>(Temp2_, Temp1_);
+          for (size_t b = 0; b < batchSize; ++b) {
+            Temp1_ = Mean<byRow, Matrix>(blaze::submatrix(SourceContext, b * maxLength, 0,
+                                                          sentenceLengths[b], SourceContext.columns()));
+            blaze::row(Temp2_, b) = blaze::row(Temp1_, 0);
+          }
 
           State = Temp2_ * w_.Wi_;
           AddBiasVector<byRow>(State, w_.Bi_);
@@ -72,7 +77,7 @@ class Decoder {
           if (w_.lns_.rows()) {
             LayerNormalization(State, w_.lns_, w_.lnb_);
           }
-          State = blaze::forEach(State, Tanh());
+          ApplyTanh(State);
           // std::cerr << "INIT: " << std::endl;
           // for (int i = 0; i < 5; ++i) std::cerr << State(0, i) << " ";
           // std::cerr << std::endl;
@@ -124,13 +129,11 @@ class Decoder {
       public:
         Attention(const Weights& model)
           : w_(model)
-        {
-          V_ = blaze::trans(blaze::row(w_.V_, 0));
-        }
+        {}
 
         void Init(const mblas::Matrix& SourceContext) {
           using namespace mblas;
-          SCU_ = SourceContext * w_.U_;
+          mblas::Multiply(SCU_, SourceContext, w_.U_, w_.Uq_);
           mblas::AddBiasVector<mblas::byRow>(SCU_, w_.B_);
 
           if (w_.Wc_att_lns_.rows()) {
@@ -138,32 +141,54 @@ class Decoder {
           }
         }
 
-        void GetAlignedSourceContext(
-          mblas::Matrix& AlignedSourceContext,
-          const mblas::Matrix& HiddenState,
-          const mblas::Matrix& SourceContext)
-        {
+        void GetAlignedSourceContext(mblas::Matrix& AlignedSourceContext,
+                                     const mblas::Matrix& HiddenState,
+                                     const mblas::Matrix& SourceContext,
+                                     const std::vector<size_t>& sentenceLengths,
+                                     const std::vector<uint>& beamSizes) {
           using namespace mblas;
 
-          Temp2_ = HiddenState * w_.W_;
+          mblas::Multiply(Temp2_, HiddenState, w_.W_, w_.Wq_);
           if (w_.W_comb_lns_.rows()) {
             LayerNormalization(Temp2_, w_.W_comb_lns_, w_.W_comb_lnb_);
           }
 
-          Temp1_ = Broadcast<Matrix>(Tanh(), SCU_, Temp2_);
-
-          A_.resize(Temp1_.rows(), 1);
-          blaze::column(A_, 0) = Temp1_ * V_;
-          size_t words = SourceContext.rows();
-          // batch size, for batching, divide by numer of sentences
-          size_t batchSize = HiddenState.rows();
-          Reshape(A_, batchSize, words); // due to broadcasting above
+          size_t batchSize = sentenceLengths.size();
+          size_t maxLength = SourceContext.rows() / batchSize;
+          size_t totalRows = std::accumulate(beamSizes.begin(), beamSizes.end(), 0);
+          amunmt_UTIL_THROW_IF2(totalRows != HiddenState.rows(),
+                                "Beam sizes (" << totalRows << ") do not match hidden state rows ("
+                                << HiddenState.rows() << ")");
+
+          // attention is computed per sentence, hypotheses of sentence b
+          // occupy beamSizes[b] consecutive rows of the hidden state
+          A_.resize(HiddenState.rows(), maxLength);
+          A_ = 0.0f;
+          AlignedSourceContext.resize(HiddenState.rows(), SourceContext.columns());
+
+          // the scores are written straight into their rows of A_ and
+          // normalized there; the bias C_ would cancel out in the softmax
+          size_t dim = SCU_.columns();
+          size_t row = 0;
+          for (size_t b = 0; b < batchSize; ++b) {
+            size_t rows = beamSizes[b];
+            size_t words = sentenceLengths[b];
+            if (rows == 0) {
+              continue;
+            }
 
-          float bias = w_.C_(0,0);
-          blaze::forEach(A_, [=](float x) { return x + bias; });
+            AttentionScores(&SCU_(b * maxLength, 0), SCU_.spacing(), words,
+                            &Temp2_(row, 0), Temp2_.spacing(), rows,
+                            &w_.V_(0, 0), dim, &A_(row, 0), A_.spacing());
+            for (size_t r = row; r < row + rows; ++r) {
+              mblas::SafeSoftmax(&A_(r, 0), words);
+            }
 
-          mblas::SafeSoftmax(A_);
-          AlignedSourceContext = A_ * SourceContext;
+            blaze::submatrix(AlignedSourceContext, row, 0, rows, SourceContext.columns())
+              = blaze::submatrix(A_, row, 0, rows, words)
+              * blaze::submatrix(SourceContext, b * maxLength, 0, words, SourceContext.columns());
+            row += rows;
+          }
         }
 
         void GetAttention(mblas::Matrix& Attention) {
@@ -178,10 +203,8 @@ class Decoder {
         const Weights& w_;
 
         mblas::Matrix SCU_;
-        mblas::Matrix Temp1_;
         mblas::Matrix Temp2_;
         mblas::Matrix A_;
-        mblas::ColumnVector V_;
     };
 
     //////////////////////////////////////////////////////////////
@@ -190,7 +213,9 @@ class Decoder {
       public:
         Softmax(const Weights& model)
         : w_(model),
-          filtered_(false)
+          filtered_(false),
+          greedy_(false),
+          topK_(0)
         {}
 
         void GetProbs(mblas::ArrayMatrix& Probs,
@@ -199,7 +224,7 @@ class Decoder {
                   const mblas::Matrix& AlignedSourceContext) {
           using namespace mblas;
 
-          T1_ = State * w_.W1_;
+          PackedGemm(State, w_.W1_, T1_);
           AddBiasVector<byRow>(T1_, w_.B1_);
           if (w_.lns_1_.rows()) {
             LayerNormalization(T1_, w_.lns_1_, w_.lnb_1_);
@@ -208,7 +233,7 @@ class Decoder {
           // for(int i = 0; i < 5; ++i) std::cerr << T1_(0, i) << " ";
           // std::cerr << std::endl;
 
-          T2_ = Embedding * w_.W2_;
+          PackedGemm(Embedding, w_.W2_, T2_);
           AddBiasVector<byRow>(T2_, w_.B2_);
           if (w_.lns_2_.rows()) {
             LayerNormalization(T2_, w_.lns_2_, w_.lnb_2_);
@@ -217,7 +242,7 @@ class Decoder {
           // for(int i = 0; i < 5; ++i) std::cerr << T2_(0, i) << " ";
           // std::cerr << std::endl;
 
-          T3_ = AlignedSourceContext * w_.W3_;
+          PackedGemm(AlignedSourceContext, w_.W3_, T3_);
           AddBiasVector<byRow>(T3_, w_.B3_);
           if (w_.lns_3_.rows()) {
             LayerNormalization(T3_, w_.lns_3_, w_.lnb_3_);
@@ -226,33 +251,94 @@ class Decoder {
           // for(int i = 0; i < 5; ++i) std::cerr << T3_(0, i) << " ";
           // std::cerr << std::endl;
 
-          auto t = blaze::forEach(T1_ + T2_ + T3_, Tanh());
-
-          if(!filtered_) {
-            Probs = t * w_.W4_;
-            AddBiasVector<byRow>(Probs, w_.B4_);
+          T1_ += T2_ + T3_;
+          ApplyTanh(T1_);
+          if (topK_) {
+            const Matrix& B4 = filtered_ ? FilteredB4_ : w_.B4_;
+            TopK_.Begin(T1_.rows(), B4.columns(), topK_, maskedColumn_);
+            if (!w_.W4q_.empty()) {
+              Int8GemmTopK(T1_, filtered_ ? FilteredW4q_ : w_.W4q_, B4, TopK_);
+            } else {
+              GemmTopK(T1_, filtered_ ? FilteredW4_ : w_.W4_, B4, TopK_);
+            }
+            TopK_.Finish(TopKWords_, TopKCosts_);
+            return;
+          }
+          if (!w_.W4q_.empty()) {
+            Int8Gemm(T1_, filtered_ ? FilteredW4q_ : w_.W4q_,
+                     filtered_ ? FilteredB4_ : w_.B4_, Probs);
           } else {
-            Probs = t * FilteredW4_;
-            AddBiasVector<byRow>(Probs, FilteredB4_);
+            PackedGemm(T1_, filtered_ ? FilteredW4_ : w_.W4_, Probs);
+            AddBiasVector<byRow>(Probs, filtered_ ? FilteredB4_ : w_.B4_);
           }
           // std::cerr << "LOgit" << std::endl;
           // for(int i = 0; i < 5; ++i) std::cerr << Probs(0, i) << " ";
           // std::cerr << std::endl;
-          LogSoftmax(Probs);
+          if (greedy_) {
+            LogSoftmaxArgmax(Probs, maskedColumn_, BestWords_, BestCosts_);
+          } else {
+            LogSoftmax(Probs);
+          }
+        }
+
+        void SetGreedy(bool greedy, size_t maskedColumn) {
+          greedy_ = greedy;
+          maskedColumn_ = maskedColumn;
+        }
+
+        void GetBestWords(std::vector<size_t>& words, std::vector<float>& costs) const {
+          words = BestWords_;
+          costs = BestCosts_;
+        }
+
+        void SetTopK(size_t k, size_t maskedColumn) {
+          topK_ = k;
+          maskedColumn_ = maskedColumn;
+        }
+
+        // the vectors are swapped, not copied; the ones passed in are
+        // filled by the next step
+        bool GetTopK(std::vector<size_t>& words, std::vector<float>& costs) {
+          if (topK_ == 0) {
+            return false;
+          }
+          words.swap(TopKWords_);
+          costs.swap(TopKCosts_);
+          return true;
         }
 
         void Filter(const std::vector<size_t>& ids) {
           filtered_ = true;
           using namespace mblas;
-          FilteredW4_ = Assemble<byColumn, Matrix>(w_.W4_, ids);
-          FilteredB4_ = Assemble<byColumn, Matrix>(w_.B4_, ids);
+          if (!w_.W4q_.empty()) {
+            FilteredW4q_ = QuantizedMatrix8(w_.W4q_, ids);
+          } else {
+            amunmt_UTIL_THROW_IF2(w_.W4T_.rows() == 0,
+                                  "The output layer was not loaded for a filtered vocabulary");
+            FilteredW4_.AssignRows(w_.W4T_, ids);
+          }
+          Assemble<byColumn>(FilteredB4_, w_.B4_, ids);
         }
 
       private:
         const Weights& w_;
         bool filtered_;
 
-        mblas::Matrix FilteredW4_;
+        // greedy decoding only keeps the best word of each row
+        bool greedy_;
+        size_t maskedColumn_;
+        std::vector<size_t> BestWords_;
+        std::vector<float> BestCosts_;
+
+        // beam search of a single model only keeps the topK_ best words of
+        // each row, Probs is left alone
+        size_t topK_;
+        mblas::LogSoftmaxTopK TopK_;
+        std::vector<size_t> TopKWords_;
+        std::vector<float> TopKCosts_;
+
+        mblas::PackedMatrix FilteredW4_;
+        mblas::QuantizedMatrix8 FilteredW4q_;
         mblas::Matrix FilteredB4_;
 
         mblas::Matrix T1_;
@@ -273,14 +359,17 @@ class Decoder {
       mblas::Matrix& NextState,
       const mblas::Matrix& State,
       const mblas::Matrix& Embeddings,
-      const mblas::Matrix& SourceContext)
+      const mblas::Matrix& SourceContext,
+      const std::vector<size_t>& sentenceLengths,
+      const std::vector<uint>& beamSizes)
     {
       GetHiddenState(HiddenState_, State, Embeddings);
       // std::cerr << "HIDDEN: " << std::endl;
       // for (int i = 0; i < 5; ++i) std::cerr << HiddenState_(0, i) << " ";
       // std::cerr << std::endl;
 
-      GetAlignedSourceContext(AlignedSourceContext_, HiddenState_, SourceContext);
+      GetAlignedSourceContext(AlignedSourceContext_, HiddenState_, SourceContext,
+                              sentenceLengths, beamSizes);
       // std::cerr << "ALIGNED SRC: " << std::endl;
       // for (int i = 0; i < 5; ++i) std::cerr << AlignedSourceContext_(0, i) << " ";
       // std::cerr << std::endl;
@@ -299,8 +388,8 @@ class Decoder {
 
     void EmptyState(mblas::Matrix& State,
                     const mblas::Matrix& SourceContext,
-                    size_t batchSize = 1) {
-    	rnn1_.InitializeState(State, SourceContext, batchSize);
+                    const std::vector<size_t>& sentenceLengths) {
+    	rnn1_.InitializeState(State, SourceContext, sentenceLengths);
     	attention_.Init(SourceContext);
     }
 
@@ -319,6 +408,22 @@ class Decoder {
       softmax_.Filter(ids);
     }
 
+    void SetGreedy(bool greedy, size_t maskedColumn) {
+      softmax_.SetGreedy(greedy, maskedColumn);
+    }
+
+    void GetBestWords(std::vector<size_t>& words, std::vector<float>& costs) const {
+      softmax_.GetBestWords(words, costs);
+    }
+
+    void SetTopK(size_t k, size_t maskedColumn) {
+      softmax_.SetTopK(k, maskedColumn);
+    }
+
+    bool GetTopK(std::vector<size_t>& words, std::vector<float>& costs) {
+      return softmax_.GetTopK(words, costs);
+    }
+
     void GetAttention(mblas::Matrix& attention) {
     	attention_.GetAttention(attention);
     }
@@ -341,8 +446,11 @@ class Decoder {
 
     void GetAlignedSourceContext(mblas::Matrix& AlignedSourceContext,
                                  const mblas::Matrix& HiddenState,
-                                 const mblas::Matrix& SourceContext) {
-    	attention_.GetAlignedSourceContext(AlignedSourceContext, HiddenState, SourceContext);
+                                 const mblas::Matrix& SourceContext,
+                                 const std::vector<size_t>& sentenceLengths,
+                                 const std::vector<uint>& beamSizes) {
+    	attention_.GetAlignedSourceContext(AlignedSourceContext, HiddenState, SourceContext,
+    	                                   sentenceLengths, beamSizes);
     }
 
     void GetNextState(mblas::Matrix& State,
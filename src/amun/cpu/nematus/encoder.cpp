@@ -1,4 +1,6 @@
 #include "encoder.h"
+#include "common/sentences.h"
+#include "common/allocation_counter.h"
 
 using namespace std;
 
@@ -6,24 +8,52 @@ namespace amunmt {
 namespace CPU {
 namespace Nematus {
 
-void Encoder::GetContext(const std::vector<size_t>& words, mblas::Matrix& context) {
-  std::vector<mblas::Matrix> embeddedWords;
+void Encoder::GetContext(const Sentences& sources, size_t tab,
+                         mblas::Matrix& context,
+                         std::vector<size_t>& sentenceLengths) {
+  size_t batchSize = sources.size();
+  size_t maxLength = 0;
+  sentenceLengths.resize(batchSize);
+  for (size_t b = 0; b < batchSize; ++b) {
+    sentenceLengths[b] = sources.at(b)->GetWords(tab).size();
+    maxLength = std::max(maxLength, sentenceLengths[b]);
+  }
 
-  context.resize(words.size(),
+  // one row per sentence and source position, sentences are padded to maxLength
+  context.resize(batchSize * maxLength,
                  forwardRnn_.GetStateLength() + backwardRnn_.GetStateLength());
 
-  for (auto& w : words) {
-    embeddedWords.emplace_back();
-    mblas::Matrix &embed = embeddedWords.back();
-    embeddings_.Lookup(embed, w);
+  // all words in one matrix, timestep-major: row i * batchSize + b
+  Words input(maxLength * batchSize);
+  for (size_t i = 0; i < maxLength; ++i) {
+    for (size_t b = 0; b < batchSize; ++b) {
+      const Words& words = sources.at(b)->GetWords(tab);
+      input[i * batchSize + b] = (i < words.size()) ? words[i] : EOS_ID;
+    }
+  }
+  embeddings_.Lookup(embeddedWords_, input);
+
+  if (backwardThread_) {
+    // both directions only read the embeddings and write disjoint
+    // column ranges of the context; the buffers the backward RNN grows on
+    // the helper thread are counted on this one
+    auto backward = backwardThread_->enqueue([&] {
+      size_t allocations = AllocationCount();
+      backwardRnn_.GetContext(embeddedWords_, context, sentenceLengths, true);
+      return AllocationCount() - allocations;
+    });
+    try {
+      forwardRnn_.GetContext(embeddedWords_, context, sentenceLengths, false);
+    } catch (...) {
+      // the task refers to this frame
+      backward.wait();
+      throw;
+    }
+    AllocationCount() += backward.get();
+  } else {
+    forwardRnn_.GetContext(embeddedWords_, context, sentenceLengths, false);
+    backwardRnn_.GetContext(embeddedWords_, context, sentenceLengths, true);
   }
-
-  forwardRnn_.GetContext(embeddedWords.cbegin(),
-						 embeddedWords.cend(),
-						 context, false);
-  backwardRnn_.GetContext(embeddedWords.crbegin(),
-						  embeddedWords.crend(),
-						  context, true);
 }
 
 }  // namespace Nematus
@@ -1,11 +1,17 @@
 #pragma once
 
+#include <memory>
+
 #include "../mblas/matrix.h"
+#include "common/threadpool.h"
 #include "model.h"
 #include "gru.h"
 #include "transition.h"
 
 namespace amunmt {
+
+class Sentences;
+
 namespace CPU {
 namespace Nematus {
 
@@ -20,12 +26,15 @@ class Encoder {
         : w_(model)
         {}
 
-        void Lookup(mblas::Matrix& Row, size_t i) {
-		  size_t len = w_.E_.columns();
-          if(i < w_.E_.rows())
-            Row = blaze::submatrix(w_.E_, i, 0, 1, len);
-          else
-            Row = blaze::submatrix(w_.E_, 1, 0, 1, len); // UNK
+        void Lookup(mblas::Matrix& Rows, const Words& words) {
+          using namespace mblas;
+          std::vector<size_t> knownWords(words.size(), 1);
+          for (size_t i = 0; i < words.size(); ++i) {
+            if (words[i] < w_.E_.rows()) {
+              knownWords[i] = words[i];
+            }
+          }
+          Rows = Assemble<byRow, Matrix>(w_.E_, knownWords);
         }
 
         const Weights& w_;
@@ -46,10 +55,11 @@ class Encoder {
           State_ = 0.0f;
         }
 
+        template <class MT>
         void GetNextState(mblas::Matrix& nextState,
                           const mblas::Matrix& state,
-                          const mblas::Matrix& embd) {
-          gru_.GetNextState(nextState, state, embd);
+                          const MT& input) {
+          gru_.GetNextStateFromInput(nextState, state, input);
           // std::cerr << "GRU: " << std::endl;
           // for (int i = 0; i < 10; ++i) std::cerr << nextState(0, i) << " ";
           // std::cerr << std::endl;
@@ -59,21 +69,33 @@ class Encoder {
           // std::cerr << std::endl;
         }
 
-        template <class It>
-        void GetContext(It it, It end, mblas::Matrix& Context, bool invert) {
-          InitializeState();
+        // Embeddings holds one block of batchSize rows per timestep.
+        // The input projections of all timesteps are computed with a
+        // single GEMM, only the recurrent part is done step by step.
+        void GetContext(const mblas::Matrix& Embeddings,
+                mblas::Matrix& Context,
+                const std::vector<size_t>& sentenceLengths,
+                bool invert) {
+          size_t batchSize = sentenceLengths.size();
+          InitializeState(batchSize);
 
-          size_t n = std::distance(it, end);
-          size_t i = 0;
-          while(it != end) {
-          GetNextState(State_, State_, *it++);
+          gru_.GetInputProjection(Input_, Embeddings);
 
+          size_t n = Embeddings.rows() / batchSize;
           size_t len = gru_.GetStateLength();
-            if(invert)
-              blaze::submatrix(Context, n - i - 1, len, 1, len) = State_;
-            else
-      			  blaze::submatrix(Context, i, 0, 1, len) = State_;
-            ++i;
+          for (size_t i = 0; i < n; ++i) {
+            size_t pos = invert ? n - i - 1 : i;
+            GetNextState(State_, State_,
+                         blaze::submatrix(Input_, pos * batchSize, 0, batchSize, Input_.columns()));
+
+            for (size_t b = 0; b < batchSize; ++b) {
+              if (pos >= sentenceLengths[b]) {
+                // padding, the backward state must stay empty until the sentence starts
+                blaze::row(State_, b) = 0.0f;
+              }
+              blaze::submatrix(Context, b * n + pos, invert ? len : 0, 1, len)
+                = blaze::submatrix(State_, b, 0, 1, len);
+            }
           }
         }
 
@@ -87,23 +109,33 @@ class Encoder {
         const Transition transition_;
 
         mblas::Matrix State_;
+        mblas::Matrix Input_;
     };
 
   /////////////////////////////////////////////////////////////////
   public:
-    Encoder(const Weights& model)
+    Encoder(const Weights& model, bool parallel = false)
       : embeddings_(model.encEmbeddings_),
         forwardRnn_(model.encForwardGRU_, model.encForwardTransition_),
-        backwardRnn_(model.encBackwardGRU_, model.encBackwardTransition_)
+        backwardRnn_(model.encBackwardGRU_, model.encBackwardTransition_),
+        backwardThread_(parallel ? new ThreadPool(1) : nullptr)
     {}
 
-    void GetContext(const std::vector<size_t>& words,
-                    mblas::Matrix& context);
+    void GetContext(const Sentences& sources, size_t tab,
+                    mblas::Matrix& context,
+                    std::vector<size_t>& sentenceLengths);
 
   private:
     Embeddings<Weights::Embeddings> embeddings_;
     EncoderRNN<Weights::GRU, Weights::Transition> forwardRnn_;
     EncoderRNN<Weights::GRU, Weights::Transition> backwardRnn_;
+
+    // runs the backward direction while the calling thread runs the forward
+    // one, started once and kept for all sentences; null if not parallel
+    std::unique_ptr<ThreadPool> backwardThread_;
+
+    // reusing memory
+    mblas::Matrix embeddedWords_;
 };
 
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include "cpu/mblas/matrix.h"
+#include "cpu/mblas/packed.h"
+#include "cpu/mblas/quantized.h"
 #include <iomanip>
 
 namespace amunmt {
@@ -11,12 +13,7 @@ class GRU {
     GRU(const Weights& model)
       : w_(model),
         layerNormalization_(w_.W_lns_.rows())
-    {
-      if (!layerNormalization_) {
-        WWx_ = mblas::Concat<mblas::byColumn, mblas::Matrix>(w_.W_, w_.Wx_);
-        UUx_ = mblas::Concat<mblas::byColumn, mblas::Matrix>(w_.U_, w_.Ux_);
-      }
-    }
+    {}
 
     void GetNextState(
       mblas::Matrix& nextState,
@@ -24,103 +21,94 @@ class GRU {
       const mblas::Matrix& context) const
     {
       // std::cerr << "Get next state" << std::endl;
+      GetInputProjection(RUH_, context);
+      GetNextStateFromInput(nextState, state, RUH_);
+    }
+
+    // The input part does not depend on the state, the encoder computes
+    // it for all timesteps at once and passes the rows of each step to
+    // GetNextStateFromInput
+    void GetInputProjection(
+      mblas::Matrix& RUH,
+      const mblas::Matrix& context) const
+    {
       if (layerNormalization_) {
-        RUH_1_ = context * w_.W_;
+        // one product for both halves
+        mblas::Multiply(Proj_, context, w_.WWx_, w_.WWxq_);
+        RUH_1_ = blaze::submatrix(Proj_, 0, 0, Proj_.rows(), w_.W_.columns());
+        RUH_2_ = blaze::submatrix(Proj_, 0, w_.W_.columns(), Proj_.rows(), w_.Wx_.columns());
+
         mblas::AddBiasVector<mblas::byRow>(RUH_1_, w_.B_);
         LayerNormalization(RUH_1_, w_.W_lns_, w_.W_lnb_);
 
-        RUH_2_ = context * w_.Wx_;
         mblas::AddBiasVector<mblas::byRow>(RUH_2_, w_.Bx1_);
         LayerNormalization(RUH_2_, w_.Wx_lns_, w_.Wx_lnb_);
 
-        RUH_ = mblas::Concat<mblas::byColumn, mblas::Matrix>(RUH_1_, RUH_2_);
+        mblas::Concat<mblas::byColumn>(RUH, RUH_1_, RUH_2_);
+      } else {
+        mblas::Multiply(RUH, context, w_.WWx_, w_.WWxq_);
+      }
+    }
+
+    template <class MT>
+    void GetNextStateFromInput(
+      mblas::Matrix& nextState,
+      const mblas::Matrix& state,
+      const MT& RUH) const
+    {
+      if (layerNormalization_) {
+        mblas::Multiply(Proj_, state, w_.UUx_, w_.UUxq_);
+        Temp_1_ = blaze::submatrix(Proj_, 0, 0, Proj_.rows(), w_.U_.columns());
+        Temp_2_ = blaze::submatrix(Proj_, 0, w_.U_.columns(), Proj_.rows(), w_.Ux_.columns());
 
-        Temp_1_ = state * w_.U_;
         mblas::AddBiasVector<mblas::byRow>(Temp_1_, w_.Bx3_);
         LayerNormalization(Temp_1_, w_.U_lns_, w_.U_lnb_);
 
-        Temp_2_ = state * w_.Ux_;
         mblas::AddBiasVector<mblas::byRow>(Temp_2_, w_.Bx2_);
         LayerNormalization(Temp_2_, w_.Ux_lns_, w_.Ux_lnb_);
 
-        Temp_ = mblas::Concat<mblas::byColumn, mblas::Matrix>(Temp_1_, Temp_2_);
+        mblas::Concat<mblas::byColumn>(Temp_, Temp_1_, Temp_2_);
 
-        ElementwiseOpsLayerNorm(nextState, state);
+        ElementwiseOpsLayerNorm(nextState, state, RUH);
 
       } else {
-        RUH_ = context * WWx_;
-        Temp_ = state * UUx_;
-        ElementwiseOps(nextState, state);
+        mblas::Multiply(Temp_, state, w_.UUx_, w_.UUxq_);
+        ElementwiseOps(nextState, state, RUH);
       }
     }
 
-    void ElementwiseOps(mblas::Matrix& NextState, const mblas::Matrix& State) const {
-      using namespace mblas;
-      using namespace blaze;
-
-      const int rowNo = State.rows();
-      const int colNo = State.columns();
-      NextState.resize(rowNo, colNo);
-
-      for (int j = 0; j < rowNo; ++j) {
-        auto rowOut = row(NextState, j);
-        auto rowState = row(State, j);
-
-        auto rowRuh = row(RUH_, j);
-        auto rowT   = row(Temp_, j);
-
-        auto rowH   = subvector(rowRuh, 2 * colNo, colNo);
-        auto rowT2  = subvector(rowT, 2 * colNo, colNo);
-
-        for (int i = 0; i < colNo; ++i) {
-          float ev1 = expapprox(-(rowRuh[i] + w_.B_(0, i) + rowT[i]));
-          float r = 1.0f / (1.0f + ev1);
-
-          int k = i + colNo;
-          float ev2 = expapprox(-(rowRuh[k] + w_.B_(0, k) + rowT[k]));
-          float u = 1.0f / (1.0f + ev2);
-
-          float hv = rowH[i] + w_.Bx1_(0, i);
-          float t2v = rowT2[i];
-          hv = tanhapprox(hv + r * t2v);
-          rowOut[i] = (1.0f - u) * hv + u * rowState[i];
-        }
-      }
+    template <class MT>
+    void ElementwiseOps(mblas::Matrix& NextState, const mblas::Matrix& State, const MT& RUH) const {
+      mblas::GRUGates gates;
+      gates.ruBias = &w_.B_(0, 0);
+      gates.hInputBias = &w_.Bx1_(0, 0);
+      ElementwiseOps(NextState, State, RUH, gates);
     }
 
-    void ElementwiseOpsLayerNorm(mblas::Matrix& NextState, const mblas::Matrix& State) const {
-      using namespace mblas;
-      using namespace blaze;
+    template <class MT>
+    void ElementwiseOpsLayerNorm(mblas::Matrix& NextState, const mblas::Matrix& State, const MT& RUH) const {
+      // the other biases are added before the layer normalization
+      mblas::GRUGates gates;
+      gates.hStateBias = &w_.Bx2_(0, 0);
+      ElementwiseOps(NextState, State, RUH, gates);
+    }
 
-      const int rowNo = State.rows();
-      const int colNo = State.columns();
+    template <class MT>
+    void ElementwiseOps(mblas::Matrix& NextState, const mblas::Matrix& State, const MT& RUH,
+                        mblas::GRUGates& gates) const {
+      const size_t rowNo = State.rows();
+      const size_t colNo = State.columns();
       NextState.resize(rowNo, colNo);
 
-      for (int j = 0; j < rowNo; ++j) {
-        auto rowOut = row(NextState, j);
-        auto rowState = row(State, j);
-
-        auto rowRuh = row(RUH_, j);
-        auto rowT   = row(Temp_, j);
-
-        auto rowH   = subvector(rowRuh, 2 * colNo, colNo);
-        auto rowT2  = subvector(rowT, 2 * colNo, colNo);
-
-        for (int i = 0; i < colNo; ++i) {
-          float ev1 = expapprox(-(rowRuh[i] + rowT[i]));
-          float r = 1.0f / (1.0f + ev1);
-
-          int k = i + colNo;
-          float ev2 = expapprox(-(rowRuh[k] + rowT[k]));
-          float u = 1.0f / (1.0f + ev2);
-
-          float hv = rowH[i];
-          float t2v = rowT2[i] + w_.Bx2_(0, i);
-          hv = tanhapprox(hv + r * t2v);
-          rowOut[i] = (1.0f - u) * hv + u * rowState[i];
-        }
+      for (size_t j = 0; j < rowNo; ++j) {
+        gates.ruInput = &RUH(j, 0);
+        gates.hInput = gates.ruInput + 2 * colNo;
+        gates.ruState = &Temp_(j, 0);
+        gates.hState = gates.ruState + 2 * colNo;
+        mblas::GRUStep(gates, &State(j, 0), &NextState(j, 0), colNo);
       }
     }
+
     size_t GetStateLength() const {
       return w_.U_.rows();
     }
@@ -129,13 +117,6 @@ class GRU {
   private:
     // Model matrices
     const Weights& w_;
-    mutable mblas::Matrix WWx_;
-    mutable mblas::Matrix UUx_;
-    mutable mblas::Matrix Wbbx_;
-    mutable mblas::Matrix lns_WWx_;
-    mutable mblas::Matrix lns_UUx_;
-    mutable mblas::Matrix lnb_WWx_;
-    mutable mblas::Matrix lnb_UUx_;
 
     // reused to avoid allocation
     mutable mblas::Matrix RUH_;
@@ -144,6 +125,7 @@ class GRU {
     mutable mblas::Matrix Temp_;
     mutable mblas::Matrix Temp_1_;
     mutable mblas::Matrix Temp_2_;
+    mutable mblas::Matrix Proj_;
 
     bool layerNormalization_;
 };
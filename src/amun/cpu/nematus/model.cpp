@@ -1,32 +1,67 @@
 #include "cpu/nematus/model.h"
 
+#include "cpu/weights_source.h"
+
 namespace amunmt {
 namespace CPU {
 namespace Nematus {
 
-Weights::Transition::Transition(const NpzConverter& model, TransitionType type, std::string prefix,
-                                std::string infix)
-  : depth_(findTransitionDepth(model, prefix, infix)), type_(type)
+namespace {
+
+// hidden x vocabulary, or transposed; tied to the target embeddings in
+// models without ff_logit_W
+std::vector<std::pair<std::string, bool>> OutputLayer(bool transposed) {
+  return {std::make_pair(std::string("ff_logit_W"), transposed),
+          std::make_pair(std::string("Wemb_dec"), !transposed)};
+}
+
+}
+
+template <class Model>
+Weights::Transition::Transition(const Model& model, TransitionType type, const std::string& name,
+                                const std::string& prefix, const std::string& infix)
+  : depth_(model.Count(name + ".B", [&](const NpzConverter& npz) {
+      return findTransitionDepth(npz, prefix, infix);
+    })),
+    type_(type)
 {
-  for (int i = 1; i <= depth_; ++i) {
-    U_.emplace_back(model[name(prefix, "U", infix, i)]);
-    Ux_.emplace_back(model[name(prefix, "Ux", infix, i)]);
-    B_.emplace_back(model(name(prefix, "b", infix, i), true));
-    U_lns_.emplace_back(model[name(prefix, "U", infix, i, "_lns")]);
-    U_lnb_.emplace_back(model[name(prefix, "U", infix, i, "_lnb")]);
-    Ux_lns_.emplace_back(model[name(prefix, "Ux", infix, i, "_lns")]);
-    Ux_lnb_.emplace_back(model[name(prefix, "Ux", infix, i, "_lnb")]);
+  for (int i = 0; i < depth_; ++i) {
+    // the npz keys count from 1
+    const std::string index = "." + std::to_string(i);
+    auto key = [&](const std::string& matrix, const std::string& suffix = "") {
+      return this->name(prefix, matrix, infix, i + 1, suffix);
+    };
+    if (model.Quantization().int16) {
+      Uq_.push_back(model.Quantized16(name + ".Uq" + index, [&](const NpzConverter& npz) {
+        return mblas::QuantizedMatrix16(npz[key("U")]);
+      }));
+      Uxq_.push_back(model.Quantized16(name + ".Uxq" + index, [&](const NpzConverter& npz) {
+        return mblas::QuantizedMatrix16(npz[key("Ux")]);
+      }));
+    } else {
+      U_.push_back(model.Packed(name + ".U" + index, [&](const NpzConverter& npz) {
+        return mblas::PackedMatrix(npz[key("U")]);
+      }));
+      Ux_.push_back(model.Packed(name + ".Ux" + index, [&](const NpzConverter& npz) {
+        return mblas::PackedMatrix(npz[key("Ux")]);
+      }));
+    }
+    B_.push_back(model.Matrix(name + ".B" + index, key("b"), true));
+    U_lns_.push_back(model.Matrix(name + ".U_lns" + index, key("U", "_lns")));
+    U_lnb_.push_back(model.Matrix(name + ".U_lnb" + index, key("U", "_lnb")));
+    Ux_lns_.push_back(model.Matrix(name + ".Ux_lns" + index, key("Ux", "_lns")));
+    Ux_lnb_.push_back(model.Matrix(name + ".Ux_lnb" + index, key("Ux", "_lnb")));
 
     switch(type) {
       case TransitionType::Encoder:
-        Bx1_.emplace_back(1, Ux_.back().dim(1));
-        const_cast<mblas::Matrix&>(Bx1_.back()) = 0.0f;
-        Bx2_.emplace_back(model(name(prefix, "bx", infix, i), true));
+        Bx2_.push_back(model.Matrix(name + ".Bx2" + index, key("bx"), true));
+        Bx1_.emplace_back(1, Bx2_.back().columns());
+        Bx1_.back() = 0.0f;
         break;
       case TransitionType::Decoder:
-        Bx1_.emplace_back(model(name(prefix, "bx", infix, i), true));
-        Bx2_.emplace_back(1, Ux_.back().dim(1));
-        const_cast<mblas::Matrix&>(Bx2_.back()) = 0.0f;
+        Bx1_.push_back(model.Matrix(name + ".Bx1" + index, key("bx"), true));
+        Bx2_.emplace_back(1, Bx1_.back().columns());
+        Bx2_.back() = 0.0f;
         break;
     }
   }
@@ -60,31 +95,43 @@ std::string Weights::Transition::name(const std::string& prefix, std::string nam
   return prefix + name + infix + "_drt_" + std::to_string(index) + suffix;
 }
 
-Weights::Embeddings::Embeddings(const NpzConverter& model, const std::string &key)
-  : E_(model[key])
+template <class Model>
+Weights::Embeddings::Embeddings(const Model& model, const std::string& name,
+                                const std::vector<std::pair<std::string, bool>>& keys)
+  : E_(model.View(name + ".E", [&](const NpzConverter& npz) { return npz.View(keys); }))
 {}
 
-Weights::Embeddings::Embeddings(const NpzConverter& model, const std::vector<std::pair<std::string, bool>> keys)
-  : E_(model.getFirstOfMany(keys))
-{}
-
-Weights::GRU::GRU(const NpzConverter& model, std::string prefix, std::vector<std::string> keys)
-  : W_(model[prefix + keys.at(0)]),
-    B_(model(prefix + keys.at(1), true)),
-    U_(model[prefix + keys.at(2)]),
-    Wx_(model[prefix + keys.at(3)]),
-    Bx1_(model(prefix + keys.at(4), true)),
+template <class Model>
+Weights::GRU::GRU(const Model& model, const std::string& name, const std::string& prefix,
+                  const std::vector<std::string>& keys)
+  : W_(model.Matrix(name + ".W", prefix + keys.at(0))),
+    B_(model.Matrix(name + ".B", prefix + keys.at(1), true)),
+    U_(model.Matrix(name + ".U", prefix + keys.at(2))),
+    Wx_(model.Matrix(name + ".Wx", prefix + keys.at(3))),
+    Bx1_(model.Matrix(name + ".Bx1", prefix + keys.at(4), true)),
     Bx2_(Bx1_.rows(), Bx1_.columns()),
     Bx3_(B_.rows(), B_.columns()),
-    Ux_(model[prefix + keys.at(5)]),
-    W_lns_(model[prefix + keys.at(6)]),
-    W_lnb_(model[prefix + keys.at(7)]),
-    Wx_lns_(model[prefix + keys.at(8)]),
-    Wx_lnb_(model[prefix + keys.at(9)]),
-    U_lns_(model[prefix + keys.at(10)]),
-    U_lnb_(model[prefix + keys.at(11)]),
-    Ux_lns_(model[prefix + keys.at(12)]),
-    Ux_lnb_(model[prefix + keys.at(13)])
+    Ux_(model.Matrix(name + ".Ux", prefix + keys.at(5))),
+    W_lns_(model.Matrix(name + ".W_lns", prefix + keys.at(6))),
+    W_lnb_(model.Matrix(name + ".W_lnb", prefix + keys.at(7))),
+    Wx_lns_(model.Matrix(name + ".Wx_lns", prefix + keys.at(8))),
+    Wx_lnb_(model.Matrix(name + ".Wx_lnb", prefix + keys.at(9))),
+    U_lns_(model.Matrix(name + ".U_lns", prefix + keys.at(10))),
+    U_lnb_(model.Matrix(name + ".U_lnb", prefix + keys.at(11))),
+    Ux_lns_(model.Matrix(name + ".Ux_lns", prefix + keys.at(12))),
+    Ux_lnb_(model.Matrix(name + ".Ux_lnb", prefix + keys.at(13))),
+    WWx_(model.Packed(name + ".WWx", [&](const NpzConverter&) {
+      return model.Quantization().int16 ? mblas::PackedMatrix() : mblas::PackedMatrix(W_, Wx_);
+    })),
+    UUx_(model.Packed(name + ".UUx", [&](const NpzConverter&) {
+      return model.Quantization().int16 ? mblas::PackedMatrix() : mblas::PackedMatrix(U_, Ux_);
+    })),
+    WWxq_(model.Quantized16(name + ".WWxq", [&](const NpzConverter&) {
+      return model.Quantization().int16 ? mblas::QuantizedMatrix16(W_, Wx_) : mblas::QuantizedMatrix16();
+    })),
+    UUxq_(model.Quantized16(name + ".UUxq", [&](const NpzConverter&) {
+      return model.Quantization().int16 ? mblas::QuantizedMatrix16(U_, Ux_) : mblas::QuantizedMatrix16();
+    }))
 {
   const_cast<mblas::Matrix&>(Bx2_) = 0.0f;
   const_cast<mblas::Matrix&>(Bx3_) = 0.0f;
@@ -92,91 +139,167 @@ Weights::GRU::GRU(const NpzConverter& model, std::string prefix, std::vector<std
 
 //////////////////////////////////////////////////////////////////////////////
 
-Weights::DecInit::DecInit(const NpzConverter& model)
-  : Wi_(model["ff_state_W"]),
-    Bi_(model("ff_state_b", true)),
-    lns_(model["ff_state_ln_s"]),
-    lnb_(model["ff_state_ln_b"])
+template <class Model>
+Weights::DecInit::DecInit(const Model& model, const std::string& name)
+  : Wi_(model.Matrix(name + ".Wi", "ff_state_W")),
+    Bi_(model.Matrix(name + ".Bi", "ff_state_b", true)),
+    lns_(model.Matrix(name + ".lns", "ff_state_ln_s")),
+    lnb_(model.Matrix(name + ".lnb", "ff_state_ln_b"))
 {}
 
 
-Weights::DecGRU2::DecGRU2(const NpzConverter& model, std::string prefix, std::vector<std::string> keys)
-  : W_(model[prefix + keys.at(0)]),  // Wc
+template <class Model>
+Weights::DecGRU2::DecGRU2(const Model& model, const std::string& name, const std::string& prefix,
+                          const std::vector<std::string>& keys)
+  : W_(model.Matrix(name + ".W", prefix + keys.at(0))),  // Wc
     B_(1, W_.dim(1)),
-    U_(model[prefix + keys.at(1)]),  // U_nl
-    Bx3_(model(prefix + keys.at(2), true)),  // b_nl
-    Wx_(model[prefix + keys.at(3)]),  // Wcx
+    U_(model.Matrix(name + ".U", prefix + keys.at(1))),  // U_nl
+    Bx3_(model.Matrix(name + ".Bx3", prefix + keys.at(2), true)),  // b_nl
+    Wx_(model.Matrix(name + ".Wx", prefix + keys.at(3))),  // Wcx
     Bx1_(1, Wx_.dim(1)),
-    Ux_(model[prefix + keys.at(4)]),  // Ux_nl
-    Bx2_(model(prefix + keys.at(5), true)),  // bx_nl
-    W_lns_(model[prefix + keys.at(6)]),  // Wc_lns
-    W_lnb_(model[prefix + keys.at(7)]),  // Wc_nlb
-    Wx_lns_(model[prefix + keys.at(8)]),  // Wcx_lns
-    Wx_lnb_(model[prefix + keys.at(9)]),  // Wcx_lnb
-    U_lns_(model[prefix + keys.at(10)]),  // U_nl_lns
-    U_lnb_(model[prefix + keys.at(11)]),  // U_nl_lnb
-    Ux_lns_(model[prefix + keys.at(12)]),  // Ux_nl_lns
-    Ux_lnb_(model[prefix + keys.at(13)])  // Ux_nl_lnb
-
+    Ux_(model.Matrix(name + ".Ux", prefix + keys.at(4))),  // Ux_nl
+    Bx2_(model.Matrix(name + ".Bx2", prefix + keys.at(5), true)),  // bx_nl
+    W_lns_(model.Matrix(name + ".W_lns", prefix + keys.at(6))),  // Wc_lns
+    W_lnb_(model.Matrix(name + ".W_lnb", prefix + keys.at(7))),  // Wc_nlb
+    Wx_lns_(model.Matrix(name + ".Wx_lns", prefix + keys.at(8))),  // Wcx_lns
+    Wx_lnb_(model.Matrix(name + ".Wx_lnb", prefix + keys.at(9))),  // Wcx_lnb
+    U_lns_(model.Matrix(name + ".U_lns", prefix + keys.at(10))),  // U_nl_lns
+    U_lnb_(model.Matrix(name + ".U_lnb", prefix + keys.at(11))),  // U_nl_lnb
+    Ux_lns_(model.Matrix(name + ".Ux_lns", prefix + keys.at(12))),  // Ux_nl_lns
+    Ux_lnb_(model.Matrix(name + ".Ux_lnb", prefix + keys.at(13))),  // Ux_nl_lnb
+    WWx_(model.Packed(name + ".WWx", [&](const NpzConverter&) {
+      return model.Quantization().int16 ? mblas::PackedMatrix() : mblas::PackedMatrix(W_, Wx_);
+    })),
+    UUx_(model.Packed(name + ".UUx", [&](const NpzConverter&) {
+      return model.Quantization().int16 ? mblas::PackedMatrix() : mblas::PackedMatrix(U_, Ux_);
+    })),
+    WWxq_(model.Quantized16(name + ".WWxq", [&](const NpzConverter&) {
+      return model.Quantization().int16 ? mblas::QuantizedMatrix16(W_, Wx_) : mblas::QuantizedMatrix16();
+    })),
+    UUxq_(model.Quantized16(name + ".UUxq", [&](const NpzConverter&) {
+      return model.Quantization().int16 ? mblas::QuantizedMatrix16(U_, Ux_) : mblas::QuantizedMatrix16();
+    }))
 {
   const_cast<mblas::Matrix&>(B_) = 0.0f;
   const_cast<mblas::Matrix&>(Bx1_) = 0.0f;
 }
 
-Weights::DecAttention::DecAttention(const NpzConverter& model)
-  : V_(model("decoder_U_att", true)),
-    W_(model["decoder_W_comb_att"]),
-    B_(model("decoder_b_att", true)),
-    U_(model["decoder_Wc_att"]),
-    C_(model["decoder_c_tt"]),
-    Wc_att_lns_(model["decoder_Wc_att_lns"]),
-    Wc_att_lnb_(model["decoder_Wc_att_lnb"]),
-    W_comb_lns_(model["decoder_W_comb_att_lns"]),
-    W_comb_lnb_(model["decoder_W_comb_att_lnb"])
+template <class Model>
+Weights::DecAttention::DecAttention(const Model& model, const std::string& name)
+  : V_(model.Matrix(name + ".V", "decoder_U_att", true)),
+    W_(model.Packed(name + ".W", [&](const NpzConverter& npz) {
+      return model.Quantization().int16 ? mblas::PackedMatrix()
+                                        : mblas::PackedMatrix(npz["decoder_W_comb_att"]);
+    })),
+    B_(model.Matrix(name + ".B", "decoder_b_att", true)),
+    U_(model.Packed(name + ".U", [&](const NpzConverter& npz) {
+      return model.Quantization().int16 ? mblas::PackedMatrix()
+                                        : mblas::PackedMatrix(npz["decoder_Wc_att"]);
+    })),
+    C_(model.Matrix(name + ".C", "decoder_c_tt")),
+    Wc_att_lns_(model.Matrix(name + ".Wc_att_lns", "decoder_Wc_att_lns")),
+    Wc_att_lnb_(model.Matrix(name + ".Wc_att_lnb", "decoder_Wc_att_lnb")),
+    W_comb_lns_(model.Matrix(name + ".W_comb_lns", "decoder_W_comb_att_lns")),
+    W_comb_lnb_(model.Matrix(name + ".W_comb_lnb", "decoder_W_comb_att_lnb")),
+    Wq_(model.Quantized16(name + ".Wq", [&](const NpzConverter& npz) {
+      return model.Quantization().int16 ? mblas::QuantizedMatrix16(npz["decoder_W_comb_att"])
+                                        : mblas::QuantizedMatrix16();
+    })),
+    Uq_(model.Quantized16(name + ".Uq", [&](const NpzConverter& npz) {
+      return model.Quantization().int16 ? mblas::QuantizedMatrix16(npz["decoder_Wc_att"])
+                                        : mblas::QuantizedMatrix16();
+    }))
 {}
 
-Weights::DecSoftmax::DecSoftmax(const NpzConverter& model)
-  : W1_(model["ff_logit_lstm_W"]),
-    B1_(model("ff_logit_lstm_b", true)),
-    W2_(model["ff_logit_prev_W"]),
-    B2_(model("ff_logit_prev_b", true)),
-    W3_(model["ff_logit_ctx_W"]),
-    B3_(model("ff_logit_ctx_b", true)),
-    W4_(model.getFirstOfMany({std::make_pair(std::string("ff_logit_W"), false),
-                              std::make_pair(std::string("Wemb_dec"), true)})),
-    B4_(model("ff_logit_b", true)),
-    lns_1_(model["ff_logit_lstm_ln_s"]),
-    lns_2_(model["ff_logit_prev_ln_s"]),
-    lns_3_(model["ff_logit_ctx_ln_s"]),
-    lnb_1_(model["ff_logit_lstm_ln_b"]),
-    lnb_2_(model["ff_logit_prev_ln_b"]),
-    lnb_3_(model["ff_logit_ctx_ln_b"])
+template <class Model>
+Weights::DecSoftmax::DecSoftmax(const Model& model, const std::string& name)
+  : W1_(model.Packed(name + ".W1", [](const NpzConverter& npz) {
+      return mblas::PackedMatrix(npz["ff_logit_lstm_W"]);
+    })),
+    B1_(model.Matrix(name + ".B1", "ff_logit_lstm_b", true)),
+    W2_(model.Packed(name + ".W2", [](const NpzConverter& npz) {
+      return mblas::PackedMatrix(npz["ff_logit_prev_W"]);
+    })),
+    B2_(model.Matrix(name + ".B2", "ff_logit_prev_b", true)),
+    W3_(model.Packed(name + ".W3", [](const NpzConverter& npz) {
+      return mblas::PackedMatrix(npz["ff_logit_ctx_W"]);
+    })),
+    B3_(model.Matrix(name + ".B3", "ff_logit_ctx_b", true)),
+    W4_(model.Packed(name + ".W4", [&](const NpzConverter& npz) {
+      const mblas::QuantizationOptions& quantization = model.Quantization();
+      return quantization.vocabMajorOutput || quantization.int8Output ? mblas::PackedMatrix() :
+          mblas::PackedMatrix(npz.getFirstOfMany(OutputLayer(false)));
+    })),
+    W4T_(model.View(name + ".W4T", [&](const NpzConverter& npz) {
+      return model.Quantization().vocabMajorOutput ? npz.View(OutputLayer(true)) : mblas::MatrixView();
+    })),
+    B4_(model.Matrix(name + ".B4", "ff_logit_b", true)),
+    W4q_(model.Quantized8(name + ".W4q", [&](const NpzConverter& npz) {
+      return model.Quantization().int8Output
+          ? mblas::QuantizedMatrix8(npz.getFirstOfMany(OutputLayer(false)))
+          : mblas::QuantizedMatrix8();
+    })),
+    lns_1_(model.Matrix(name + ".lns_1", "ff_logit_lstm_ln_s")),
+    lns_2_(model.Matrix(name + ".lns_2", "ff_logit_prev_ln_s")),
+    lns_3_(model.Matrix(name + ".lns_3", "ff_logit_ctx_ln_s")),
+    lnb_1_(model.Matrix(name + ".lnb_1", "ff_logit_lstm_ln_b")),
+    lnb_2_(model.Matrix(name + ".lnb_2", "ff_logit_prev_ln_b")),
+    lnb_3_(model.Matrix(name + ".lnb_3", "ff_logit_ctx_ln_b"))
 {}
 
 //////////////////////////////////////////////////////////////////////////////
 
-Weights::Weights(const NpzConverter& model, size_t)
-  : encEmbeddings_(model, "Wemb"),
-    decEmbeddings_(model, std::vector<std::pair<std::string, bool>>(
-          {std::make_pair(std::string("Wemb_dec"), false),
-           std::make_pair(std::string("Wemb"), false)})),
-    encForwardGRU_(model, "encoder_", {"W", "b", "U", "Wx", "bx", "Ux", "W_lns", "W_lnb", "Wx_lns",
-                                       "Wx_lnb", "U_lns", "U_lnb", "Ux_lns", "Ux_lnb" }),
-    encBackwardGRU_(model, "encoder_r_", {"W", "b", "U", "Wx", "bx", "Ux", "W_lns", "W_lnb",
-                                          "Wx_lns", "Wx_lnb", "U_lns", "U_lnb", "Ux_lns", "Ux_lnb" }),
-    decInit_(model),
-    decGru1_(model, "decoder_", {"W", "b", "U", "Wx", "bx", "Ux", "W_lns", "W_lnb", "Wx_lns",
-                                 "Wx_lnb", "U_lns", "U_lnb", "Ux_lns", "Ux_lnb" }),
-    decGru2_(model, "decoder_", {"Wc", "U_nl", "b_nl", "Wcx", "Ux_nl", "bx_nl", "Wc_lns", "Wc_lnb",
-                                 "Wcx_lns", "Wcx_lnb", "U_nl_lns", "U_nl_lnb", "Ux_nl_lns",
-                                 "Ux_nl_lnb"}),
-    decAttention_(model),
-    decSoftmax_(model),
-    encForwardTransition_(model, Weights::Transition::TransitionType::Encoder, "encoder_"),
-    encBackwardTransition_(model,Weights::Transition::TransitionType::Encoder, "encoder_r_"),
-    decTransition_(model, Weights::Transition::TransitionType::Decoder, "decoder_", "_nl")
+Weights::Weights(const NpzConverter& model, size_t, const mblas::QuantizationOptions& quantization)
+  : Weights(NpzSource(model, quantization))
+{}
+
+Weights::Weights(const BinaryModel& model, size_t)
+  : Weights(BinarySource(model))
 {}
 
+template <class Model>
+Weights::Weights(const Model& model)
+  : encEmbeddings_(model, "encEmbeddings", {std::make_pair(std::string("Wemb"), false)}),
+    decEmbeddings_(model, "decEmbeddings", {std::make_pair(std::string("Wemb_dec"), false),
+                                            std::make_pair(std::string("Wemb"), false)}),
+    encForwardGRU_(model, "encForwardGRU", "encoder_",
+                   {"W", "b", "U", "Wx", "bx", "Ux", "W_lns", "W_lnb", "Wx_lns",
+                    "Wx_lnb", "U_lns", "U_lnb", "Ux_lns", "Ux_lnb" }),
+    encBackwardGRU_(model, "encBackwardGRU", "encoder_r_",
+                    {"W", "b", "U", "Wx", "bx", "Ux", "W_lns", "W_lnb",
+                     "Wx_lns", "Wx_lnb", "U_lns", "U_lnb", "Ux_lns", "Ux_lnb" }),
+    decInit_(model, "decInit"),
+    decGru1_(model, "decGru1", "decoder_",
+             {"W", "b", "U", "Wx", "bx", "Ux", "W_lns", "W_lnb", "Wx_lns",
+              "Wx_lnb", "U_lns", "U_lnb", "Ux_lns", "Ux_lnb" }),
+    decGru2_(model, "decGru2", "decoder_",
+             {"Wc", "U_nl", "b_nl", "Wcx", "Ux_nl", "bx_nl", "Wc_lns", "Wc_lnb",
+              "Wcx_lns", "Wcx_lnb", "U_nl_lns", "U_nl_lnb", "Ux_nl_lns", "Ux_nl_lnb"}),
+    decAttention_(model, "decAttention"),
+    decSoftmax_(model, "decSoftmax"),
+    encForwardTransition_(model, Weights::Transition::TransitionType::Encoder,
+                          "encForwardTransition", "encoder_"),
+    encBackwardTransition_(model, Weights::Transition::TransitionType::Encoder,
+                           "encBackwardTransition", "encoder_r_"),
+    decTransition_(model, Weights::Transition::TransitionType::Decoder,
+                   "decTransition", "decoder_", "_nl")
+{}
+
+void Weights::Save(BinaryModelWriter& writer) const {
+  writer.Add("encEmbeddings", encEmbeddings_);
+  writer.Add("decEmbeddings", decEmbeddings_);
+  writer.Add("encForwardGRU", encForwardGRU_);
+  writer.Add("encBackwardGRU", encBackwardGRU_);
+  writer.Add("decInit", decInit_);
+  writer.Add("decGru1", decGru1_);
+  writer.Add("decGru2", decGru2_);
+  writer.Add("decAttention", decAttention_);
+  writer.Add("decSoftmax", decSoftmax_);
+  writer.Add("encForwardTransition", encForwardTransition_);
+  writer.Add("encBackwardTransition", encBackwardTransition_);
+  writer.Add("decTransition", decTransition_);
+}
+
 }  // namespace Nematus
 }  // namespace cpu
 }  // namespace amunmt
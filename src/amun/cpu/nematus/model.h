@@ -5,8 +5,11 @@
 #include <string>
 
 #include "cpu/npz_converter.h"
+#include "cpu/binary_model.h"
 
 #include "cpu/mblas/matrix.h"
+#include "cpu/mblas/packed.h"
+#include "cpu/mblas/quantized.h"
 
 namespace amunmt {
 namespace CPU {
@@ -17,8 +20,9 @@ struct Weights {
     public:
       enum class TransitionType {Encoder, Decoder};
 
-      Transition(const NpzConverter& model, TransitionType type, std::string prefix,
-                 std::string infix="");
+      template <class Model>
+      Transition(const Model& model, TransitionType type, const std::string& name,
+                 const std::string& prefix, const std::string& infix = "");
 
     static int findTransitionDepth(const NpzConverter& model, std::string prefix, std::string infix);
 
@@ -26,6 +30,22 @@ struct Weights {
 
     TransitionType type() const;
 
+    // the members by name, for the native model format
+    template <class F>
+    void Visit(F&& f) const {
+      f("B", B_);
+      f("Bx1", Bx1_);
+      f("Bx2", Bx2_);
+      f("U", U_);
+      f("Ux", Ux_);
+      f("U_lns", U_lns_);
+      f("U_lnb", U_lnb_);
+      f("Ux_lns", Ux_lns_);
+      f("Ux_lnb", Ux_lnb_);
+      f("Uq", Uq_);
+      f("Uxq", Uxq_);
+    }
+
     protected:
       std::string name(const std::string& prefix, std::string name, std::string infix, int index,
           std::string suffix = "");
@@ -38,25 +58,64 @@ struct Weights {
       std::vector<mblas::Matrix> B_;
       std::vector<mblas::Matrix> Bx1_;
       std::vector<mblas::Matrix> Bx2_;
-      std::vector<mblas::Matrix> U_;
-      std::vector<mblas::Matrix> Ux_;
+      // empty with --cpu-int16
+      std::vector<mblas::PackedMatrix> U_;
+      std::vector<mblas::PackedMatrix> Ux_;
 
       std::vector<mblas::Matrix> U_lns_;
       std::vector<mblas::Matrix> U_lnb_;
       std::vector<mblas::Matrix> Ux_lns_;
       std::vector<mblas::Matrix> Ux_lnb_;
 
+      // only prepared for --cpu-int16, empty otherwise
+      std::vector<mblas::QuantizedMatrix16> Uq_;
+      std::vector<mblas::QuantizedMatrix16> Uxq_;
   };
 
   struct Embeddings {
-    Embeddings(const NpzConverter& model, const std::string &key);
-    Embeddings(const NpzConverter& model, const std::vector<std::pair<std::string, bool>> keys);
-
-    const mblas::Matrix E_;
+    template <class Model>
+    Embeddings(const Model& model, const std::string& name,
+               const std::vector<std::pair<std::string, bool>>& keys);
+
+    // the members by name, for the native model format
+    template <class F>
+    void Visit(F&& f) const {
+      f("E", E_);
+    }
+
+    // in the mapped model file
+    const mblas::MatrixView E_;
   };
 
   struct GRU {
-    GRU(const NpzConverter& model, std::string prefix, std::vector<std::string> keys);
+    template <class Model>
+    GRU(const Model& model, const std::string& name, const std::string& prefix,
+        const std::vector<std::string>& keys);
+
+    // the members by name, for the native model format
+    template <class F>
+    void Visit(F&& f) const {
+      f("W", W_);
+      f("B", B_);
+      f("U", U_);
+      f("Wx", Wx_);
+      f("Bx1", Bx1_);
+      f("Bx2", Bx2_);
+      f("Bx3", Bx3_);
+      f("Ux", Ux_);
+      f("W_lns", W_lns_);
+      f("W_lnb", W_lnb_);
+      f("Wx_lns", Wx_lns_);
+      f("Wx_lnb", Wx_lnb_);
+      f("U_lns", U_lns_);
+      f("U_lnb", U_lnb_);
+      f("Ux_lns", Ux_lns_);
+      f("Ux_lnb", Ux_lnb_);
+      f("WWx", WWx_);
+      f("UUx", UUx_);
+      f("WWxq", WWxq_);
+      f("UUxq", UUxq_);
+    }
 
     const mblas::Matrix W_;
     const mblas::Matrix B_;
@@ -75,10 +134,27 @@ struct Weights {
     const mblas::Matrix U_lnb_;
     const mblas::Matrix Ux_lns_;
     const mblas::Matrix Ux_lnb_;
+
+    // [W Wx] and [U Ux], shared by the GRUs of all threads; the packed ones
+    // are empty with --cpu-int16, the quantized ones without
+    const mblas::PackedMatrix WWx_;
+    const mblas::PackedMatrix UUx_;
+    const mblas::QuantizedMatrix16 WWxq_;
+    const mblas::QuantizedMatrix16 UUxq_;
   };
 
   struct DecInit {
-    DecInit(const NpzConverter& model);
+    template <class Model>
+    DecInit(const Model& model, const std::string& name);
+
+    // the members by name, for the native model format
+    template <class F>
+    void Visit(F&& f) const {
+      f("Wi", Wi_);
+      f("Bi", Bi_);
+      f("lns", lns_);
+      f("lnb", lnb_);
+    }
 
     const mblas::Matrix Wi_;
     const mblas::Matrix Bi_;
@@ -87,7 +163,34 @@ struct Weights {
   };
 
   struct DecGRU2 {
-    DecGRU2(const NpzConverter& model, std::string prefix, std::vector<std::string> keys);
+    template <class Model>
+    DecGRU2(const Model& model, const std::string& name, const std::string& prefix,
+            const std::vector<std::string>& keys);
+
+    // the members by name, for the native model format
+    template <class F>
+    void Visit(F&& f) const {
+      f("W", W_);
+      f("B", B_);
+      f("U", U_);
+      f("Wx", Wx_);
+      f("Bx1", Bx1_);
+      f("Bx2", Bx2_);
+      f("Bx3", Bx3_);
+      f("Ux", Ux_);
+      f("W_lns", W_lns_);
+      f("W_lnb", W_lnb_);
+      f("Wx_lns", Wx_lns_);
+      f("Wx_lnb", Wx_lnb_);
+      f("U_lns", U_lns_);
+      f("U_lnb", U_lnb_);
+      f("Ux_lns", Ux_lns_);
+      f("Ux_lnb", Ux_lnb_);
+      f("WWx", WWx_);
+      f("UUx", UUx_);
+      f("WWxq", WWxq_);
+      f("UUxq", UUxq_);
+    }
 
     const mblas::Matrix W_;
     const mblas::Matrix B_;
@@ -106,33 +209,91 @@ struct Weights {
     const mblas::Matrix U_lnb_;
     const mblas::Matrix Ux_lns_;
     const mblas::Matrix Ux_lnb_;
+
+    // [W Wx] and [U Ux], shared by the GRUs of all threads; the packed ones
+    // are empty with --cpu-int16, the quantized ones without
+    const mblas::PackedMatrix WWx_;
+    const mblas::PackedMatrix UUx_;
+    const mblas::QuantizedMatrix16 WWxq_;
+    const mblas::QuantizedMatrix16 UUxq_;
   };
 
   struct DecAttention {
-    DecAttention(const NpzConverter& model);
+    template <class Model>
+    DecAttention(const Model& model, const std::string& name);
+
+    // the members by name, for the native model format
+    template <class F>
+    void Visit(F&& f) const {
+      f("V", V_);
+      f("W", W_);
+      f("B", B_);
+      f("U", U_);
+      f("C", C_);
+      f("Wc_att_lns", Wc_att_lns_);
+      f("Wc_att_lnb", Wc_att_lnb_);
+      f("W_comb_lns", W_comb_lns_);
+      f("W_comb_lnb", W_comb_lnb_);
+      f("Wq", Wq_);
+      f("Uq", Uq_);
+    }
 
     const mblas::Matrix V_;
-    const mblas::Matrix W_;
+    // W_ and U_ are empty with --cpu-int16
+    const mblas::PackedMatrix W_;
     const mblas::Matrix B_;
-    const mblas::Matrix U_;
+    const mblas::PackedMatrix U_;
     const mblas::Matrix C_;
     const mblas::Matrix Wc_att_lns_;
     const mblas::Matrix Wc_att_lnb_;
     const mblas::Matrix W_comb_lns_;
     const mblas::Matrix W_comb_lnb_;
+
+    // only prepared for --cpu-int16, empty otherwise
+    const mblas::QuantizedMatrix16 Wq_;
+    const mblas::QuantizedMatrix16 Uq_;
   };
 
   struct DecSoftmax {
-    DecSoftmax(const NpzConverter& model);
-
-    const mblas::Matrix W1_;
+    template <class Model>
+    DecSoftmax(const Model& model, const std::string& name);
+
+    // the members by name, for the native model format
+    template <class F>
+    void Visit(F&& f) const {
+      f("W1", W1_);
+      f("B1", B1_);
+      f("W2", W2_);
+      f("B2", B2_);
+      f("W3", W3_);
+      f("B3", B3_);
+      f("W4", W4_);
+      f("W4T", W4T_);
+      f("B4", B4_);
+      f("W4q", W4q_);
+      f("lns_1", lns_1_);
+      f("lns_2", lns_2_);
+      f("lns_3", lns_3_);
+      f("lnb_1", lnb_1_);
+      f("lnb_2", lnb_2_);
+      f("lnb_3", lnb_3_);
+    }
+
+    const mblas::PackedMatrix W1_;
     const mblas::Matrix B1_;
-    const mblas::Matrix W2_;
+    const mblas::PackedMatrix W2_;
     const mblas::Matrix B2_;
-    const mblas::Matrix W3_;
+    const mblas::PackedMatrix W3_;
     const mblas::Matrix B3_;
-    const mblas::Matrix W4_;
+    // the output layer is kept in one of three forms: W4_ by default, W4T_
+    // for QuantizationOptions::vocabMajorOutput and W4q_ for
+    // --cpu-int8-output; the other two are empty
+    const mblas::PackedMatrix W4_;
+    // W4_ transposed, a row per target word; in the mapped model file
+    // when the output layer is tied to the target embeddings
+    const mblas::MatrixView W4T_;
     const mblas::Matrix B4_;
+    const mblas::QuantizedMatrix8 W4q_;
     const mblas::Matrix lns_1_;
     const mblas::Matrix lns_2_;
     const mblas::Matrix lns_3_;
@@ -142,11 +303,18 @@ struct Weights {
   };
 
 
-  Weights(const std::string& npzFile, size_t device = 0)
-    : Weights(NpzConverter(npzFile), device)
+  Weights(const std::string& npzFile, size_t device = 0,
+          const mblas::QuantizationOptions& quantization = mblas::QuantizationOptions())
+    : Weights(NpzConverter(npzFile), device, quantization)
   {}
 
-  Weights(const NpzConverter& model, size_t device = 0);
+  Weights(const NpzConverter& model, size_t device = 0,
+          const mblas::QuantizationOptions& quantization = mblas::QuantizationOptions());
+
+  // a model converted by amun-convert, in the forms it was converted to
+  Weights(const BinaryModel& model, size_t device = 0);
+
+  void Save(BinaryModelWriter& writer) const;
 
   size_t GetDevice() {
     return std::numeric_limits<size_t>::max();
@@ -164,6 +332,11 @@ struct Weights {
   const Transition encForwardTransition_;
   const Transition encBackwardTransition_;
   const Transition decTransition_;
+
+ private:
+  // from an NpzSource or a BinarySource, see cpu/weights_source.h
+  template <class Model>
+  explicit Weights(const Model& model);
 };
 
 inline std::ostream& operator<<(std::ostream &out, const Weights::Embeddings &obj)
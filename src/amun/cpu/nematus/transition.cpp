@@ -1,4 +1,5 @@
 #include "transition.h"
+#include "cpu/mblas/quantized.h"
 
 namespace amunmt {
 namespace CPU {
@@ -18,8 +19,7 @@ void Transition::GetNextState(mblas::Matrix& state) const
 {
   if (layerNormalization_) {
     for (int i = 0; i < w_.size(); ++i) {
-      Temp_1_ = state * w_.U_[i];
-      Temp_2_ = state * w_.Ux_[i];
+      Project(state, i);
 
       switch(w_.type()) {
         case Weights::Transition::TransitionType::Encoder:
@@ -41,8 +41,7 @@ void Transition::GetNextState(mblas::Matrix& state) const
     }
   } else {
     for (int i = 0; i < w_.size(); ++i) {
-      Temp_1_ = state * w_.U_[i];
-      Temp_2_ = state * w_.Ux_[i];
+      Project(state, i);
       mblas::AddBiasVector<mblas::byRow>(Temp_1_, w_.B_[i]);
       mblas::AddBiasVector<mblas::byRow>(Temp_2_, w_.Bx1_[i]);
       ElementwiseOps(state, i);
@@ -51,28 +50,29 @@ void Transition::GetNextState(mblas::Matrix& state) const
 }
 
 
+void Transition::Project(const mblas::Matrix& state, int idx) const {
+  if (w_.Uq_.empty()) {
+    mblas::PackedGemm(state, w_.U_[idx], Temp_1_);
+    mblas::PackedGemm(state, w_.Ux_[idx], Temp_2_);
+  } else {
+    mblas::Int16Gemm(state, w_.Uq_[idx], Temp_1_);
+    mblas::Int16Gemm(state, w_.Uxq_[idx], Temp_2_);
+  }
+}
+
+
 void Transition::ElementwiseOps(mblas::Matrix& state, int idx) const {
-  using namespace mblas;
-  using namespace blaze;
-
-  for (int j = 0; j < (int)state.dim(0); ++j) {
-    auto rowState = row(state, j);
-    auto rowT   = row(Temp_1_, j);
-    auto rowT2  = row(Temp_2_, j);
-
-    for (int i = 0; i < (int)state.dim(1); ++i) {
-      float ev1 = expapprox(-(rowT[i])); // + w_.B_[idx](0, i)));
-      float r = 1.0f / (1.0f + ev1);
-
-      int k = i + state.dim(1);
-      float ev2 = expapprox(-(rowT[k])); // + w_.B_[idx](0, k)));
-      float u = 1.0f / (1.0f + ev2);
-
-      float hv = w_.Bx2_[idx](0, i);
-      float t2v = rowT2[i]; // + w_.Bx1_[idx](0, i);
-      hv = tanhapprox(hv + r * t2v);
-      rowState[i] = (1.0f - u) * hv + u * rowState[i];
-    }
+  const size_t colNo = state.columns();
+
+  // the input of a transition layer is only the bias, B_ and Bx1_ are
+  // added before the layer normalization
+  mblas::GRUGates gates;
+  gates.hInputBias = &w_.Bx2_[idx](0, 0);
+
+  for (size_t j = 0; j < state.rows(); ++j) {
+    gates.ruState = &Temp_1_(j, 0);
+    gates.hState = &Temp_2_(j, 0);
+    mblas::GRUStep(gates, &state(j, 0), &state(j, 0), colNo);
   }
 }
 
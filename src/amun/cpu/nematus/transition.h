@@ -16,12 +16,14 @@ class Transition {
   protected:
     void ElementwiseOps(mblas::Matrix& state, int idx) const;
 
+    // Temp_1_ = state * U_[idx], Temp_2_ = state * Ux_[idx]
+    void Project(const mblas::Matrix& state, int idx) const;
+
   private:
     // Model matrices
     const Weights::Transition& w_;
 
     // reused to avoid allocation
-    mutable mblas::Matrix UUx_;
     mutable mblas::Matrix RUH_;
     mutable mblas::Matrix RUH_1_;
     mutable mblas::Matrix RUH_2_;
@@ -0,0 +1,263 @@
+#include "cpu/npz_converter.h"
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "common/exception.h"
+
+namespace amunmt {
+namespace CPU {
+
+namespace {
+
+typedef blaze::CustomMatrix<float, blaze::unaligned,
+  blaze::unpadded, blaze::rowMajor> BlazeWrapper;
+
+const uint32_t LOCAL_HEADER = 0x04034b50;
+const uint32_t DIRECTORY_ENTRY = 0x02014b50;
+const uint32_t END_OF_DIRECTORY = 0x06054b50;
+const uint32_t ZIP64_END_OF_DIRECTORY = 0x06064b50;
+const uint32_t ZIP64_LOCATOR = 0x07064b50;
+const uint16_t ZIP64_EXTRA = 0x0001;
+
+// zip and npy fields are little endian and unaligned
+template <class T>
+T Read(const char* p) {
+  T value;
+  std::memcpy(&value, p, sizeof(T));
+  return value;
+}
+
+// value of key in the dictionary of an npy header, up to the next comma
+// outside of parentheses
+std::string HeaderField(const std::string& header, const std::string& key) {
+  size_t pos = header.find("'" + key + "'");
+  if (pos == std::string::npos) {
+    return "";
+  }
+  pos = header.find(':', pos);
+  if (pos == std::string::npos) {
+    return "";
+  }
+  size_t end = pos + 1;
+  for (int depth = 0; end < header.size(); ++end) {
+    char c = header[end];
+    if (c == '(') ++depth;
+    if (c == ')') --depth;
+    if ((c == ',' && depth == 0) || c == '}') break;
+  }
+  std::string value = header.substr(pos + 1, end - pos - 1);
+  size_t first = value.find_first_not_of(" \t");
+  size_t last = value.find_last_not_of(" \t");
+  return first == std::string::npos ? "" : value.substr(first, last - first + 1);
+}
+
+}
+
+NpzConverter::NpzConverter(const std::string& file, bool hugePages)
+  : file_(new MappedFile(file))
+{
+  file_->WillNeed();
+  if (hugePages && !file_->HugePages()) {
+    std::cerr << "No huge pages for " << file << std::endl;
+  }
+  ReadDirectory();
+}
+
+void NpzConverter::ReadDirectory() {
+  const char* begin = file_->data();
+  const size_t size = file_->size();
+  const std::string& path = file_->path();
+
+  // the end of directory record is followed by a comment of up to 64k
+  size_t eocd = std::string::npos;
+  for (size_t back = 22; back <= size && back <= 22 + 0xffff; ++back) {
+    if (Read<uint32_t>(begin + size - back) == END_OF_DIRECTORY) {
+      eocd = size - back;
+      break;
+    }
+  }
+  amunmt_UTIL_THROW_IF2(eocd == std::string::npos, path << " is not an npz file");
+
+  uint64_t entries = Read<uint16_t>(begin + eocd + 10);
+  uint64_t directory = Read<uint32_t>(begin + eocd + 16);
+  if (eocd >= 20 && Read<uint32_t>(begin + eocd - 20) == ZIP64_LOCATOR) {
+    uint64_t zip64 = Read<uint64_t>(begin + eocd - 20 + 8);
+    amunmt_UTIL_THROW_IF2(zip64 + 56 > size || Read<uint32_t>(begin + zip64) != ZIP64_END_OF_DIRECTORY,
+                          "Broken zip64 directory in " << path);
+    entries = Read<uint64_t>(begin + zip64 + 32);
+    directory = Read<uint64_t>(begin + zip64 + 48);
+  }
+
+  size_t pos = directory;
+  for (uint64_t i = 0; i < entries; ++i) {
+    amunmt_UTIL_THROW_IF2(pos + 46 > size || Read<uint32_t>(begin + pos) != DIRECTORY_ENTRY,
+                          "Broken zip directory in " << path);
+    uint16_t method = Read<uint16_t>(begin + pos + 10);
+    uint64_t stored = Read<uint32_t>(begin + pos + 20);
+    uint64_t original = Read<uint32_t>(begin + pos + 24);
+    uint16_t nameLength = Read<uint16_t>(begin + pos + 28);
+    uint16_t extraLength = Read<uint16_t>(begin + pos + 30);
+    uint16_t commentLength = Read<uint16_t>(begin + pos + 32);
+    uint64_t offset = Read<uint32_t>(begin + pos + 42);
+    amunmt_UTIL_THROW_IF2(pos + 46 + nameLength + extraLength > size,
+                          "Broken zip directory in " << path);
+    std::string name(begin + pos + 46, nameLength);
+
+    // sizes and offset that do not fit 32 bits are in the zip64 extra
+    // field, in this order
+    const char* extra = begin + pos + 46 + nameLength;
+    const char* extraEnd = extra + extraLength;
+    while (extra + 4 <= extraEnd) {
+      uint16_t id = Read<uint16_t>(extra);
+      uint16_t length = Read<uint16_t>(extra + 2);
+      if (id == ZIP64_EXTRA) {
+        const char* field = extra + 4;
+        if (original == 0xffffffff) { original = Read<uint64_t>(field); field += 8; }
+        if (stored == 0xffffffff) { stored = Read<uint64_t>(field); field += 8; }
+        if (offset == 0xffffffff) { offset = Read<uint64_t>(field); field += 8; }
+      }
+      extra += 4 + length;
+    }
+    pos += 46 + nameLength + extraLength + commentLength;
+
+    amunmt_UTIL_THROW_IF2(method != 0 || stored != original,
+                          name << " in " << path << " is compressed, save the model with "
+                          "numpy.savez instead of numpy.savez_compressed");
+    amunmt_UTIL_THROW_IF2(offset + 30 > size || Read<uint32_t>(begin + offset) != LOCAL_HEADER,
+                          "Broken zip entry " << name << " in " << path);
+
+    // the extra field of the local header may differ from the directory's
+    size_t data = offset + 30 + Read<uint16_t>(begin + offset + 26)
+                             + Read<uint16_t>(begin + offset + 28);
+    amunmt_UTIL_THROW_IF2(data + stored > size, "Broken zip entry " << name << " in " << path);
+
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".npy") == 0) {
+      name.erase(name.size() - 4);
+    }
+    AddEntry(name, data, stored);
+  }
+}
+
+void NpzConverter::AddEntry(const std::string& name, size_t offset, size_t size) {
+  const char* npy = file_->data() + offset;
+  const std::string& path = file_->path();
+
+  // magic, version, header length (2 bytes in version 1, 4 after), header
+  amunmt_UTIL_THROW_IF2(size < 10 || std::memcmp(npy, "\x93NUMPY", 6) != 0,
+                        name << " in " << path << " is not an npy array");
+  size_t headerLength, headerStart;
+  if (npy[6] == 1) {
+    headerLength = Read<uint16_t>(npy + 8);
+    headerStart = 10;
+  } else {
+    amunmt_UTIL_THROW_IF2(size < 12, name << " in " << path << " is not an npy array");
+    headerLength = Read<uint32_t>(npy + 8);
+    headerStart = 12;
+  }
+  amunmt_UTIL_THROW_IF2(headerStart + headerLength > size,
+                        "Broken npy header of " << name << " in " << path);
+  std::string header(npy + headerStart, headerLength);
+
+  std::string descr = HeaderField(header, "descr");
+  std::string shape = HeaderField(header, "shape");
+  std::vector<size_t> dims;
+  for (size_t i = 0; i < shape.size(); ) {
+    if (isdigit(shape[i])) {
+      size_t length;
+      dims.push_back(std::stoul(shape.substr(i), &length));
+      i += length;
+    } else {
+      ++i;
+    }
+  }
+
+  Array array;
+  array.data = npy + headerStart + headerLength;
+  // a scalar is 1x1 and a vector a column, as cnpy read them
+  array.rows = dims.empty() ? 1 : dims[0];
+  array.columns = dims.size() < 2 ? 1 : dims[1];
+  array.usable = (descr == "'<f4'" || descr == "'=f4'")
+                 && HeaderField(header, "fortran_order") == "False"
+                 && dims.size() <= 2
+                 && headerStart + headerLength + array.rows * array.columns * sizeof(float) <= size;
+  arrays_[name] = array;
+}
+
+const NpzConverter::Array& NpzConverter::Get(const std::string& key) const {
+  const Array& array = arrays_.at(key);
+  amunmt_UTIL_THROW_IF2(!array.usable, key << " in " << file_->path()
+                        << " is not a float32 matrix in C order");
+  return array;
+}
+
+mblas::Matrix NpzConverter::Copy(const Array& array, bool transpose) const {
+  BlazeWrapper matrix((float*)array.data, array.rows, array.columns);
+  mblas::Matrix ret;
+  if (transpose) {
+    ret = blaze::trans(matrix);
+  } else {
+    ret = matrix;
+  }
+  return ret;
+}
+
+mblas::Matrix NpzConverter::operator[](const std::string& key) const {
+  if (!has(key)) {
+    if (key.find("gamma") == std::string::npos) {
+      std::cerr << "Missing " << key << std::endl;
+    }
+    return mblas::Matrix();
+  }
+  return Copy(Get(key), false);
+}
+
+mblas::Matrix NpzConverter::getFirstOfMany(const std::vector<std::pair<std::string, bool>> keys) const {
+  for (auto& key : keys) {
+    if (has(key.first)) {
+      return Copy(Get(key.first), key.second);
+    }
+  }
+  std::cerr << "Matrix not found: " << keys[0].first << "\n";
+  return mblas::Matrix();
+}
+
+mblas::Matrix NpzConverter::operator()(const std::string& key,
+                                       bool transpose) const {
+  if (!has(key)) {
+    std::cerr << "Missing " << key << std::endl;
+    return mblas::Matrix();
+  }
+  return Copy(Get(key), transpose);
+}
+
+mblas::MatrixView NpzConverter::View(const std::vector<std::pair<std::string, bool>>& keys) const {
+  for (auto& key : keys) {
+    if (!has(key.first)) {
+      continue;
+    }
+    const Array& array = Get(key.first);
+    if (!key.second) {
+      return mblas::MatrixView(file_, reinterpret_cast<const float*>(array.data),
+                               array.rows, array.columns);
+    }
+    if (array.rows == 1 || array.columns == 1) {
+      return mblas::MatrixView(file_, reinterpret_cast<const float*>(array.data),
+                               array.columns, array.rows);
+    }
+
+    // transposed into a buffer of its own, without padding
+    std::shared_ptr<std::vector<float>> copy(new std::vector<float>(array.rows * array.columns));
+    BlazeWrapper source((float*)array.data, array.rows, array.columns);
+    BlazeWrapper target(copy->data(), array.columns, array.rows);
+    target = blaze::trans(source);
+    return mblas::MatrixView(copy, copy->data(), array.columns, array.rows);
+  }
+  std::cerr << "Matrix not found: " << keys[0].first << "\n";
+  return mblas::MatrixView();
+}
+
+}
+}
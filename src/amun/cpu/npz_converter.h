@@ -1,137 +1,62 @@
 #pragma once
 
-#include "cnpy/cnpy.h"
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/mapped_file.h"
 #include "mblas/matrix.h"
 
 namespace amunmt {
 namespace CPU {
 
+// Reads the arrays of a model saved with numpy.savez. The file is mapped
+// instead of read, the arrays are found through the zip directory and are
+// used where they lie: the matrices returned by value are copied straight
+// from the mapped pages, the views point into them and keep the file mapped.
+// Entries have to be stored uncompressed, as savez does, and hold float32
+// values in C order.
 class NpzConverter {
-  private:
-    class NpyMatrixWrapper {
-      public:
-        NpyMatrixWrapper(const cnpy::NpyArray& npy)
-        : npy_(npy) {}
-
-        size_t size() const {
-          return size1() * size2();
-        }
-
-        float* data() const {
-          return (float*)npy_.data;
-        }
-
-        float operator()(size_t i, size_t j) const {
-          return ((float*)npy_.data)[i * size2() + j];
-        }
-
-        size_t size1() const {
-          return npy_.shape[0];
-        }
-
-        size_t size2() const {
-          if(npy_.shape.size() == 1)
-            return 1;
-          else
-            return npy_.shape[1];
-        }
-
-      private:
-        const cnpy::NpyArray& npy_;
-    };
-
   public:
-
-    typedef blaze::CustomMatrix<float, blaze::unaligned,
-      blaze::unpadded, blaze::rowMajor> BlazeWrapper;
+    explicit NpzConverter(const std::string& file, bool hugePages = false);
 
     bool has(std::string key) const {
-      auto it = model_.find(key);
-      return (it != model_.end());
+      return arrays_.count(key);
     }
 
+    mblas::Matrix operator[](const std::string& key) const;
 
-    NpzConverter(const std::string& file)
-      : model_(cnpy::npz_load(file)),
-        destructed_(false) {
-      }
+    // the first of the keys in the model, transposed if its flag is set
+    mblas::Matrix getFirstOfMany(const std::vector<std::pair<std::string, bool>> keys) const;
 
-    ~NpzConverter() {
-      if(!destructed_)
-        model_.destruct();
-    }
+    mblas::Matrix operator()(const std::string& key,
+                             bool transpose) const;
 
-    void Destruct() {
-      model_.destruct();
-      destructed_ = true;
-    }
+    // The first of the keys in place, for large matrices used as they are
+    // stored. One transposed by its flag is copied instead, unless it is a
+    // vector.
+    mblas::MatrixView View(const std::vector<std::pair<std::string, bool>>& keys) const;
 
-    mblas::Matrix operator[](const std::string& key) const {
-      BlazeWrapper matrix;
-      auto it = model_.find(key);
-      if(it != model_.end()) {
-        NpyMatrixWrapper np(it->second);
-        matrix = BlazeWrapper(np.data(), np.size1(), np.size2());
-      }
-      else {
-        if (key.find("gamma") == std::string::npos) {
-          std::cerr << "Missing " << key << std::endl;
-        }
-      }
-
-      mblas::Matrix ret;
-      ret = matrix;
-      return std::move(ret);
-    }
+  private:
+    struct Array {
+      const char* data;
+      size_t rows;
+      size_t columns;
+      // only float32 in C order can be used
+      bool usable;
+    };
 
-    mblas::Matrix getFirstOfMany(const std::vector<std::pair<std::string, bool>> keys) const {
-      BlazeWrapper matrix;
-      for (auto key : keys) {
-        auto it = model_.find(key.first);
-        if(it != model_.end()) {
-          NpyMatrixWrapper np(it->second);
-          matrix = BlazeWrapper(np.data(), np.size1(), np.size2());
-          mblas::Matrix ret;
-          if (key.second) {
-            const auto matrix2 = blaze::trans(matrix);
-            ret = matrix2;
-          } else {
-            ret = matrix;
-          }
-          return std::move(ret);
-        }
-      }
-      std::cerr << "Matrix not found: " << keys[0].first << "\n";
-
-      mblas::Matrix ret;
-      return std::move(ret);
-    }
+    void ReadDirectory();
 
-    mblas::Matrix operator()(const std::string& key,
-                                   bool transpose) const {
-      BlazeWrapper matrix;
-      auto it = model_.find(key);
-      if(it != model_.end()) {
-        NpyMatrixWrapper np(it->second);
-        matrix = BlazeWrapper(np.data(), np.size1(), np.size2());
-      } else {
-          std::cerr << "Missing " << key << std::endl;
-      }
-      mblas::Matrix ret;
-      if (transpose) {
-        const auto matrix2 = blaze::trans(matrix);
-        ret = matrix2;
-      } else {
-        ret = matrix;
-      }
-      return std::move(ret);
-    }
+    void AddEntry(const std::string& name, size_t offset, size_t size);
 
-  private:
-    cnpy::npz_t model_;
-    bool destructed_;
+    const Array& Get(const std::string& key) const;
+
+    mblas::Matrix Copy(const Array& array, bool transpose) const;
+
+    MappedFilePtr file_;
+    std::map<std::string, Array> arrays_;
 };
 
 }
 }
-
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+
+#include "cpu/binary_model.h"
+#include "cpu/npz_converter.h"
+
+namespace amunmt {
+namespace CPU {
+
+// What the constructors of the Weights structs read their members from, an
+// npz model or a native one; the constructors are templates on the two.
+// Every member is given both ways: by its tensor name in the native model
+// and by its npz key or by make, which builds it from the npz model in the
+// form the decoders use. NpzSource takes the key or calls make, BinarySource
+// reads the tensor, which holds the member in that form already.
+class NpzSource {
+  public:
+    NpzSource(const NpzConverter& model, const mblas::QuantizationOptions& quantization)
+      : model_(model), quantization_(quantization)
+    {}
+
+    const mblas::QuantizationOptions& Quantization() const {
+      return quantization_;
+    }
+
+    mblas::Matrix Matrix(const std::string&, const std::string& key) const {
+      return model_[key];
+    }
+
+    mblas::Matrix Matrix(const std::string&, const std::string& key, bool transpose) const {
+      return model_(key, transpose);
+    }
+
+    template <class F>
+    mblas::MatrixView View(const std::string&, F&& make) const {
+      return make(model_);
+    }
+
+    template <class F>
+    mblas::PackedMatrix Packed(const std::string&, F&& make) const {
+      return make(model_);
+    }
+
+    template <class F>
+    mblas::QuantizedMatrix8 Quantized8(const std::string&, F&& make) const {
+      return make(model_);
+    }
+
+    template <class F>
+    mblas::QuantizedMatrix16 Quantized16(const std::string&, F&& make) const {
+      return make(model_);
+    }
+
+    // length of a list of members
+    template <class F>
+    size_t Count(const std::string&, F&& make) const {
+      return make(model_);
+    }
+
+  private:
+    const NpzConverter& model_;
+    const mblas::QuantizationOptions quantization_;
+};
+
+class BinarySource {
+  public:
+    explicit BinarySource(const BinaryModel& model)
+      : model_(model)
+    {}
+
+    const mblas::QuantizationOptions& Quantization() const {
+      return model_.Quantization();
+    }
+
+    mblas::Matrix Matrix(const std::string& name, const std::string&, bool = false) const {
+      return model_.Matrix(name);
+    }
+
+    template <class F>
+    mblas::MatrixView View(const std::string& name, F&&) const {
+      return model_.View(name);
+    }
+
+    template <class F>
+    mblas::PackedMatrix Packed(const std::string& name, F&&) const {
+      return model_.Packed(name);
+    }
+
+    template <class F>
+    mblas::QuantizedMatrix8 Quantized8(const std::string& name, F&&) const {
+      return model_.Quantized8(name);
+    }
+
+    template <class F>
+    mblas::QuantizedMatrix16 Quantized16(const std::string& name, F&&) const {
+      return model_.Quantized16(name);
+    }
+
+    // the tensors "<name>.0", "<name>.1" and so on, as BinaryModelWriter
+    // stores a list
+    template <class F>
+    size_t Count(const std::string& name, F&&) const {
+      size_t count = 0;
+      while (model_.Has(name + "." + std::to_string(count))) {
+        ++count;
+      }
+      return count;
+    }
+
+  private:
+    const BinaryModel& model_;
+};
+
+}
+}
@@ -116,10 +116,10 @@ void BestHyps::CalcBeam(
 
     HypothesisPtr hyp;
     if (returnAlignment) {
-      //hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost,
-      //                         GetAlignments(scorers, hypIndex)));
+      //hyp = NewHypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost,
+      //                    GetAlignments(scorers, hypIndex));
     } else {
-      hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost));
+      hyp = NewHypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost);
     }
 
     if(doBreakdown) {
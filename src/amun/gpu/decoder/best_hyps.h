@@ -152,10 +152,10 @@ class BestHyps : public BestHypsBase
 
         HypothesisPtr hyp;
         if (returnAttentionWeights_) {
-          hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost,
-                                   GetAlignments(scorers, hypIndex)));
+          hyp = NewHypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost,
+                              GetAlignments(scorers, hypIndex));
         } else {
-          hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost));
+          hyp = NewHypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost);
         }
 
         if(returnNBestList_) {
@@ -296,10 +296,10 @@ std::cout << "Get DONE COL BY KEY " << std::endl;
         std::cout << "Hypothesis index [" << i << "] " << hypIndex << " and cost" << cost << std::endl;
         HypothesisPtr hyp;
         if (returnAttentionWeights_) {
-          hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost,
-                                   GetAlignments(scorers, hypIndex)));
+          hyp = NewHypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost,
+                              GetAlignments(scorers, hypIndex));
         } else {
-          hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost));
+          hyp = NewHypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost);
         }
 
         if(returnNBestList_) {
@@ -20,6 +20,15 @@ using namespace std;
 
 God god_;
 
+// lets other Python threads run while amun works
+class ReleaseGIL {
+  public:
+    ReleaseGIL() : state_(PyEval_SaveThread()) {}
+    ~ReleaseGIL() { PyEval_RestoreThread(state_); }
+  private:
+    PyThreadState* state_;
+};
+
 void init(const std::string& options) {
   god_.Init(options);
 }
@@ -72,9 +81,12 @@ boost::python::list translate(boost::python::list& in)
 
   // resort batch into line number order
   Histories allHistories;
-  for (auto&& result : results) {
-    std::shared_ptr<Histories> histories = result.get();
-    allHistories.Append(*histories);
+  {
+    ReleaseGIL release;
+    for (auto&& result : results) {
+      std::shared_ptr<Histories> histories = result.get();
+      allHistories.Append(*histories);
+    }
   }
   allHistories.SortByLineNum();
 
@@ -88,8 +100,21 @@ boost::python::list translate(boost::python::list& in)
   return output;
 }
 
+// Loads the scorers again and switches to them, see God::Reload; scorers is
+// a YAML map like the scorers section of the config, empty for that section.
+// Other Python threads may translate meanwhile.
+void reload(const std::string& scorers) {
+  ReleaseGIL release;
+  if (scorers.empty()) {
+    god_.Reload();
+  } else {
+    god_.Reload(YAML::Load(scorers));
+  }
+}
+
 BOOST_PYTHON_MODULE(libamunmt)
 {
   boost::python::def("init", init);
   boost::python::def("translate", translate);
+  boost::python::def("reload", reload, (boost::python::arg("scorers") = ""));
 }
@@ -0,0 +1,172 @@
+// A model converted by amun-convert has to load the same weights as the npz
+// model it was converted from, in every form the decoders keep them, and a
+// native model of another version or a damaged one has to be refused.
+
+#include "check.h"
+
+#include <cmath>
+#include <vector>
+
+#include "cnpy/cnpy.h"
+#include "common/logging.h"
+#include "cpu/binary_model.h"
+#include "cpu/npz_converter.h"
+
+using namespace amunmt;
+using namespace amunmt::CPU;
+
+namespace {
+
+// one member of every kind the writer handles
+struct Weights {
+  Weights(const NpzConverter& model)
+    : W_(model["W"]),
+      Wo_(model.View({{"Wo", false}})),
+      B_(model.View({{"b", true}})),
+      WP_(W_),
+      Wq8_(model["Wo"]),
+      Wq16_(model["W"]),
+      layers_({model["W"], model("W", true)})
+  {}
+
+  Weights(const BinaryModel& model, const std::string& name)
+    : W_(model.Matrix(name + ".W")),
+      Wo_(model.View(name + ".Wo")),
+      B_(model.View(name + ".B")),
+      WP_(model.Packed(name + ".WP")),
+      Wq8_(model.Quantized8(name + ".Wq8")),
+      Wq16_(model.Quantized16(name + ".Wq16")),
+      layers_({model.Matrix(name + ".layers.0"), model.Matrix(name + ".layers.1")})
+  {}
+
+  template <class F>
+  void Visit(F&& f) const {
+    f("W", W_);
+    f("Wo", Wo_);
+    f("B", B_);
+    f("WP", WP_);
+    f("Wq8", Wq8_);
+    f("Wq16", Wq16_);
+    f("layers", layers_);
+  }
+
+  const mblas::Matrix W_;
+  const mblas::MatrixView Wo_;
+  const mblas::MatrixView B_;
+  const mblas::PackedMatrix WP_;
+  const mblas::QuantizedMatrix8 Wq8_;
+  const mblas::QuantizedMatrix16 Wq16_;
+  const std::vector<mblas::Matrix> layers_;
+};
+
+template <class M1, class M2>
+bool Same(const M1& a, const M2& b) {
+  if (a.rows() != b.rows() || a.columns() != b.columns()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.rows(); ++i) {
+    for (size_t j = 0; j < a.columns(); ++j) {
+      if (a(i, j) != b(i, j)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+template <class Q>
+bool SameQuantized(const Q& a, const Q& b) {
+  if (a.rows() != b.rows() || a.columns() != b.columns() || a.stride() != b.stride()) {
+    return false;
+  }
+  for (size_t j = 0; j < a.columns(); ++j) {
+    if (a.scale(j) != b.scale(j)
+        || !std::equal(a.column(j), a.column(j) + a.stride(), b.column(j))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<float> Values(size_t n, float step) {
+  std::vector<float> values(n);
+  for (size_t i = 0; i < n; ++i) {
+    values[i] = std::sin(i * step) * (i + 1);
+  }
+  return values;
+}
+
+}
+
+int main() {
+  spdlog::stderr_logger_mt("info");
+
+  // a W without a full panel of columns, so that the packed form is padded
+  const unsigned W[] = {37, 11};
+  const unsigned Wo[] = {9, 70};
+  const unsigned b[] = {1, 13};
+  std::vector<float> w = Values(W[0] * W[1], 0.3f);
+  std::vector<float> wo = Values(Wo[0] * Wo[1], 0.7f);
+  std::vector<float> bias = Values(b[0] * b[1], 1.1f);
+  cnpy::npz_save("model.npz", "W", w.data(), W, 2, "w");
+  cnpy::npz_save("model.npz", "Wo", wo.data(), Wo, 2, "a");
+  cnpy::npz_save("model.npz", "b", bias.data(), b, 2, "a");
+
+  NpzConverter npz("model.npz");
+  Weights original(npz);
+  CHECK(original.W_.rows() == 37 && original.W_.columns() == 11);
+  CHECK(original.W_(4, 3) == w[4 * 11 + 3]);
+  CHECK(original.B_.rows() == 13 && original.B_.columns() == 1);
+
+  mblas::QuantizationOptions quantization;
+  quantization.int16 = true;
+  quantization.vocabMajorOutput = true;
+  BinaryModelWriter writer("nematus2", quantization);
+  writer.Add("model", original);
+  auto roundTrip = test::SaveRoundTrip(
+      "model.bin",
+      [&](const std::string& path) { writer.Save(path); },
+      [](const std::string& path) { BinaryModel model(path); });
+  CHECK(BinaryModel::IsBinary("model.bin"));
+  CHECK(!BinaryModel::IsBinary("model.npz"));
+
+  {
+    BinaryModel model("model.bin");
+    CHECK(model.Type() == "nematus2");
+    CHECK(!(model.Quantization() != quantization));
+
+    Weights loaded(model, "model");
+    CHECK(Same(loaded.W_, original.W_));
+    CHECK(Same(loaded.Wo_, original.Wo_));
+    CHECK(Same(loaded.B_, original.B_));
+    CHECK(Same(loaded.WP_, original.WP_));
+    CHECK(Same(loaded.WP_, original.W_));
+    CHECK(SameQuantized(loaded.Wq8_, original.Wq8_));
+    CHECK(SameQuantized(loaded.Wq16_, original.Wq16_));
+    CHECK(loaded.layers_.size() == 2);
+    CHECK(loaded.layers_.size() == 2 && Same(loaded.layers_[0], original.layers_[0])
+          && Same(loaded.layers_[1], original.layers_[1]));
+
+    CHECK(model.Has("model.layers.1") && !model.Has("model.layers.2"));
+    CHECK_THROWS(model.Matrix("model.extra"), "Missing model.extra");
+    CHECK_THROWS(model.Packed("model.W"), "is of kind");
+  }
+
+  const std::string& file = roundTrip.File();
+
+  std::string version = file;
+  version[8] = 2;
+  CHECK_REFUSES(roundTrip, "version", version, "is a native model of version 2");
+
+  // the tensor table is there, the data is not
+  CHECK_REFUSES_CUT(roundTrip, "cut", file.size() - 64, "Broken tensor");
+
+  // cut off within the metadata
+  CHECK_REFUSES_CUT(roundTrip, "metadata", 30, "Broken model file");
+
+  std::string magic = file;
+  magic[0] = 'X';
+  CHECK_REFUSES(roundTrip, "magic", magic, "is not a native amun model");
+
+  return test::Failures() != 0;
+}
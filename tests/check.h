@@ -0,0 +1,116 @@
+#pragma once
+
+// Checks for the tests run by ctest. A failed check prints where and what
+// failed and is counted; a test's main returns Failures() != 0.
+
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+
+namespace amunmt {
+namespace test {
+
+inline int& Failures() {
+  static int failures = 0;
+  return failures;
+}
+
+inline void Fail(const char* file, int line, const std::string& message) {
+  std::cerr << file << ":" << line << ": " << message << std::endl;
+  ++Failures();
+}
+
+inline void WriteFile(const std::string& path, const std::string& content) {
+  std::ofstream out(path, std::ios::binary);
+  out << content;
+}
+
+inline std::string ReadFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+inline void CheckMessage(const char* file, int line, const std::exception& e, const std::string& text) {
+  if (std::string(e.what()).find(text) == std::string::npos) {
+    Fail(file, line, std::string("unexpected exception: ") + e.what());
+  }
+}
+
+// The binary formats are all tested the same way: the test saves a file,
+// loads it and compares it with what it was saved from, then damaged
+// copies of the file have to be refused by load. A copy is written next to
+// the file, "model.bin" damaged as "cut" to "model_cut.bin".
+template <class Load>
+class RoundTrip {
+  public:
+    RoundTrip(const std::string& path, Load load)
+      : path_(path),
+        load_(std::move(load)),
+        file_(ReadFile(path))
+    {}
+
+    // the saved file
+    const std::string& File() const {
+      return file_;
+    }
+
+    // load has to throw for content an exception whose message contains text
+    void Refuses(const char* file, int line, const std::string& damage,
+                 const std::string& content, const std::string& text) const {
+      size_t dot = path_.rfind('.');
+      std::string path = path_.substr(0, dot) + "_" + damage + path_.substr(dot);
+      WriteFile(path, content);
+      try {
+        load_(path);
+        Fail(file, line, "no exception loading " + path);
+      } catch (const std::exception& e) {
+        CheckMessage(file, line, e, text);
+      }
+    }
+
+    // the file cut off after size bytes
+    void RefusesCut(const char* file, int line, const std::string& damage,
+                    size_t size, const std::string& text) const {
+      Refuses(file, line, damage, file_.substr(0, size), text);
+    }
+
+  private:
+    const std::string path_;
+    const Load load_;
+    const std::string file_;
+};
+
+// save writes the file to path, load reads a file and throws if it is broken
+template <class Save, class Load>
+RoundTrip<Load> SaveRoundTrip(const std::string& path, Save&& save, Load load) {
+  save(path);
+  return RoundTrip<Load>(path, std::move(load));
+}
+
+}
+}
+
+#define CHECK(condition) do { \
+  if (!(condition)) { \
+    amunmt::test::Fail(__FILE__, __LINE__, "check failed: " #condition); \
+  } \
+} while (0)
+
+// statement has to throw an exception whose message contains text
+#define CHECK_THROWS(statement, text) do { \
+  try { \
+    statement; \
+    amunmt::test::Fail(__FILE__, __LINE__, "no exception from " #statement); \
+  } catch (const std::exception& e) { \
+    amunmt::test::CheckMessage(__FILE__, __LINE__, e, text); \
+  } \
+} while (0)
+
+// a damaged copy of the file of roundTrip has to be refused, see RoundTrip
+#define CHECK_REFUSES(roundTrip, damage, content, text) \
+  (roundTrip).Refuses(__FILE__, __LINE__, damage, content, text)
+
+#define CHECK_REFUSES_CUT(roundTrip, damage, size, text) \
+  (roundTrip).RefusesCut(__FILE__, __LINE__, damage, size, text)
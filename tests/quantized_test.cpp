@@ -0,0 +1,109 @@
+// The quantized products have to stay within the error their rounding
+// allows of the fp32 product they replace.
+
+#include "check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "common/logging.h"
+#include "cpu/mblas/matrix.h"
+#include "cpu/mblas/quantized.h"
+
+using namespace amunmt;
+using namespace amunmt::CPU;
+
+namespace {
+
+mblas::Matrix Random(size_t rows, size_t cols, std::mt19937& random) {
+  std::normal_distribution<float> normal;
+  mblas::Matrix matrix(rows, cols);
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t j = 0; j < cols; ++j) {
+      matrix(i, j) = normal(random);
+    }
+  }
+  return matrix;
+}
+
+// Element (i, j) of Out against In * W + Bias in double. Row i of In and
+// column j of W are rounded to steps of max / range each, the error of a
+// product is at most half a step of one times the other plus the product
+// of the half steps.
+template <class MT>
+bool WithinRounding(const mblas::Matrix& In, const mblas::Matrix& W, const float* bias,
+                    const MT& Out, float range) {
+  for (size_t i = 0; i < In.rows(); ++i) {
+    for (size_t j = 0; j < W.columns(); ++j) {
+      double exact = bias ? bias[j] : 0.0;
+      double sumIn = 0.0, sumW = 0.0, maxIn = 0.0, maxW = 0.0, sumProducts = 0.0;
+      for (size_t k = 0; k < W.rows(); ++k) {
+        exact += double(In(i, k)) * W(k, j);
+        sumIn += std::abs(In(i, k));
+        sumW += std::abs(W(k, j));
+        maxIn = std::max(maxIn, double(std::abs(In(i, k))));
+        maxW = std::max(maxW, double(std::abs(W(k, j))));
+        sumProducts += std::abs(In(i, k) * W(k, j));
+      }
+      double halfIn = maxIn / range / 2, halfW = maxW / range / 2;
+      double bound = halfIn * sumW + halfW * sumIn + W.rows() * halfIn * halfW
+                   + 1e-5 * (sumProducts + 1.0);
+      if (std::abs(Out(i, j) - exact) > bound) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+}
+
+int main() {
+  spdlog::stderr_logger_mt("info");
+  std::mt19937 random(1);
+
+  // neither the rows nor the columns fill the blocks of the kernels
+  mblas::Matrix In = Random(7, 70, random);
+  mblas::Matrix W = Random(70, 45, random);
+  mblas::Matrix Bias = Random(1, 45, random);
+
+  mblas::QuantizedMatrix8 W8(W);
+  CHECK(W8.rows() == 70 && W8.columns() == 45 && W8.stride() % 32 == 0);
+  mblas::ArrayMatrix Out8;
+  mblas::Int8Gemm(In, W8, Bias, Out8);
+  CHECK(Out8.rows() == 7 && Out8.columns() == 45);
+  CHECK(WithinRounding(In, W, Bias.data(), Out8, 127.0f));
+
+  // a row of zeros has no scale
+  mblas::Matrix Zero(1, 70);
+  Zero = 0.0f;
+  mblas::Int8Gemm(Zero, W8, Bias, Out8);
+  CHECK(WithinRounding(Zero, W, Bias.data(), Out8, 127.0f));
+
+  // the recurrent and attention matrices, a smaller rounding step
+  mblas::QuantizedMatrix16 W16(W);
+  CHECK(W16.range() > 127.0f && W16.range() <= 32767.0f);
+  mblas::Matrix Out16;
+  mblas::Int16Gemm(In, W16, Out16);
+  CHECK(Out16.rows() == 7 && Out16.columns() == 45);
+  CHECK(WithinRounding(In, W, nullptr, Out16, W16.range()));
+
+  // two matrices quantized side by side, as a GRU keeps its gates
+  mblas::Matrix W2 = Random(70, 20, random);
+  mblas::Matrix Both;
+  mblas::Int16Gemm(In, mblas::QuantizedMatrix16(W, W2), Both);
+  CHECK(Both.columns() == 65);
+  CHECK(blaze::submatrix(Both, 0, 0, 7, 45) == Out16);
+
+  // Multiply takes the int16 kernel only for a quantized matrix
+  mblas::PackedMatrix packed(W);
+  mblas::Matrix Out;
+  mblas::Multiply(Out, In, packed, W16);
+  CHECK(Out == Out16);
+  mblas::Multiply(Out, In, packed, mblas::QuantizedMatrix16());
+  CHECK(WithinRounding(In, W, nullptr, Out, 1e6f));
+
+  return test::Failures() != 0;
+}
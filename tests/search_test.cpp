@@ -0,0 +1,206 @@
+// The search has to give the same translations however a batch is
+// decoded. A tiny random dl4mt model is written first, then the same
+// sentences are translated with the options of each path.
+
+#include "check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cnpy/cnpy.h"
+#include "common/god.h"
+#include "common/history.h"
+#include "common/logging.h"
+#include "common/sentence.h"
+#include "common/sentences.h"
+#include "common/translation_task.h"
+
+using namespace amunmt;
+
+namespace {
+
+const size_t VOCAB = 20;
+const size_t EMB = 8;
+const size_t HIDDEN = 8;
+
+const std::vector<std::string> LINES = {
+  "w2 w3 w4",
+  "w5 w6 w7 w8 w9 w10",
+  "w11",
+  "w12 w13 w14 w15",
+  "w16 w17 w18 w19 w2 w3 w4 w5",
+};
+
+// the parameters CPU::dl4mt::Weights reads, with random values
+void WriteModel(const std::string& path) {
+  std::mt19937 random(1);
+  std::normal_distribution<float> normal;
+  std::string mode = "w";
+  auto add = [&](const std::string& name, std::vector<unsigned> shape, float scale) {
+    size_t size = 1;
+    for (unsigned n : shape) {
+      size *= n;
+    }
+    std::vector<float> values(size);
+    for (float& value : values) {
+      value = scale * normal(random);
+    }
+    cnpy::npz_save(path, name, values.data(), shape.data(), shape.size(), mode);
+    mode = "a";
+  };
+
+  const unsigned V = VOCAB, E = EMB, H = HIDDEN, C = 2 * HIDDEN;
+  for (std::string gru : {"encoder_", "encoder_r_", "decoder_"}) {
+    add(gru + "W", {E, 2 * H}, 0.3f);
+    add(gru + "b", {2 * H}, 0.3f);
+    add(gru + "U", {H, 2 * H}, 0.3f);
+    add(gru + "Wx", {E, H}, 0.3f);
+    add(gru + "bx", {H}, 0.3f);
+    add(gru + "Ux", {H, H}, 0.3f);
+  }
+  add("decoder_Wc", {C, 2 * H}, 0.3f);
+  add("decoder_b_nl", {2 * H}, 0.3f);
+  add("decoder_U_nl", {H, 2 * H}, 0.3f);
+  add("decoder_Wcx", {C, H}, 0.3f);
+  add("decoder_bx_nl", {H}, 0.3f);
+  add("decoder_Ux_nl", {H, H}, 0.3f);
+  add("decoder_U_att", {C, 1}, 0.3f);
+  add("decoder_W_comb_att", {H, C}, 0.3f);
+  add("decoder_b_att", {C}, 0.3f);
+  add("decoder_Wc_att", {C, C}, 0.3f);
+  add("decoder_c_tt", {1}, 0.3f);
+  add("Wemb", {V, E}, 1.0f);
+  add("Wemb_dec", {V, E}, 1.0f);
+  add("ff_state_W", {C, H}, 0.3f);
+  add("ff_state_b", {H}, 0.3f);
+  add("ff_logit_lstm_W", {H, E}, 0.3f);
+  add("ff_logit_lstm_b", {E}, 0.3f);
+  add("ff_logit_prev_W", {E, E}, 0.3f);
+  add("ff_logit_prev_b", {E}, 0.3f);
+  add("ff_logit_ctx_W", {C, E}, 0.3f);
+  add("ff_logit_ctx_b", {E}, 0.3f);
+  add("ff_logit_W", {E, V}, 1.0f);
+  add("ff_logit_b", {V}, 0.3f);
+}
+
+void WriteConfig() {
+  WriteModel("search.npz");
+  std::string vocab = "\"</s>\": 0\n\"<unk>\": 1\n";
+  for (size_t i = 2; i < VOCAB; ++i) {
+    vocab += "w" + std::to_string(i) + ": " + std::to_string(i) + "\n";
+  }
+  test::WriteFile("search_vocab.yml", vocab);
+  test::WriteFile("search.yml",
+                  "scorers:\n"
+                  "  F0:\n"
+                  "    type: Nematus\n"
+                  "    path: search.npz\n"
+                  "weights:\n"
+                  "  F0: 1.0\n"
+                  "source-vocab: search_vocab.yml\n"
+                  "target-vocab: search_vocab.yml\n");
+}
+
+// the best translation of every line, the lines in the given batches
+std::vector<Result> Translate(const std::string& options, const std::vector<std::vector<size_t>>& batches) {
+  std::vector<Result> results(LINES.size());
+  {
+    God god;
+    god.Init("-c search.yml --cpu-threads 1 --log-progress off " + options);
+    for (auto& batch : batches) {
+      std::shared_ptr<Sentences> sentences(new Sentences());
+      for (size_t lineNo : batch) {
+        sentences->push_back(SentencePtr(new Sentence(god, lineNo, LINES[lineNo])));
+      }
+      std::shared_ptr<Histories> histories = TranslationTask(god, sentences);
+      for (size_t i = 0; i < histories->size(); ++i) {
+        results[histories->at(i)->GetLineNum()] = histories->at(i)->Top();
+      }
+    }
+  }
+  // the next God registers them again
+  spdlog::drop_all();
+  return results;
+}
+
+// all lines in one batch
+std::vector<Result> Translate(const std::string& options) {
+  std::vector<size_t> batch;
+  for (size_t i = 0; i < LINES.size(); ++i) {
+    batch.push_back(i);
+  }
+  return Translate(options, {batch});
+}
+
+// every line on its own
+std::vector<Result> TranslateOneByOne(const std::string& options) {
+  std::vector<std::vector<size_t>> batches;
+  for (size_t i = 0; i < LINES.size(); ++i) {
+    batches.push_back({i});
+  }
+  return Translate(options, batches);
+}
+
+// same words, costs of b scale times those of a up to the rounding of a
+// different order of operations
+bool Same(const std::vector<Result>& a, const std::vector<Result>& b, float scale = 1.0f) {
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].first != b[i].first
+        || std::abs(scale * a[i].second->GetCost() - b[i].second->GetCost()) > 1e-3f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+int main() {
+  WriteConfig();
+
+  // with normalization the best translations are longer than a word; the
+  // hypotheses of the results outlive their histories and the God
+  const std::string BEAM = "--beam-size 5 --normalize";
+  std::vector<Result> beam = Translate(BEAM);
+  for (auto& result : beam) {
+    CHECK(result.first.size() > 1 && result.second->GetCost() < 0.0f);
+  }
+
+  // padded batch of sentences of different lengths
+  CHECK(Same(beam, TranslateOneByOne(BEAM)));
+
+  // A sentence stops once its result cannot change any more. Without early
+  // stopping the sentences of a batch run to the limit of the longest one,
+  // so alone they have to give the same.
+  CHECK(Same(beam, TranslateOneByOne(BEAM + " --no-early-stopping")));
+  CHECK(Same(Translate("--beam-size 5"), TranslateOneByOne("--beam-size 5 --no-early-stopping")));
+
+  // greedy decoding, the rows of finished sentences drop out of the batch
+  std::vector<Result> greedy = Translate("--beam-size 1");
+  for (size_t i = 0; i < greedy.size(); ++i) {
+    const Words& words = greedy[i].first;
+    // the words of the line and </s>
+    size_t length = std::count(LINES[i].begin(), LINES[i].end(), ' ') + 2;
+    CHECK(!words.empty() && (words.back() == EOS_ID || words.size() == 3 * length));
+  }
+  CHECK(Same(greedy, TranslateOneByOne("--beam-size 1")));
+
+  // best-first search expanding one entry into one candidate follows the
+  // greedy path
+  CHECK(Same(greedy, Translate("--search best-first --beam-size 1 --best-first-batch 1")));
+  CHECK(Same(Translate("--search best-first " + BEAM),
+             TranslateOneByOne("--search best-first " + BEAM)));
+
+  // A single model only hands the best words of every row to the search.
+  // The model twice gives the same words at twice the cost, through the
+  // full log-softmax of both.
+  const std::string TWICE = " -m search.npz search.npz";
+  CHECK(Same(beam, Translate(BEAM + TWICE), 2.0f));
+  CHECK(Same(Translate("--search best-first " + BEAM),
+             Translate("--search best-first " + BEAM + TWICE), 2.0f));
+
+  return test::Failures() != 0;
+}
@@ -0,0 +1,92 @@
+// The binary shortlist written by amun-shortlist has to give the same
+// vocabularies as the text alignment file it was converted from, and a
+// file that does not fit the vocabularies or is damaged has to be refused.
+
+#include "check.h"
+
+#include "common/filter.h"
+#include "common/logging.h"
+#include "common/vocab.h"
+
+using namespace amunmt;
+
+namespace {
+
+const char* SRC_VOCAB = "{\"</s>\": 0, \"<unk>\": 1, \"a\": 2, \"b\": 3, \"c\": 4, \"d\": 5}";
+const char* TRG_VOCAB = "{\"</s>\": 0, \"<unk>\": 1, \"x\": 2, \"y\": 3, \"z\": 4, \"w\": 5, \"v\": 6}";
+
+// target, source and probability; "q" and "e" are not in the vocabularies
+const char* ALIGNMENTS =
+  "x a 0.5\n"
+  "y a 0.7\n"
+  "q a 0.9\n"
+  "z b 0.1\n"
+  "w b 0.9\n"
+  "v b 0.4\n"
+  "x e 0.3\n"
+  "y c 0.2\n";
+
+void CheckSameVocabs(const Filter& text, const Filter& binary) {
+  for (Word a = 0; a < 7; ++a) {
+    for (Word b = 0; b < 7; ++b) {
+      for (size_t maxVocabSize : {3, 5, 7}) {
+        Words srcWords = {a, b};
+        CHECK(text.GetFilteredVocab(srcWords, maxVocabSize)
+              == binary.GetFilteredVocab(srcWords, maxVocabSize));
+      }
+    }
+  }
+}
+
+}
+
+int main() {
+  spdlog::stderr_logger_mt("info");
+
+  test::WriteFile("shortlist_src.yml", SRC_VOCAB);
+  test::WriteFile("shortlist_trg.yml", TRG_VOCAB);
+  test::WriteFile("shortlist.txt", ALIGNMENTS);
+  Vocab srcVocab("shortlist_src.yml");
+  Vocab trgVocab("shortlist_trg.yml");
+
+  Filter text(srcVocab, trgVocab, "shortlist.txt", 2);
+  CHECK(!Filter::IsBinary("shortlist.txt"));
+  auto roundTrip = test::SaveRoundTrip(
+      "shortlist.bin",
+      [&](const std::string& path) { text.Save(path); },
+      [&](const std::string& path) { Filter(srcVocab, trgVocab, path); });
+  CHECK(Filter::IsBinary("shortlist.bin"));
+
+  // "b": w, v and z by probability, after the first two words
+  CHECK(text.GetFilteredVocab({3}, 7) == Words({0, 1, 4, 5, 6}));
+
+  Filter binary(srcVocab, trgVocab, "shortlist.bin", 2);
+  CheckSameVocabs(text, binary);
+
+  // the most probable translations only
+  Filter textBest(srcVocab, trgVocab, "shortlist.txt", 2, 1);
+  Filter binaryBest(srcVocab, trgVocab, "shortlist.bin", 2, 1);
+  CHECK(binaryBest.GetFilteredVocab({2, 3}, 7) == Words({0, 1, 3, 5}));
+  CheckSameVocabs(textBest, binaryBest);
+
+  // converted for other vocabularies
+  test::WriteFile("shortlist_small.yml", "{\"</s>\": 0, \"<unk>\": 1, \"x\": 2}");
+  Vocab smallVocab("shortlist_small.yml");
+  CHECK_THROWS(Filter(srcVocab, smallVocab, "shortlist.bin"), "was converted for vocabularies");
+
+  const std::string& file = roundTrip.File();
+  // cut off after the header
+  CHECK_REFUSES_CUT(roundTrip, "cut", 20 + 3 * 4, "Broken softmax filter file");
+
+  // a target word beyond the vocabulary
+  std::string outOfRange = file;
+  outOfRange[outOfRange.size() - 4] = 100;
+  CHECK_REFUSES(roundTrip, "range", outOfRange, "Broken softmax filter file");
+
+  // decreasing offsets
+  std::string offsets = file;
+  offsets[20 + 4] = 100;
+  CHECK_REFUSES(roundTrip, "offsets", offsets, "Broken softmax filter file");
+
+  return test::Failures() != 0;
+}
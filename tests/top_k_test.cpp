@@ -0,0 +1,144 @@
+// The k best words of every row, taken from tiles of logits as the output
+// layer computes them, have to be those of the full log-softmax with the
+// same costs.
+
+#include "check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "common/logging.h"
+#include "cpu/mblas/matrix.h"
+#include "cpu/mblas/packed.h"
+#include "cpu/mblas/quantized.h"
+#include "cpu/mblas/top_k.h"
+
+using namespace amunmt;
+using namespace amunmt::CPU;
+
+namespace {
+
+mblas::Matrix Random(size_t rows, size_t cols, std::mt19937& random) {
+  std::normal_distribution<float> normal;
+  mblas::Matrix matrix(rows, cols);
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t j = 0; j < cols; ++j) {
+      matrix(i, j) = normal(random);
+    }
+  }
+  return matrix;
+}
+
+struct TopK {
+  std::vector<size_t> words;
+  std::vector<float> costs;
+};
+
+// the k best columns of every row of the full log-softmax, in the order of
+// LogSoftmaxTopK::Finish
+template <class MT>
+TopK Reference(const MT& Logits, size_t k, size_t maskedColumn) {
+  mblas::Matrix probs(Logits.rows(), Logits.columns());
+  probs = Logits;
+  mblas::LogSoftmax(probs);
+
+  TopK topK;
+  for (size_t i = 0; i < probs.rows(); ++i) {
+    std::vector<size_t> order(probs.columns());
+    std::iota(order.begin(), order.end(), 0);
+    order.erase(std::remove(order.begin(), order.end(), maskedColumn), order.end());
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return probs(i, a) > probs(i, b);
+    });
+    order.resize(std::min(k, order.size()));
+    for (size_t word : order) {
+      topK.words.push_back(word);
+      topK.costs.push_back(probs(i, word));
+    }
+  }
+  return topK;
+}
+
+// Logits passed to LogSoftmaxTopK in tiles of the given widths
+TopK FromTiles(const mblas::Matrix& Logits, size_t k, size_t maskedColumn,
+               const std::vector<size_t>& tiles) {
+  mblas::LogSoftmaxTopK logSoftmaxTopK;
+  logSoftmaxTopK.Begin(Logits.rows(), Logits.columns(), k, maskedColumn);
+  size_t col = 0;
+  for (size_t n : tiles) {
+    logSoftmaxTopK.Add(&Logits(0, col), Logits.spacing(), col, n);
+    col += n;
+  }
+  TopK topK;
+  logSoftmaxTopK.Finish(topK.words, topK.costs);
+  return topK;
+}
+
+bool Same(const TopK& a, const TopK& b) {
+  if (a.words != b.words || a.costs.size() != b.costs.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.costs.size(); ++i) {
+    if (std::abs(a.costs[i] - b.costs[i]) > 1e-4f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+int main() {
+  spdlog::stderr_logger_mt("info");
+  std::mt19937 random(1);
+
+  // a tie at the top of row 0, the smaller word comes first
+  mblas::Matrix Logits = Random(5, 100, random);
+  Logits(0, 40) = 10.0f;
+  Logits(0, 7) = 10.0f;
+
+  for (auto& tiles : std::vector<std::vector<size_t>>{{100}, {16, 16, 68}, {7, 93}}) {
+    CHECK(Same(FromTiles(Logits, 5, 1, tiles), Reference(Logits, 5, 1)));
+    CHECK(Same(FromTiles(Logits, 5, 100, tiles), Reference(Logits, 5, 100)));
+  }
+  TopK tie = FromTiles(Logits, 2, 100, {100});
+  CHECK(tie.words[0] == 7 && tie.words[1] == 40);
+
+  // more words asked for than there are, less the masked one
+  TopK all = FromTiles(Logits, 200, 1, {100});
+  CHECK(all.words.size() == 5 * 99);
+  CHECK(Same(all, Reference(Logits, 200, 1)));
+
+  // the output layer, in more than one tile of columns
+  mblas::Matrix In = Random(40, 16, random);
+  mblas::Matrix W = Random(16, 2000, random);
+  mblas::Matrix Bias = Random(1, 2000, random);
+
+  mblas::Matrix Out;
+  mblas::PackedMatrix packed(W);
+  mblas::PackedGemm(In, packed, Out);
+  for (size_t i = 0; i < Out.rows(); ++i) {
+    blaze::row(Out, i) += blaze::row(Bias, 0);
+  }
+  mblas::LogSoftmaxTopK logSoftmaxTopK;
+  TopK gemm;
+  logSoftmaxTopK.Begin(In.rows(), W.columns(), 8, 1);
+  mblas::GemmTopK(In, packed, Bias, logSoftmaxTopK);
+  logSoftmaxTopK.Finish(gemm.words, gemm.costs);
+  CHECK(Same(gemm, Reference(Out, 8, 1)));
+
+  // the same logits as the int8 product
+  mblas::QuantizedMatrix8 W8(W);
+  mblas::ArrayMatrix Out8;
+  mblas::Int8Gemm(In, W8, Bias, Out8);
+  TopK int8;
+  logSoftmaxTopK.Begin(In.rows(), W.columns(), 8, 1);
+  mblas::Int8GemmTopK(In, W8, Bias, logSoftmaxTopK);
+  logSoftmaxTopK.Finish(int8.words, int8.costs);
+  CHECK(Same(int8, Reference(Out8, 8, 1)));
+
+  return test::Failures() != 0;
+}
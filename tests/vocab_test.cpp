@@ -0,0 +1,85 @@
+// A vocabulary converted by amun-vocab has to map words and ids exactly as
+// the YAML or JSON file it was converted from, and a damaged binary file
+// has to be refused.
+
+#include "check.h"
+
+#include <string>
+#include <vector>
+
+#include "common/logging.h"
+#include "common/vocab.h"
+
+using namespace amunmt;
+
+namespace {
+
+void CheckSame(const Vocab& yaml, const Vocab& binary, const std::vector<std::string>& words) {
+  CHECK(yaml.size() == binary.size());
+  for (size_t id = 0; id < yaml.size() && id < binary.size(); ++id) {
+    CHECK(yaml[id] == binary[id]);
+  }
+  for (const std::string& word : words) {
+    CHECK(yaml[word] == binary[word]);
+  }
+}
+
+}
+
+int main() {
+  spdlog::stderr_logger_mt("info");
+
+  // "Haus" twice, the last id is kept; id 6 is left out
+  test::WriteFile("vocab.yml",
+                  "\"</s>\": 0\n"
+                  "\"<unk>\": 1\n"
+                  "das: 2\n"
+                  "Haus: 3\n"
+                  "\"ist\": 4\n"
+                  "\"größer\": 5\n"
+                  "\"\\\"\": 7\n"
+                  "Haus: 8\n");
+  test::WriteFile("vocab.json",
+                  "{\"</s>\": 0, \"<unk>\": 1, \"a\": 2, \"b c\": 3}");
+  const std::vector<std::string> words = {"</s>", "<unk>", "das", "Haus", "ist", "größer",
+                                          "\"", "haus", "da", "dass", "", "b c", "a"};
+
+  Vocab yaml("vocab.yml");
+  CHECK(!Vocab::IsBinary("vocab.yml"));
+  CHECK(yaml["Haus"] == 8);
+  CHECK(yaml["größer"] == 5);
+  CHECK(yaml["\""] == 7);
+  CHECK(yaml["haus"] == UNK_ID);
+  CHECK(yaml.size() == 9);
+
+  auto roundTrip = test::SaveRoundTrip(
+      "vocab.bin",
+      [&](const std::string& path) { yaml.Save(path); },
+      [](const std::string& path) { Vocab vocab(path); });
+  CHECK(Vocab::IsBinary("vocab.bin"));
+  Vocab binary("vocab.bin");
+  CheckSame(yaml, binary, words);
+  CHECK(binary("das Haus  ist größer dass") == Words({2, 8, 4, 5, UNK_ID, EOS_ID}));
+  CHECK(binary(Words({2, 8, 0})) == std::vector<std::string>({"das", "Haus"}));
+
+  Vocab json("vocab.json");
+  json.Save("vocab_json.bin");
+  CheckSame(json, Vocab("vocab_json.bin"), words);
+
+  const std::string& file = roundTrip.File();
+  CHECK_REFUSES_CUT(roundTrip, "cut", file.size() - 1, "Broken vocabulary file");
+  CHECK_REFUSES_CUT(roundTrip, "header", 12, "Broken vocabulary file");
+
+  // the blob size does not match the last offset
+  std::string blob = file;
+  blob[12] += 1;
+  CHECK_REFUSES(roundTrip, "blob", blob + "x", "Broken vocabulary file");
+
+  // the second offset after the third
+  std::string offsets = file;
+  const size_t count = static_cast<unsigned char>(file[8]);
+  offsets[16 + 4 * count + 4] = 100;
+  CHECK_REFUSES(roundTrip, "offsets", offsets, "Broken vocabulary file");
+
+  return test::Failures() != 0;
+}